@@ -48,6 +48,7 @@ extern "C"
 #include "mlt_repository.h"
 #include "mlt_log.h"
 #include "mlt_cache.h"
+#include "mlt_audio.h"
 #include "mlt_version.h"
 
 #ifdef __cplusplus
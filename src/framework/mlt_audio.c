@@ -0,0 +1,397 @@
+/**
+ * \file mlt_audio.c
+ * \brief audio sample format conversion and mixing
+ * \see mlt_audio_convert
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mlt_audio.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(USE_SSE2) && defined(__SSE2__)
+#include <emmintrin.h>
+#define AUDIO_SSE2
+#endif
+
+/** the number of 32-bit samples in the buffer used to change the layout and the type at once */
+#define TEMP_SAMPLES (4096)
+
+/** The type of a sample regardless of the layout. */
+
+enum
+{
+	type_s16,
+	type_s32,
+	type_f32
+};
+
+static int sample_type( mlt_audio_format format )
+{
+	switch ( format )
+	{
+		case mlt_audio_s16:    return type_s16;
+		case mlt_audio_s32le:
+		case mlt_audio_s32:    return type_s32;
+		case mlt_audio_f32le:
+		case mlt_audio_float:  return type_f32;
+		default:               return -1;
+	}
+}
+
+static int sample_planar( mlt_audio_format format )
+{
+	return format == mlt_audio_s32 || format == mlt_audio_float;
+}
+
+static void s16_to_s32( int32_t *dest, const int16_t *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128i zero = _mm_setzero_si128( );
+	for ( ; i + 8 <= n; i += 8 )
+	{
+		__m128i x = _mm_loadu_si128( ( const __m128i* )( src + i ) );
+		_mm_storeu_si128( ( __m128i* )( dest + i ), _mm_unpacklo_epi16( zero, x ) );
+		_mm_storeu_si128( ( __m128i* )( dest + i + 4 ), _mm_unpackhi_epi16( zero, x ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+		dest[ i ] = ( int32_t )src[ i ] << 16;
+}
+
+static void s16_to_f32( float *dest, const int16_t *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128 scale = _mm_set1_ps( 1.0f / 32768.0f );
+	for ( ; i + 8 <= n; i += 8 )
+	{
+		__m128i x = _mm_loadu_si128( ( const __m128i* )( src + i ) );
+		__m128i lo = _mm_srai_epi32( _mm_unpacklo_epi16( x, x ), 16 );
+		__m128i hi = _mm_srai_epi32( _mm_unpackhi_epi16( x, x ), 16 );
+		_mm_storeu_ps( dest + i, _mm_mul_ps( _mm_cvtepi32_ps( lo ), scale ) );
+		_mm_storeu_ps( dest + i + 4, _mm_mul_ps( _mm_cvtepi32_ps( hi ), scale ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+		dest[ i ] = ( float )src[ i ] * ( 1.0f / 32768.0f );
+}
+
+static void s32_to_s16( int16_t *dest, const int32_t *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	for ( ; i + 8 <= n; i += 8 )
+	{
+		__m128i lo = _mm_srai_epi32( _mm_loadu_si128( ( const __m128i* )( src + i ) ), 16 );
+		__m128i hi = _mm_srai_epi32( _mm_loadu_si128( ( const __m128i* )( src + i + 4 ) ), 16 );
+		_mm_storeu_si128( ( __m128i* )( dest + i ), _mm_packs_epi32( lo, hi ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+		dest[ i ] = src[ i ] >> 16;
+}
+
+static void s32_to_f32( float *dest, const int32_t *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128 scale = _mm_set1_ps( 1.0f / 2147483648.0f );
+	for ( ; i + 4 <= n; i += 4 )
+	{
+		__m128i x = _mm_loadu_si128( ( const __m128i* )( src + i ) );
+		_mm_storeu_ps( dest + i, _mm_mul_ps( _mm_cvtepi32_ps( x ), scale ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+		dest[ i ] = ( float )src[ i ] * ( 1.0f / 2147483648.0f );
+}
+
+static void f32_to_s16( int16_t *dest, const float *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128 lower = _mm_set1_ps( -1.0f );
+	__m128 upper = _mm_set1_ps( 1.0f );
+	__m128 scale = _mm_set1_ps( 32767.0f );
+	for ( ; i + 8 <= n; i += 8 )
+	{
+		__m128 a = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( src + i ), lower ), upper );
+		__m128 b = _mm_min_ps( _mm_max_ps( _mm_loadu_ps( src + i + 4 ), lower ), upper );
+		__m128i lo = _mm_cvttps_epi32( _mm_mul_ps( a, scale ) );
+		__m128i hi = _mm_cvttps_epi32( _mm_mul_ps( b, scale ) );
+		_mm_storeu_si128( ( __m128i* )( dest + i ), _mm_packs_epi32( lo, hi ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+	{
+		float f = src[ i ];
+		f = f > 1.0f ? 1.0f : f < -1.0f ? -1.0f : f;
+		dest[ i ] = 32767.0f * f;
+	}
+}
+
+static void f32_to_s32( int32_t *dest, const float *src, int n )
+{
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128 lower = _mm_set1_ps( -1.0f );
+	__m128 scale = _mm_set1_ps( 2147483648.0f );
+	for ( ; i + 4 <= n; i += 4 )
+	{
+		__m128 f = _mm_mul_ps( _mm_max_ps( _mm_loadu_ps( src + i ), lower ), scale );
+		// The conversion gives 0x80000000 when it overflows, which flips to the maximum
+		__m128i overflow = _mm_castps_si128( _mm_cmpge_ps( f, scale ) );
+		_mm_storeu_si128( ( __m128i* )( dest + i ), _mm_xor_si128( _mm_cvttps_epi32( f ), overflow ) );
+	}
+#endif
+	for ( ; i < n; i++ )
+	{
+		float f = src[ i ];
+		f = f < -1.0f ? -1.0f : f;
+		dest[ i ] = f >= 1.0f ? INT32_MAX : ( int32_t )( 2147483648.0f * f );
+	}
+}
+
+/** Convert a run of samples from one type to another.
+*/
+
+static void convert_run( void *dest, int dest_type, const void *src, int src_type, int n )
+{
+	if ( dest_type == src_type )
+	{
+		memcpy( dest, src, n * ( dest_type == type_s16 ? sizeof( int16_t ) : sizeof( int32_t ) ) );
+	}
+	else if ( src_type == type_s16 )
+	{
+		if ( dest_type == type_s32 )
+			s16_to_s32( dest, src, n );
+		else
+			s16_to_f32( dest, src, n );
+	}
+	else if ( src_type == type_s32 )
+	{
+		if ( dest_type == type_s16 )
+			s32_to_s16( dest, src, n );
+		else
+			s32_to_f32( dest, src, n );
+	}
+	else
+	{
+		if ( dest_type == type_s16 )
+			f32_to_s16( dest, src, n );
+		else
+			f32_to_s32( dest, src, n );
+	}
+}
+
+/** Split n interleaved 32-bit samples into the planes of length samples from offset.
+*/
+
+static void deinterleave( int32_t *dest, int length, int offset, const int32_t *src, int channels, int n )
+{
+	int c, i = 0;
+
+	dest += offset;
+	if ( channels == 2 )
+	{
+		int32_t *left = dest;
+		int32_t *right = dest + length;
+#ifdef AUDIO_SSE2
+		for ( ; i + 4 <= n; i += 4 )
+		{
+			__m128 a = _mm_loadu_ps( ( const float* )( src + 2 * i ) );
+			__m128 b = _mm_loadu_ps( ( const float* )( src + 2 * i + 4 ) );
+			_mm_storeu_ps( ( float* )( left + i ), _mm_shuffle_ps( a, b, _MM_SHUFFLE( 2, 0, 2, 0 ) ) );
+			_mm_storeu_ps( ( float* )( right + i ), _mm_shuffle_ps( a, b, _MM_SHUFFLE( 3, 1, 3, 1 ) ) );
+		}
+#endif
+		for ( ; i < n; i++ )
+		{
+			left[ i ] = src[ 2 * i ];
+			right[ i ] = src[ 2 * i + 1 ];
+		}
+	}
+	else
+	{
+		for ( c = 0; c < channels; c++, dest += length )
+			for ( i = 0; i < n; i++ )
+				dest[ i ] = src[ i * channels + c ];
+	}
+}
+
+/** Merge n samples from offset of the planes of length samples into interleaved 32-bit samples.
+*/
+
+static void interleave( int32_t *dest, const int32_t *src, int length, int offset, int channels, int n )
+{
+	int c, i = 0;
+
+	src += offset;
+	if ( channels == 2 )
+	{
+		const int32_t *left = src;
+		const int32_t *right = src + length;
+#ifdef AUDIO_SSE2
+		for ( ; i + 4 <= n; i += 4 )
+		{
+			__m128 a = _mm_loadu_ps( ( const float* )( left + i ) );
+			__m128 b = _mm_loadu_ps( ( const float* )( right + i ) );
+			_mm_storeu_ps( ( float* )( dest + 2 * i ), _mm_unpacklo_ps( a, b ) );
+			_mm_storeu_ps( ( float* )( dest + 2 * i + 4 ), _mm_unpackhi_ps( a, b ) );
+		}
+#endif
+		for ( ; i < n; i++ )
+		{
+			dest[ 2 * i ] = left[ i ];
+			dest[ 2 * i + 1 ] = right[ i ];
+		}
+	}
+	else
+	{
+		for ( c = 0; c < channels; c++, src += length )
+			for ( i = 0; i < n; i++ )
+				dest[ i * channels + c ] = src[ i ];
+	}
+}
+
+/** Convert a block of audio from one format to another.
+ *
+ * Any pair of formats may be converted, changing the type of the samples and
+ * the layout of the channels in a single pass. A change of layout is done in
+ * blocks small enough to stay in the cache, which matters with many channels.
+ * Floats are clipped to -1.0 to 1.0. The buffers must not overlap.
+ *
+ * \public \memberof mlt_frame_s
+ * \param dest the buffer to receive the converted audio
+ * \param dest_format the format of \p dest
+ * \param src the audio to convert
+ * \param src_format the format of \p src
+ * \param samples the number of samples per channel
+ * \param channels the number of channels
+ * \return true if either format is invalid
+ */
+
+int mlt_audio_convert( void *dest, mlt_audio_format dest_format, const void *src, mlt_audio_format src_format, int samples, int channels )
+{
+	int dest_type = sample_type( dest_format );
+	int src_type = sample_type( src_format );
+	int dest_size = dest_type == type_s16 ? sizeof( int16_t ) : sizeof( int32_t );
+	int src_size = src_type == type_s16 ? sizeof( int16_t ) : sizeof( int32_t );
+	int frames = channels > 0 ? TEMP_SAMPLES / channels : 0;
+	int32_t temp[ TEMP_SAMPLES ];
+	int offset, n;
+
+	if ( dest_type < 0 || src_type < 0 || samples < 0 || frames <= 0 )
+		return 1;
+
+	if ( channels == 1 || sample_planar( dest_format ) == sample_planar( src_format ) )
+	{
+		convert_run( dest, dest_type, src, src_type, samples * channels );
+	}
+	else if ( sample_planar( src_format ) )
+	{
+		for ( offset = 0; offset < samples; offset += n )
+		{
+			uint8_t *out = ( uint8_t* )dest + offset * channels * dest_size;
+			n = samples - offset < frames ? samples - offset : frames;
+			if ( dest_type == src_type )
+			{
+				interleave( ( int32_t* )out, src, samples, offset, channels, n );
+			}
+			else
+			{
+				interleave( temp, src, samples, offset, channels, n );
+				convert_run( out, dest_type, temp, src_type, n * channels );
+			}
+		}
+	}
+	else
+	{
+		for ( offset = 0; offset < samples; offset += n )
+		{
+			const uint8_t *in = ( const uint8_t* )src + offset * channels * src_size;
+			n = samples - offset < frames ? samples - offset : frames;
+			if ( dest_type == src_type )
+			{
+				deinterleave( dest, samples, offset, ( const int32_t* )in, channels, n );
+			}
+			else
+			{
+				convert_run( temp, dest_type, in, src_type, n * channels );
+				deinterleave( dest, samples, offset, temp, channels, n );
+			}
+		}
+	}
+
+	return 0;
+}
+
+/** Sum planes of float samples into one, applying a gain ramp to each.
+ *
+ * This is the mixing bus: each input is a plane of one channel, so a mixdown of
+ * any number of channels sums the planes of each channel in turn. The gain of
+ * an input goes from its start value at the first sample towards its end value
+ * at the last, and all of the inputs are summed in a single pass. The
+ * destination may be one of the inputs.
+ *
+ * \public \memberof mlt_frame_s
+ * \param dest the plane to receive the sum
+ * \param inputs the planes to sum
+ * \param start the gain of each input at the first sample, or NULL for unity
+ * \param end the gain of each input after the last sample, or NULL for unity
+ * \param count the number of inputs
+ * \param samples the number of samples in each plane
+ */
+
+void mlt_audio_mix( float *dest, const float **inputs, const float *start, const float *end, int count, int samples )
+{
+	int i = 0, k;
+
+	if ( samples <= 0 )
+		return;
+#ifdef AUDIO_SSE2
+	{
+		__m128 offsets = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+		for ( ; i + 4 <= samples; i += 4 )
+		{
+			__m128 sum = _mm_setzero_ps( );
+			__m128 position = _mm_add_ps( _mm_set1_ps( ( float )i ), offsets );
+			for ( k = 0; k < count; k++ )
+			{
+				float gain = start ? start[ k ] : 1.0f;
+				float step = ( ( end ? end[ k ] : 1.0f ) - gain ) / samples;
+				__m128 ramp = _mm_add_ps( _mm_set1_ps( gain ), _mm_mul_ps( _mm_set1_ps( step ), position ) );
+				sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( inputs[ k ] + i ), ramp ) );
+			}
+			_mm_storeu_ps( dest + i, sum );
+		}
+	}
+#endif
+	for ( ; i < samples; i++ )
+	{
+		float sum = 0.0f;
+		for ( k = 0; k < count; k++ )
+		{
+			float gain = start ? start[ k ] : 1.0f;
+			float step = ( ( end ? end[ k ] : 1.0f ) - gain ) / samples;
+			sum += inputs[ k ][ i ] * ( gain + step * i );
+		}
+		dest[ i ] = sum;
+	}
+}
@@ -0,0 +1,29 @@
+/**
+ * \file mlt_audio.h
+ * \brief audio sample format conversion and mixing
+ * \see mlt_audio_convert
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _MLT_AUDIO_H_
+#define _MLT_AUDIO_H_
+
+#include "mlt_types.h"
+
+extern int mlt_audio_convert( void *dest, mlt_audio_format dest_format, const void *src, mlt_audio_format src_format, int samples, int channels );
+extern void mlt_audio_mix( float *dest, const float **inputs, const float *start, const float *end, int count, int samples );
+
+#endif
@@ -30,7 +30,10 @@
 #include <pthread.h>
 
 /** the maximum number of data objects to cache per line */
-#define MAX_CACHE_SIZE (10)
+#define MAX_CACHE_SIZE (200)
+
+/** the default number of data objects to cache per line */
+#define DEFAULT_CACHE_SIZE (10)
 
 /** \brief Cache item class
  *
@@ -178,7 +181,7 @@ void mlt_cache_item_close( mlt_cache_item item )
 
 /** Create a new cache.
  *
- * The default size is \p MAX_CACHE_SIZE.
+ * The default size is \p DEFAULT_CACHE_SIZE.
  * \public \memberof mlt_cache_s
  * \return a new cache or NULL if there was an error
  */
@@ -188,7 +191,7 @@ mlt_cache mlt_cache_init()
 	mlt_cache result = calloc( 1, sizeof( struct mlt_cache_s ) );
 	if ( result )
 	{
-		result->size = MAX_CACHE_SIZE;
+		result->size = DEFAULT_CACHE_SIZE;
 		result->current = result->A;
 		pthread_mutex_init( &result->mutex, NULL );
 		result->active = mlt_properties_new();
@@ -598,6 +598,100 @@ static inline long time_difference( struct timeval *time1 )
  * \param arg a consumer
  */
 
+/** The audio render thread.
+ *
+ * When audio_ahead is set, this thread gets the frames from the producer and
+ * renders their audio, running up to audio_ahead frames ahead of the read
+ * ahead thread, which then only renders the images. Audio is then never held
+ * up by video.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param arg a consumer
+ */
+
+static void *consumer_audio_thread( void *arg )
+{
+	// The argument is the consumer
+	mlt_consumer self = arg;
+
+	// Get the properties of the consumer
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+
+	// Get the audio settings
+	mlt_audio_format afmt = mlt_audio_s16;
+	int counter = 0;
+	double fps = mlt_properties_get_double( properties, "fps" );
+	int channels = mlt_properties_get_int( properties, "channels" );
+	int frequency = mlt_properties_get_int( properties, "frequency" );
+	int samples = 0;
+	void *audio = NULL;
+
+	// See if audio is turned off
+	int audio_off = mlt_properties_get_int( properties, "audio_off" );
+
+	// Get the maximum number of frames to run ahead
+	int ahead = mlt_properties_get_int( properties, "audio_ahead" );
+
+	// General frame variable
+	mlt_frame frame = NULL;
+
+	while ( self->ahead )
+	{
+		// Get the next frame
+		frame = mlt_consumer_get_frame( self );
+
+		// If there's no frame, we're probably stopped...
+		if ( frame == NULL )
+			continue;
+
+		if ( !audio_off )
+		{
+			samples = mlt_sample_calculator( fps, frequency, counter++ );
+			mlt_frame_get_audio( frame, &audio, &afmt, &frequency, &channels, &samples );
+		}
+
+		// Put the frame in the audio queue for the read ahead thread
+		pthread_mutex_lock( &self->audio_mutex );
+		while ( self->ahead && mlt_deque_count( self->audio_queue ) >= ahead )
+			pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
+		if ( self->ahead )
+			mlt_deque_push_back( self->audio_queue, frame );
+		else
+			mlt_frame_close( frame );
+		pthread_cond_broadcast( &self->audio_cond );
+		pthread_mutex_unlock( &self->audio_mutex );
+	}
+
+	return NULL;
+}
+
+/** Get the next frame for the read ahead thread.
+ *
+ * This is the next frame from the producer or, when the audio render thread
+ * is running, the next frame from the audio queue with its audio rendered.
+ *
+ * \private \memberof mlt_consumer_s
+ * \param self a consumer
+ * \return a frame
+ */
+
+static mlt_frame consumer_read_ahead_frame( mlt_consumer self )
+{
+	mlt_frame frame = NULL;
+
+	if ( self->audio_queue == NULL )
+		return mlt_consumer_get_frame( self );
+
+	pthread_mutex_lock( &self->audio_mutex );
+	while ( self->ahead && mlt_deque_count( self->audio_queue ) == 0 )
+		pthread_cond_wait( &self->audio_cond, &self->audio_mutex );
+	frame = mlt_deque_pop_front( self->audio_queue );
+	pthread_cond_broadcast( &self->audio_cond );
+	pthread_mutex_unlock( &self->audio_mutex );
+
+	return frame;
+}
+
 static void *consumer_read_ahead_thread( void *arg )
 {
 	// The argument is the consumer
@@ -624,8 +718,8 @@ static void *consumer_read_ahead_thread( void *arg )
 	int samples = 0;
 	void *audio = NULL;
 
-	// See if audio is turned off
-	int audio_off = mlt_properties_get_int( properties, "audio_off" );
+	// See if audio is turned off, or rendered by the audio thread
+	int audio_off = mlt_properties_get_int( properties, "audio_off" ) || self->audio_queue != NULL;
 
 	// Get the maximum size of the buffer
 	int buffer = mlt_properties_get_int( properties, "buffer" ) + 1;
@@ -652,7 +746,7 @@ static void *consumer_read_ahead_thread( void *arg )
 		self->format = preview_format;
 
 	// Get the first frame
-	frame = mlt_consumer_get_frame( self );
+	frame = consumer_read_ahead_frame( self );
 
 	if ( frame )
 	{
@@ -695,7 +789,7 @@ static void *consumer_read_ahead_thread( void *arg )
 		time_wait += time_difference( &ante );
 
 		// Get the next frame
-		frame = mlt_consumer_get_frame( self );
+		frame = consumer_read_ahead_frame( self );
 		time_frame += time_difference( &ante );
 
 		// If there's no frame, we're probably stopped...
@@ -918,6 +1012,15 @@ static void consumer_read_ahead_start( mlt_consumer self )
 	// Create the condition
 	pthread_cond_init( &self->queue_cond, NULL );
 
+	// Create the audio render thread and its queue if audio may run ahead
+	if ( mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self ), "audio_ahead" ) > 0 )
+	{
+		self->audio_queue = mlt_deque_init( );
+		pthread_mutex_init( &self->audio_mutex, NULL );
+		pthread_cond_init( &self->audio_cond, NULL );
+		pthread_create( &self->audio_thread, NULL, consumer_audio_thread, self );
+	}
+
 	// Create the read ahead
 	if ( mlt_properties_get( MLT_CONSUMER_PROPERTIES( self ), "priority" ) )
 	{
@@ -1035,10 +1138,30 @@ static void consumer_read_ahead_stop( mlt_consumer self )
 		pthread_cond_broadcast( &self->put_cond );
 		pthread_mutex_unlock( &self->put_mutex );
 
+		// Broadcast to the audio condition in case either thread is waiting
+		if ( self->audio_queue )
+		{
+			pthread_mutex_lock( &self->audio_mutex );
+			pthread_cond_broadcast( &self->audio_cond );
+			pthread_mutex_unlock( &self->audio_mutex );
+		}
+
 		// Join the thread
 		pthread_join( self->ahead_thread, NULL );
 		self->started = 0;
 
+		// Join the audio thread and wipe its queue
+		if ( self->audio_queue )
+		{
+			pthread_join( self->audio_thread, NULL );
+			pthread_mutex_destroy( &self->audio_mutex );
+			pthread_cond_destroy( &self->audio_cond );
+			while ( mlt_deque_count( self->audio_queue ) )
+				mlt_frame_close( mlt_deque_pop_back( self->audio_queue ) );
+			mlt_deque_close( self->audio_queue );
+			self->audio_queue = NULL;
+		}
+
 		// Destroy the frame queue mutex
 		pthread_mutex_destroy( &self->queue_mutex );
 
@@ -1128,6 +1251,15 @@ void mlt_consumer_purge( mlt_consumer self )
 			mlt_frame_close( mlt_deque_pop_back( self->queue ) );
 		pthread_cond_broadcast( &self->queue_cond );
 		pthread_mutex_unlock( &self->queue_mutex );
+
+		if ( self->audio_queue )
+		{
+			pthread_mutex_lock( &self->audio_mutex );
+			while ( mlt_deque_count( self->audio_queue ) )
+				mlt_frame_close( mlt_deque_pop_back( self->audio_queue ) );
+			pthread_cond_broadcast( &self->audio_cond );
+			pthread_mutex_unlock( &self->audio_mutex );
+		}
 	}
 }
 
@@ -1146,7 +1278,7 @@ static mlt_frame worker_get_frame( mlt_consumer self, mlt_properties properties
 	buffer = buffer < headroom ? headroom : buffer;
 
 	// Start worker threads if not already started.
-	if ( ! self->ahead )
+	if ( ! self->ahead && ! self->started )
 	{
 		int prefill = mlt_properties_get_int( properties, "prefill" );
 		prefill = prefill > 0 && prefill < buffer ? prefill : buffer;
@@ -1261,8 +1393,8 @@ mlt_frame mlt_consumer_rt_frame( mlt_consumer self )
 	{
 		int size = 1;
 
-		// Is the read ahead running?
-		if ( self->ahead == 0 )
+		// Is the read ahead running? Do not restart it while it is being stopped.
+		if ( self->ahead == 0 && !self->started )
 		{
 			int buffer = mlt_properties_get_int( properties, "buffer" );
 			int prefill = mlt_properties_get_int( properties, "prefill" );
@@ -44,6 +44,9 @@
  * \properties \em channels the number of audio channels to use, defaults to 2
  * \properties \em real_time the asynchronous behavior: 1 (default) for asynchronous
  * with frame dropping, -1 for asynchronous without frame dropping, 0 to disable (synchronous)
+ * \properties \em audio_ahead when asynchronous with a real_time of 1 or -1, render audio on a
+ * thread of its own up to this many frames ahead of video, defaults to 0 (audio is rendered
+ * after the image on the same thread)
  * \properties \em test_card the name of a resource to use as the test card, defaults to
  * environment variable MLT_TEST_CARD. If undefined, the hard-coded default test card is
  * white silence. A test card is what appears when nothing is produced.
@@ -123,6 +126,12 @@ struct mlt_consumer_s
 	int consecutive_rendered;
 	int process_head;
 	int started;
+
+	/* additional fields added for the audio render thread */
+	mlt_deque audio_queue;
+	pthread_t audio_thread;
+	pthread_mutex_t audio_mutex;
+	pthread_cond_t audio_cond;
 };
 
 #define MLT_CONSUMER_SERVICE( consumer )	( &( consumer )->parent )
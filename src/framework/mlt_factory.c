@@ -95,6 +95,10 @@ static void mlt_factory_create_done( mlt_listener listener, mlt_properties owner
  *
  * The environment variable MLT_REPOSITORY overrides the default location of the plugin modules, defaults to \p PREFIX_LIB.
  *
+ * The environment variable MLT_REPOSITORY_CACHE overrides the default location of the cache of module services,
+ * defaults to a file in $XDG_CACHE_HOME or $HOME/.cache, and setting it empty disables the cache and the
+ * plugin caches of modules such as frei0r and LADSPA.
+ *
  * \param directory an optional full path to a directory containing the modules that overrides the default and
  * the MLT_REPOSITORY environment variable
  * \return the repository
@@ -30,6 +30,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+
+/** statistics for images shared with mlt_frame_set_image_shared() */
+
+static pthread_mutex_t image_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int image_stats_shared = 0;
+static int image_stats_copied = 0;
 
 /** Construct a frame object.
  *
@@ -307,9 +314,91 @@ mlt_deque mlt_frame_service_stack( mlt_frame self )
 
 int mlt_frame_set_image( mlt_frame self, uint8_t *image, int size, mlt_destructor destroy )
 {
+	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "_image_shared", NULL, 0, NULL, NULL );
 	return mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, size, destroy, NULL );
 }
 
+/** Set a shared, read-only image on the frame.
+  *
+  * Instead of cloning a cached image for every frame, a producer can share it.
+  * The frame takes its own reference on \p image, which must have been
+  * allocated with mlt_pool_alloc(). The image is copied by mlt_frame_get_image()
+  * only when a caller asks for a writable image while the buffer is still in use
+  * elsewhere (copy on write).
+  *
+  * \public \memberof mlt_frame_s
+  * \param self a frame
+  * \param image a pointer to the raw image data obtained from the memory pool
+  * \param size the size of the image data in bytes
+  * \return true if error
+  */
+
+int mlt_frame_set_image_shared( mlt_frame self, uint8_t *image, int size )
+{
+	int error = mlt_frame_set_image( self, mlt_pool_retain( image ), size, mlt_pool_release );
+	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "_image_shared", image, 0, NULL, NULL );
+	pthread_mutex_lock( &image_stats_mutex );
+	image_stats_shared ++;
+	pthread_mutex_unlock( &image_stats_mutex );
+	return error;
+}
+
+/** Get the statistics of shared images.
+  *
+  * The number of copies avoided is \p shared minus \p copied.
+  *
+  * \public \memberof mlt_frame_s
+  * \param[out] shared the number of images set with mlt_frame_set_image_shared() (optional)
+  * \param[out] copied the number of those that had to be copied for writing (optional)
+  */
+
+void mlt_frame_image_stats( int *shared, int *copied )
+{
+	pthread_mutex_lock( &image_stats_mutex );
+	if ( shared ) *shared = image_stats_shared;
+	if ( copied ) *copied = image_stats_copied;
+	pthread_mutex_unlock( &image_stats_mutex );
+}
+
+/** Give the frame a private copy of a shared image before it is written.
+  *
+  * \private \memberof mlt_frame_s
+  * \param self a frame
+  * \param[in,out] buffer the image buffer about to be returned to a writer
+  */
+
+static void unshare_image( mlt_frame self, uint8_t **buffer )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	int size = 0;
+	uint8_t *shared = mlt_properties_get_data( properties, "_image_shared", NULL );
+	uint8_t *image = mlt_properties_get_data( properties, "image", &size );
+
+	if ( shared && shared == *buffer && shared == image )
+	{
+		if ( mlt_pool_references( image ) > 1 )
+		{
+			uint8_t *copy = mlt_pool_alloc( size );
+			if ( copy )
+			{
+				memcpy( copy, image, size );
+				*buffer = copy;
+
+				// This drops our reference on the shared image
+				mlt_frame_set_image( self, copy, size, mlt_pool_release );
+				pthread_mutex_lock( &image_stats_mutex );
+				image_stats_copied ++;
+				pthread_mutex_unlock( &image_stats_mutex );
+			}
+		}
+		else
+		{
+			// Nobody else is using it anymore, so it is ours to write
+			mlt_properties_set_data( properties, "_image_shared", NULL, 0, NULL, NULL );
+		}
+	}
+}
+
 /** Set a new alpha channel on the frame.
   *
   * \public \memberof mlt_frame_s
@@ -357,7 +446,7 @@ void mlt_frame_replace_image( mlt_frame self, uint8_t *image, mlt_image_format f
 	while( mlt_deque_pop_back( self->stack_image ) ) ;
 
 	// Update the information
-	mlt_properties_set_data( MLT_FRAME_PROPERTIES( self ), "image", image, 0, NULL, NULL );
+	mlt_frame_set_image( self, image, 0, NULL );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "width", width );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "height", height );
 	mlt_properties_set_int( MLT_FRAME_PROPERTIES( self ), "format", format );
@@ -458,6 +547,8 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 			if ( self->convert_image && *buffer )
 				self->convert_image( self, buffer, format, requested_format );
 			mlt_properties_set_int( properties, "format", *format );
+			if ( writable )
+				unshare_image( self, buffer );
 		}
 		else
 		{
@@ -476,6 +567,8 @@ int mlt_frame_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *for
 			self->convert_image( self, buffer, format, requested_format );
 			mlt_properties_set_int( properties, "format", *format );
 		}
+		if ( writable && *buffer )
+			unshare_image( self, buffer );
 	}
 	else if ( producer )
 	{
@@ -742,6 +835,18 @@ int mlt_frame_get_audio( mlt_frame self, void **buffer, mlt_audio_format *format
 
 		mlt_properties_set( properties, "meta.volume", NULL );
 	}
+	else if ( ( *format == mlt_audio_float || *format == mlt_audio_f32le ) && mlt_properties_get( properties, "meta.volume" ) )
+	{
+		float value = mlt_properties_get_double( properties, "meta.volume" );
+		int total = *samples * *channels;
+		float *p = *buffer;
+
+		if ( value != 1.0 )
+			while ( total -- )
+				*p++ *= value;
+
+		mlt_properties_set( properties, "meta.volume", NULL );
+	}
 
 	return 0;
 }
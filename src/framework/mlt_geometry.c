@@ -27,20 +27,17 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct geometry_item_s
-{
-	struct mlt_geometry_item_s data;
-	struct geometry_item_s *next, *prev;
-}
-*geometry_item;
-
 typedef struct
 {
 	char *data;
 	int length;
 	int nw;
 	int nh;
-	geometry_item item;
+	struct mlt_geometry_item_s *keys;
+	int count;
+	int size;
+	int smooth;
+	float ( *coefficients )[ 5 ][ 4 ];
 }
 geometry_s, *geometry;
 
@@ -75,116 +72,176 @@ static inline double linearstep( double start, double end, double position, int
 	return start + position * o;
 }
 
-static void mlt_geometry_virtual_refresh( mlt_geometry self )
+static inline float *item_value( struct mlt_geometry_item_s *item, int i )
 {
-	geometry g = self->local;
+	switch( i )
+	{
+		case 0: return &item->x;
+		case 1: return &item->y;
+		case 2: return &item->w;
+		case 3: return &item->h;
+	}
+	return &item->mix;
+}
+
+// Find the last key at or before the position, or the first key when there is none -
+// this does not modify the geometry, so fetches may run in several threads at once
+static int geometry_locate( geometry g, double position )
+{
+	int lo = 0;
+	int hi = g->count - 1;
 
-	// Parse of all items to ensure unspecified keys are calculated correctly
-	if ( g->item != NULL )
+	while ( lo < hi )
 	{
-		int i = 0;
-		for ( i = 0; i < 5; i ++ )
-		{
-			geometry_item current = g->item;
-			while( current != NULL )
-			{
-				int fixed = current->data.f[ i ];
-				if ( !fixed )
-				{
-					geometry_item prev = current->prev;
-					geometry_item next = current->next;
-
-					double prev_value = 0;
-					double next_value = 0;
-					double value = 0;
-
-					while( prev != NULL && !prev->data.f[ i ] ) prev = prev->prev;
-					while( next != NULL && !next->data.f[ i ] ) next = next->next;
-
-					switch( i )
-					{
-						case 0:
-							if ( prev ) prev_value = prev->data.x;
-							if ( next ) next_value = next->data.x;
-							break;
-						case 1:
-							if ( prev ) prev_value = prev->data.y;
-							if ( next ) next_value = next->data.y;
-							break;
-						case 2:
-							if ( prev ) prev_value = prev->data.w;
-							if ( next ) next_value = next->data.w;
-							break;
-						case 3:
-							if ( prev ) prev_value = prev->data.h;
-							if ( next ) next_value = next->data.h;
-							break;
-						case 4:
-							if ( prev ) prev_value = prev->data.mix;
-							if ( next ) next_value = next->data.mix;
-							break;
-					}
-
-					// This should never happen
-					if ( prev == NULL )
-						current->data.f[ i ] = 1;
-					else if ( next == NULL )
-						value = prev_value;
-					else 
-						value = linearstep( prev_value, next_value, current->data.frame - prev->data.frame, next->data.frame - prev->data.frame );
-
-					switch( i )
-					{
-						case 0: current->data.x = value; break;
-						case 1: current->data.y = value; break;
-						case 2: current->data.w = value; break;
-						case 3: current->data.h = value; break;
-						case 4: current->data.mix = value; break;
-					}
-				}
+		int mid = ( lo + hi + 1 ) / 2;
+		if ( g->keys[ mid ].frame <= position )
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
 
-				// Move to the next item
-				current = current->next;
-			}
-		}
+// Find the index of the key at the frame or the one following it
+static int geometry_search( geometry g, int frame )
+{
+	int lo = 0;
+	int hi = g->count;
+	while ( lo < hi )
+	{
+		int mid = ( lo + hi ) / 2;
+		if ( g->keys[ mid ].frame < frame )
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
+	return lo;
 }
 
-static int mlt_geometry_drop( mlt_geometry self, geometry_item item )
+// Calculate the values which are not fixed in the keys from first to last
+static void geometry_refresh_range( geometry g, int i, int first, int last )
 {
-	geometry g = self->local;
+	int prev = -1;
+	int next = first;
+	int j;
 
-	if ( item == g->item )
+	for ( j = first; j <= last; j ++ )
 	{
-		g->item = item->next;
-		if ( g->item != NULL )
-			g->item->prev = NULL;
-		// To ensure correct seeding, ensure all values are fixed
-		if ( g->item != NULL )
+		struct mlt_geometry_item_s *current = &g->keys[ j ];
+
+		if ( current->f[ i ] )
+		{
+			prev = j;
+			continue;
+		}
+
+		// Find the following fixed value once for a run of unfixed values
+		if ( next <= j )
+			for ( next = j + 1; next < g->count && !g->keys[ next ].f[ i ]; next ++ ) ;
+
+		// The first key is always fixed, so this should never happen
+		if ( j == 0 )
+		{
+			current->f[ i ] = 1;
+			*item_value( current, i ) = 0;
+		}
+		// Without a following value, the key before holds the last fixed one
+		else if ( next >= g->count )
+		{
+			*item_value( current, i ) = *item_value( &g->keys[ j - 1 ], i );
+		}
+		else
 		{
-			g->item->data.f[0] = 1;
-			g->item->data.f[1] = 1;
-			g->item->data.f[2] = 1;
-			g->item->data.f[3] = 1;
-			g->item->data.f[4] = 1;
+			if ( prev < 0 )
+				for ( prev = j - 1; prev > 0 && !g->keys[ prev ].f[ i ]; prev -- ) ;
+			*item_value( current, i ) = linearstep( *item_value( &g->keys[ prev ], i ), *item_value( &g->keys[ next ], i ),
+				current->frame - g->keys[ prev ].frame, g->keys[ next ].frame - g->keys[ prev ].frame );
 		}
 	}
-	else if ( item->next != NULL && item->prev != NULL )
+}
+
+// Calculate the Catmull-Rom coefficients of the segments between keys from first to last
+static void geometry_smooth_coefficients( geometry g, int first, int last )
+{
+	int j, i;
+
+	if ( !g->smooth || g->coefficients == NULL )
+		return;
+
+	for ( j = first < 0 ? 0 : first; j <= last && j + 1 < g->count; j ++ )
 	{
-		item->prev->next = item->next;
-		item->next->prev = item->prev;
+		struct mlt_geometry_item_s *k0 = &g->keys[ j > 0 ? j - 1 : j ];
+		struct mlt_geometry_item_s *k1 = &g->keys[ j ];
+		struct mlt_geometry_item_s *k2 = &g->keys[ j + 1 ];
+		struct mlt_geometry_item_s *k3 = &g->keys[ j + 2 < g->count ? j + 2 : j + 1 ];
+		double h = k2->frame - k1->frame;
+
+		for ( i = 0; i < 5; i ++ )
+		{
+			double p1 = *item_value( k1, i );
+			double p2 = *item_value( k2, i );
+
+			// Tangents in units per segment, one-sided at the ends
+			double m1 = k2->frame != k0->frame ? ( p2 - *item_value( k0, i ) ) / ( k2->frame - k0->frame ) * h : 0;
+			double m2 = k3->frame != k1->frame ? ( *item_value( k3, i ) - p1 ) / ( k3->frame - k1->frame ) * h : 0;
+
+			// Cubic Hermite as ( ( a t + b ) t + c ) t + d
+			g->coefficients[ j ][ i ][ 0 ] = 2 * p1 - 2 * p2 + m1 + m2;
+			g->coefficients[ j ][ i ][ 1 ] = -3 * p1 + 3 * p2 - 2 * m1 - m2;
+			g->coefficients[ j ][ i ][ 2 ] = m1;
+			g->coefficients[ j ][ i ][ 3 ] = p1;
+		}
 	}
-	else if ( item->next != NULL )
+}
+
+// Recalculate the unfixed values that depend on the key at the index - when a
+// fixed value was added or removed there, the values between the fixed ones on
+// either side may change, otherwise only the key itself needs calculating - the
+// spline segments that use any of the recalculated keys are updated with them
+static void mlt_geometry_virtual_refresh( mlt_geometry self, int index, const int *fixed )
+{
+	geometry g = self->local;
+	int lowest = index;
+	int highest = index;
+	int i = 0;
+
+	for ( i = 0; i < 5; i ++ )
 	{
-		item->next->prev = item->prev;
+		int first = index;
+		int last = index;
+		if ( fixed[ i ] )
+		{
+			first --;
+			last ++;
+			while( first >= 0 && !g->keys[ first ].f[ i ] ) first --;
+			while( last < g->count && !g->keys[ last ].f[ i ] ) last ++;
+		}
+		geometry_refresh_range( g, i, first < 0 ? 0 : first, last >= g->count ? g->count - 1 : last );
+		lowest = first < lowest ? first : lowest;
+		highest = last > highest ? last : highest;
 	}
-	else if ( item->prev != NULL )
+	geometry_smooth_coefficients( g, lowest - 2, highest + 1 );
+}
+
+static int mlt_geometry_drop( mlt_geometry self, int index )
+{
+	geometry g = self->local;
+
+	memmove( &g->keys[ index ], &g->keys[ index + 1 ], ( g->count - index - 1 ) * sizeof( struct mlt_geometry_item_s ) );
+	if ( g->smooth && g->coefficients != NULL && index + 1 < g->count )
+		memmove( &g->coefficients[ index ], &g->coefficients[ index + 1 ], ( g->count - index - 1 ) * sizeof( *g->coefficients ) );
+	g->count --;
+
+	// To ensure correct seeding, ensure all values are fixed
+	if ( index == 0 && g->count > 0 )
 	{
-		item->prev->next = item->next;
+		g->keys[ 0 ].f[0] = 1;
+		g->keys[ 0 ].f[1] = 1;
+		g->keys[ 0 ].f[2] = 1;
+		g->keys[ 0 ].f[3] = 1;
+		g->keys[ 0 ].f[4] = 1;
 	}
 
-	free( item );
-
 	return 0;
 }
 
@@ -193,8 +250,7 @@ static void mlt_geometry_clean( mlt_geometry self )
 	geometry g = self->local;
 	free( g->data );
 	g->data = NULL;
-	while( g->item )
-		mlt_geometry_drop( self, g->item );
+	g->count = 0;
 }
 
 // Parse the geometry specification for a given length and normalised width/height (-1 for default)
@@ -387,30 +443,27 @@ int mlt_geometry_fetch( mlt_geometry self, mlt_geometry_item item, float positio
 	// Get the local geometry
 	geometry g = self->local;
 
-	// Need to find the nearest key to the position specifed
-	geometry_item key = g->item;
-
-	// Iterate through the keys until we reach last or have 
-	while( key != NULL && key->next != NULL && position >= key->next->data.frame )
-		key = key->next;
-
-	if ( key != NULL )
+	if ( g->count > 0 )
 	{
+		// Need to find the nearest key to the position specifed
+		int index = geometry_locate( g, position );
+		struct mlt_geometry_item_s *key = &g->keys[ index ];
+
 		// Position is situated before the first key - all zeroes
-		if ( position < key->data.frame )
+		if ( position < key->frame )
 		{
 			memset( item, 0, sizeof( struct mlt_geometry_item_s ) );
 			item->mix = 100;
 		}
 		// Position is a key itself - no iterpolation need
-		else if ( position == key->data.frame )
+		else if ( position == key->frame )
 		{
-			memcpy( item, &key->data, sizeof( struct mlt_geometry_item_s ) );
+			memcpy( item, key, sizeof( struct mlt_geometry_item_s ) );
 		}
 		// Position is after the last key - no interpolation, but not a key frame
-		else if ( key->next == NULL )
+		else if ( index + 1 == g->count )
 		{
-			memcpy( item, &key->data, sizeof( struct mlt_geometry_item_s ) );
+			memcpy( item, key, sizeof( struct mlt_geometry_item_s ) );
 			item->key = 0;
 			item->f[ 0 ] = 0;
 			item->f[ 1 ] = 0;
@@ -418,19 +471,33 @@ int mlt_geometry_fetch( mlt_geometry self, mlt_geometry_item item, float positio
 			item->f[ 3 ] = 0;
 			item->f[ 4 ] = 0;
 		}
+		// Interpolation along a spline through the keys
+		else if ( g->smooth && g->coefficients != NULL )
+		{
+			double t = ( position - key->frame ) / ( key[ 1 ].frame - key->frame );
+			int i;
+			item->key = 0;
+			for ( i = 0; i < 5; i ++ )
+			{
+				float *c = g->coefficients[ index ][ i ];
+				*item_value( item, i ) = ( ( c[ 0 ] * t + c[ 1 ] ) * t + c[ 2 ] ) * t + c[ 3 ];
+			}
+			item->distort = key->distort;
+		}
 		// Interpolation is needed - position > key and there is a following key
 		else
 		{
+			struct mlt_geometry_item_s *next = key + 1;
 			item->key = 0;
 			item->frame = position;
-			position -= key->data.frame;
-			item->x = linearstep( key->data.x, key->next->data.x, position, key->next->data.frame - key->data.frame );
-			item->y = linearstep( key->data.y, key->next->data.y, position, key->next->data.frame - key->data.frame );
-			item->w = linearstep( key->data.w, key->next->data.w, position, key->next->data.frame - key->data.frame );
-			item->h = linearstep( key->data.h, key->next->data.h, position, key->next->data.frame - key->data.frame );
-			item->mix = linearstep( key->data.mix, key->next->data.mix, position, key->next->data.frame - key->data.frame );
-			item->distort = key->data.distort;
-			position += key->data.frame;
+			position -= key->frame;
+			item->x = linearstep( key->x, next->x, position, next->frame - key->frame );
+			item->y = linearstep( key->y, next->y, position, next->frame - key->frame );
+			item->w = linearstep( key->w, next->w, position, next->frame - key->frame );
+			item->h = linearstep( key->h, next->h, position, next->frame - key->frame );
+			item->mix = linearstep( key->mix, next->mix, position, next->frame - key->frame );
+			item->distort = key->distort;
+			position += key->frame;
 		}
 
 		item->frame = position;
@@ -442,7 +509,7 @@ int mlt_geometry_fetch( mlt_geometry self, mlt_geometry_item item, float positio
 		item->mix = 100;
 	}
 
-	return key == NULL;
+	return g->count == 0;
 }
 
 // Specify a geometry item at an absolute position
@@ -451,60 +518,60 @@ int mlt_geometry_insert( mlt_geometry self, mlt_geometry_item item )
 	// Get the local/private geometry structure
 	geometry g = self->local;
 
-	// Create a new local item (this may be removed if a key already exists at self position)
-	geometry_item gi = calloc( 1, sizeof( struct geometry_item_s ) );
-	memcpy( &gi->data, item, sizeof( struct mlt_geometry_item_s ) );
-	gi->data.key = 1;
+	// Locate an existing nearby item
+	int index = geometry_search( g, item->frame );
+	int empty = g->count == 0;
+	int fixed[ 5 ];
+	int i;
 
-	// Determine if we need to insert or append to the list, or if it's a new list
-	if ( g->item != NULL )
+	if ( index == g->count || g->keys[ index ].frame != item->frame )
 	{
-		// Get the first item
-		geometry_item place = g->item;
-
-		// Locate an existing nearby item
-		while ( place->next != NULL && item->frame > place->data.frame )
-			place = place->next;
+		memset( fixed, 0, sizeof( fixed ) );
 
-		if ( item->frame < place->data.frame )
+		// Make room for a new key
+		if ( g->count == g->size )
 		{
-			if ( place == g->item )
-				g->item = gi;
-			if ( place->prev )
-				place->prev->next = gi;
-			gi->next = place;
-			gi->prev = place->prev;
-			place->prev = gi;
-		}
-		else if ( item->frame > place->data.frame )
-		{
-			if ( place->next )
-				place->next->prev = gi;
-			gi->next = place->next;
-			gi->prev = place;
-			place->next = gi;
-		}
-		else
-		{
-			memcpy( &place->data, &gi->data, sizeof( struct mlt_geometry_item_s ) );
-			free( gi );
+			int size = g->size ? g->size * 2 : 16;
+			struct mlt_geometry_item_s *keys = realloc( g->keys, size * sizeof( struct mlt_geometry_item_s ) );
+			if ( keys == NULL )
+				return 1;
+			g->keys = keys;
+			if ( g->coefficients != NULL || g->smooth )
+			{
+				void *coefficients = realloc( g->coefficients, size * sizeof( *g->coefficients ) );
+				if ( coefficients == NULL )
+					return 1;
+				g->coefficients = coefficients;
+			}
+			g->size = size;
 		}
+		memmove( &g->keys[ index + 1 ], &g->keys[ index ], ( g->count - index ) * sizeof( struct mlt_geometry_item_s ) );
+		if ( g->smooth && g->coefficients != NULL && index < g->count )
+			memmove( &g->coefficients[ index + 1 ], &g->coefficients[ index ], ( g->count - index ) * sizeof( *g->coefficients ) );
+		g->count ++;
 	}
 	else
 	{
-		// Set the first item
-		g->item = gi;
-
-		// To ensure correct seeding, ensure all values are fixed
-		g->item->data.f[0] = 1;
-		g->item->data.f[1] = 1;
-		g->item->data.f[2] = 1;
-		g->item->data.f[3] = 1;
-		g->item->data.f[4] = 1;
+		memcpy( fixed, g->keys[ index ].f, sizeof( fixed ) );
+	}
+
+	memcpy( &g->keys[ index ], item, sizeof( struct mlt_geometry_item_s ) );
+	g->keys[ index ].key = 1;
+
+	// To ensure correct seeding, ensure all values are fixed
+	if ( empty )
+	{
+		g->keys[ 0 ].f[0] = 1;
+		g->keys[ 0 ].f[1] = 1;
+		g->keys[ 0 ].f[2] = 1;
+		g->keys[ 0 ].f[3] = 1;
+		g->keys[ 0 ].f[4] = 1;
 	}
 
-	// Refresh all geometries
-	mlt_geometry_virtual_refresh( self );
+	// Refresh the geometries around the key
+	for ( i = 0; i < 5; i ++ )
+		fixed[ i ] = fixed[ i ] || g->keys[ index ].f[ i ] || index == 0;
+	mlt_geometry_virtual_refresh( self, index, fixed );
 
 	// TODO: Error checking
 	return 0;
@@ -518,17 +585,21 @@ int mlt_geometry_remove( mlt_geometry self, int position )
 	// Get the local/private geometry structure
 	geometry g = self->local;
 
-	// Get the first item
-	geometry_item place = g->item;
+	int index = geometry_search( g, position );
 
-	while( place != NULL && position != place->data.frame )
-		place = place->next;
+	if ( index < g->count && position == g->keys[ index ].frame )
+	{
+		int fixed[ 5 ];
+		memcpy( fixed, g->keys[ index ].f, sizeof( fixed ) );
 
-	if ( place != NULL && position == place->data.frame )
-		ret = mlt_geometry_drop( self, place );
+		ret = mlt_geometry_drop( self, index );
 
-	// Refresh all geometries
-	mlt_geometry_virtual_refresh( self );
+		// Refresh the geometries around the removed key
+		if ( index < g->count )
+			mlt_geometry_virtual_refresh( self, index, fixed );
+		else if ( g->count > 0 )
+			mlt_geometry_virtual_refresh( self, g->count - 1, fixed );
+	}
 
 	return ret;
 }
@@ -539,16 +610,12 @@ int mlt_geometry_next_key( mlt_geometry self, mlt_geometry_item item, int positi
 	// Get the local/private geometry structure
 	geometry g = self->local;
 
-	// Get the first item
-	geometry_item place = g->item;
-
-	while( place != NULL && position > place->data.frame )
-		place = place->next;
+	int index = geometry_search( g, position );
 
-	if ( place != NULL )
-		memcpy( item, &place->data, sizeof( struct mlt_geometry_item_s ) );
+	if ( index < g->count )
+		memcpy( item, &g->keys[ index ], sizeof( struct mlt_geometry_item_s ) );
 
-	return place == NULL;
+	return index == g->count;
 }
 
 // Get the key at the position or the previous key
@@ -557,16 +624,28 @@ int mlt_geometry_prev_key( mlt_geometry self, mlt_geometry_item item, int positi
 	// Get the local/private geometry structure
 	geometry g = self->local;
 
-	// Get the first item
-	geometry_item place = g->item;
+	if ( g->count > 0 )
+		memcpy( item, &g->keys[ geometry_locate( g, position ) ], sizeof( struct mlt_geometry_item_s ) );
 
-	while( place != NULL && place->next != NULL && position >= place->next->data.frame )
-		place = place->next;
+	return g->count == 0;
+}
 
-	if ( place != NULL )
-		memcpy( item, &place->data, sizeof( struct mlt_geometry_item_s ) );
+// Choose between linear (0) and Catmull-Rom spline (1) interpolation between keys
+void mlt_geometry_set_smooth( mlt_geometry self, int smooth )
+{
+	geometry g = self->local;
 
-	return place == NULL;
+	if ( smooth && g->coefficients == NULL && g->size > 0 )
+	{
+		g->coefficients = malloc( g->size * sizeof( *g->coefficients ) );
+		if ( g->coefficients == NULL )
+			smooth = 0;
+	}
+	if ( smooth != g->smooth )
+	{
+		g->smooth = smooth;
+		geometry_smooth_coefficients( g, 0, g->count - 2 );
+	}
 }
 
 char *mlt_geometry_serialise_cut( mlt_geometry self, int in, int out )
@@ -602,7 +681,7 @@ char *mlt_geometry_serialise_cut( mlt_geometry self, int in, int out )
 
 				// If the first key is larger than the current position
 				// then do nothing here
-				if ( g->item->data.frame > item.frame )
+				if ( g->keys[ 0 ].frame > item.frame )
 				{
 					item.frame ++;
 					continue;
@@ -690,7 +769,10 @@ void mlt_geometry_close( mlt_geometry self )
 {
 	if ( self != NULL )
 	{
+		geometry g = self->local;
 		mlt_geometry_clean( self );
+		free( g->keys );
+		free( g->coefficients );
 		free( self->local );
 		free( self );
 	}
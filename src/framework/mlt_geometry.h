@@ -63,6 +63,8 @@ extern int mlt_geometry_remove( mlt_geometry self, int position );
 /* Get the key at the position or the next following */
 extern int mlt_geometry_next_key( mlt_geometry self, mlt_geometry_item item, int position );
 extern int mlt_geometry_prev_key( mlt_geometry self, mlt_geometry_item item, int position );
+/* Choose between linear (0) and Catmull-Rom spline (1) interpolation between keys */
+extern void mlt_geometry_set_smooth( mlt_geometry self, int smooth );
 /* Serialise the current geometry */
 extern char *mlt_geometry_serialise_cut( mlt_geometry self, int in, int out );
 extern char *mlt_geometry_serialise( mlt_geometry self );
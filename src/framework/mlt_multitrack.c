@@ -457,6 +457,13 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int ind
 		mlt_properties_set_double( properties, "_speed", speed );
 		mlt_frame_set_position( *frame, position );
 		mlt_properties_set_int( properties, "hide", hide );
+
+		// Let a parallel tractor know what the track itself stacked on the frame
+		if ( mlt_properties_get_int( producer_properties, "_parallel" ) )
+		{
+			mlt_properties_set_int( properties, "_multitrack_image_depth", hide & 1 ? -1 : mlt_deque_count( MLT_FRAME_IMAGE_STACK( *frame ) ) );
+			mlt_properties_set_int( properties, "_multitrack_audio_depth", hide & 2 ? -1 : mlt_deque_count( MLT_FRAME_AUDIO_STACK( *frame ) ) );
+		}
 	}
 	else
 	{
@@ -53,6 +53,7 @@ struct playlist_entry_s
 static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index );
 static int mlt_playlist_unmix( mlt_playlist self, int clip );
 static int mlt_playlist_resize_mix( mlt_playlist self, int clip, int in, int out );
+static void mlt_playlist_index( mlt_playlist self );
 
 /** Construct a playlist.
  *
@@ -97,6 +98,8 @@ mlt_playlist mlt_playlist_init( )
 
 		self->size = 10;
 		self->list = malloc( self->size * sizeof( playlist_entry * ) );
+		pthread_mutex_init( &self->offsets_mutex, NULL );
+		mlt_playlist_index( self );
 	}
 
 	return self;
@@ -141,6 +144,33 @@ mlt_properties mlt_playlist_properties( mlt_playlist self )
 	return MLT_PRODUCER_PROPERTIES( &self->parent );
 }
 
+/** Rebuild the index of playlist offsets after the list or an entry has changed.
+ *
+ * offsets[ i ] is the time at which entry i starts and offsets[ count ] is
+ * the length of the playlist. It is only written here, so looking up a
+ * position never modifies the playlist. It has a lock of its own because the
+ * service lock is already held by mlt_service_get_frame, which may refresh
+ * the playlist, and it is not recursive.
+ * \private \memberof mlt_playlist_s
+ * \param self a playlist
+ */
+
+static void mlt_playlist_index( mlt_playlist self )
+{
+	int i;
+
+	pthread_mutex_lock( &self->offsets_mutex );
+	if ( self->offsets_size < self->count + 1 )
+	{
+		self->offsets_size = self->size + 1;
+		self->offsets = realloc( self->offsets, self->offsets_size * sizeof( mlt_position ) );
+	}
+	self->offsets[ 0 ] = 0;
+	for ( i = 0; i < self->count; i ++ )
+		self->offsets[ i + 1 ] = self->offsets[ i ] + self->list[ i ]->frame_count;
+	pthread_mutex_unlock( &self->offsets_mutex );
+}
+
 /** Refresh the playlist after a clip has been changed.
  *
  * \private \memberof mlt_playlist_s
@@ -192,6 +222,7 @@ static int mlt_playlist_virtual_refresh( mlt_playlist self )
 		// Update the frame_count for self clip
 		frame_count += self->list[ i ]->frame_count;
 	}
+	mlt_playlist_index( self );
 
 	// Refresh all properties
 	mlt_events_block( properties, properties );
@@ -339,27 +370,39 @@ static mlt_producer mlt_playlist_locate( mlt_playlist self, mlt_position *positi
 {
 	// Default producer to NULL
 	mlt_producer producer = NULL;
+	mlt_position *offsets;
 
-	// Loop for each producer until found
-	for ( *clip = 0; *clip < self->count; *clip += 1 )
-	{
-		// Increment the total
-		*total += self->list[ *clip ]->frame_count;
+	pthread_mutex_lock( &self->offsets_mutex );
+	offsets = self->offsets;
 
-		// Check if the position indicates that we have found the clip
-		// Note that 0 length clips get skipped automatically
-		if ( *position < self->list[ *clip ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ *clip ]->producer;
-			break;
-		}
+	// Binary search for the first entry that ends after the position
+	// Note that 0 length clips get skipped automatically
+	int lower = 0;
+	int upper = self->count;
+	while ( lower < upper )
+	{
+		int middle = ( lower + upper ) / 2;
+		if ( *position < offsets[ middle + 1 ] )
+			upper = middle;
 		else
-		{
-			// Decrement position by length of self entry
-			*position -= self->list[ *clip ]->frame_count;
-		}
+			lower = middle + 1;
 	}
+	*clip = lower;
+
+	if ( *clip < self->count )
+	{
+		// Found it
+		producer = self->list[ *clip ]->producer;
+		*total += offsets[ *clip + 1 ];
+	}
+	else
+	{
+		*total += offsets[ self->count ];
+	}
+
+	// Make the position relative to the start of the entry
+	*position -= offsets[ *clip ];
+	pthread_mutex_unlock( &self->offsets_mutex );
 
 	return producer;
 }
@@ -470,23 +513,12 @@ static mlt_producer mlt_playlist_virtual_set_out( mlt_playlist self )
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
 
-	// Loop through the virtual playlist
+	// Locate the entry
 	int i = 0;
+	int total = 0;
 
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			producer = self->list[ i ]->producer;
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
+	if ( mlt_playlist_locate( self, &position, &i, &total ) )
+		producer = self->list[ i ]->producer;
 
 	// Seek in real producer to relative position
 	if ( i < self->count && self->list[ i ]->frame_out != position )
@@ -514,22 +546,10 @@ int mlt_playlist_current_clip( mlt_playlist self )
 	// Map playlist position to real producer in virtual playlist
 	mlt_position position = mlt_producer_frame( &self->parent );
 
-	// Loop through the virtual playlist
+	// Locate the entry
 	int i = 0;
-
-	for ( i = 0; i < self->count; i ++ )
-	{
-		if ( position < self->list[ i ]->frame_count )
-		{
-			// Found it, now break
-			break;
-		}
-		else
-		{
-			// Decrement position by length of this entry
-			position -= self->list[ i ]->frame_count;
-		}
-	}
+	int total = 0;
+	mlt_playlist_locate( self, &position, &i, &total );
 
 	return i;
 }
@@ -562,9 +582,8 @@ mlt_producer mlt_playlist_current( mlt_playlist self )
 
 mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index )
 {
-	mlt_position position = 0;
 	int absolute_clip = index;
-	int i = 0;
+	mlt_position position;
 
 	// Determine the absolute clip
 	switch ( whence )
@@ -589,8 +608,9 @@ mlt_position mlt_playlist_clip( mlt_playlist self, mlt_whence whence, int index
 		absolute_clip = self->count;
 
 	// Now determine the position
-	for ( i = 0; i < absolute_clip; i ++ )
-		position += self->list[ i ]->frame_count;
+	pthread_mutex_lock( &self->offsets_mutex );
+	position = self->offsets[ absolute_clip ];
+	pthread_mutex_unlock( &self->offsets_mutex );
 
 	return position;
 }
@@ -771,6 +791,7 @@ int mlt_playlist_remove( mlt_playlist self, int where )
 		for ( i = where + 1; i < self->count; i ++ )
 			self->list[ i - 1 ] = self->list[ i ];
 		self->count --;
+		mlt_playlist_index( self );
 
 		if ( entry->preservation_hack == 0 )
 		{
@@ -867,6 +888,7 @@ int mlt_playlist_move( mlt_playlist self, int src, int dest )
 				self->list[ i ] = self->list[ i + 1 ];
 		}
 		self->list[ dest ] = src_entry;
+		mlt_playlist_index( self );
 
 		mlt_playlist_get_clip_info( self, &current_info, current );
 		mlt_producer_seek( MLT_PLAYLIST_PRODUCER( self ), current_info.start + position );
@@ -1834,6 +1856,8 @@ void mlt_playlist_close( mlt_playlist self )
 		mlt_producer_close( &self->blank );
 		mlt_producer_close( &self->parent );
 		free( self->list );
+		free( self->offsets );
+		pthread_mutex_destroy( &self->offsets_mutex );
 		free( self );
 	}
 }
@@ -25,6 +25,7 @@
 #define _MLT_PLAYLIST_H_
 
 #include "mlt_producer.h"
+#include <pthread.h>
 
 /** \brief structure for returning clip information from a playlist entry
  */
@@ -73,6 +74,11 @@ struct mlt_playlist_s
 	int size;
 	int count;
 	playlist_entry **list;
+
+	/* additional fields added for the index of entry offsets */
+	mlt_position *offsets; /**< \private the start of each entry followed by the length */
+	int offsets_size;      /**< \private the allocated number of offsets */
+	pthread_mutex_t offsets_mutex; /**< \private guards the offsets */
 };
 
 #define MLT_PLAYLIST_PRODUCER( playlist )	( &( playlist )->parent )
@@ -116,7 +116,7 @@ static void *pool_fetch( mlt_pool self )
 			ptr = mlt_deque_pop_back( self->stack );
 
 			// Assign the reference
-			( ( mlt_release )ptr )->references = 1;
+			( ( mlt_release )( ( char * )ptr - sizeof( struct mlt_release_s ) ) )->references = 1;
 		}
 		else
 		{
@@ -174,8 +174,9 @@ static void pool_return( void *ptr )
 			// Lock the pool
 			pthread_mutex_lock( &self->lock );
 
-			// Push the that back back on to the stack
-			mlt_deque_push_back( self->stack, ptr );
+			// Push the that back back on to the stack once the last reference is gone
+			if ( -- that->references <= 0 )
+				mlt_deque_push_back( self->stack, ptr );
 
 			// Unlock the pool
 			pthread_mutex_unlock( &self->lock );
@@ -325,6 +326,54 @@ void *mlt_pool_realloc( void *ptr, int size )
 	return result;
 }
 
+/** Add a reference to an item allocated from the pool.
+ *
+ * The item is only returned to the pool when each reference has been given up
+ * with mlt_pool_release(), which allows a single block to be shared read-only
+ * by a cache and any number of frames.
+ *
+ * \public \memberof mlt_pool_s
+ * \param ptr an opaque pointer of a block in the pool
+ * \return \p ptr
+ */
+
+void *mlt_pool_retain( void *ptr )
+{
+	if ( ptr != NULL )
+	{
+		mlt_release that = ( void * )(( char * )ptr - sizeof( struct mlt_release_s ));
+		mlt_pool self = that->pool;
+
+		pthread_mutex_lock( &self->lock );
+		that->references ++;
+		pthread_mutex_unlock( &self->lock );
+	}
+	return ptr;
+}
+
+/** Get the number of references held on an item allocated from the pool.
+ *
+ * \public \memberof mlt_pool_s
+ * \param ptr an opaque pointer of a block in the pool
+ * \return the reference count, or 0 if \p ptr is NULL
+ */
+
+int mlt_pool_references( void *ptr )
+{
+	int references = 0;
+
+	if ( ptr != NULL )
+	{
+		mlt_release that = ( void * )(( char * )ptr - sizeof( struct mlt_release_s ));
+		mlt_pool self = that->pool;
+
+		pthread_mutex_lock( &self->lock );
+		references = that->references;
+		pthread_mutex_unlock( &self->lock );
+	}
+	return references;
+}
+
 /** Purge unused items in the pool.
  *
  * A form of garbage collection.
@@ -357,6 +406,8 @@ void mlt_pool_purge( )
 }
 
 /** Release the allocated memory.
+ *
+ * This gives up one reference; the block goes back to the pool with the last one.
  *
  * \public \memberof mlt_pool_s
  * \param release an opaque pointer of a block in the pool
@@ -28,6 +28,8 @@ extern void mlt_pool_init( );
 extern void *mlt_pool_alloc( int size );
 extern void *mlt_pool_realloc( void *ptr, int size );
 extern void mlt_pool_release( void *release );
+extern void *mlt_pool_retain( void *ptr );
+extern int mlt_pool_references( void *ptr );
 extern void mlt_pool_purge( );
 extern void mlt_pool_close( );
 
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 /* Forward references. */
 
@@ -994,6 +995,215 @@ int mlt_producer_optimise( mlt_producer self )
 	return error;
 }
 
+/** \brief private to mlt_producer_s, used by mlt_producer_render_range() and mlt_producer_render_list() */
+
+typedef struct
+{
+	mlt_producer producer;
+	mlt_image_format format;
+	int width;
+	int height;
+	mlt_properties properties;
+	mlt_producer_render_callback callback;
+	void *data;
+	mlt_position *positions;
+	mlt_position in;
+	int next;
+	int shown;
+	int count;
+	int stop;
+	int error;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+}
+render_range_job;
+
+/** Fetch, render and deliver frames until the range is done.
+ *
+ * Frames are fetched one at a time, since a producer can only be at one
+ * position, but their images are rendered concurrently and the frames are
+ * delivered in the order they were fetched.
+ * \private \memberof mlt_producer_s
+ * \param arg a render_range_job
+ * \return NULL
+ */
+
+static void *render_range_thread( void *arg )
+{
+	render_range_job *job = arg;
+
+	pthread_mutex_lock( &job->mutex );
+	while ( !job->stop && job->next < job->count )
+	{
+		int index = job->next ++;
+		mlt_position position = job->positions ? job->positions[ index ] : job->in + index;
+		mlt_frame frame = NULL;
+		uint8_t *image = NULL;
+		mlt_image_format format = job->format;
+		int width = job->width;
+		int height = job->height;
+		int error;
+		int stop;
+
+		mlt_producer_seek( job->producer, position );
+		error = mlt_service_get_frame( MLT_PRODUCER_SERVICE( job->producer ), &frame, 0 );
+		if ( frame != NULL && job->properties != NULL )
+			mlt_properties_inherit( MLT_FRAME_PROPERTIES( frame ), job->properties );
+		pthread_mutex_unlock( &job->mutex );
+
+		if ( frame != NULL && format != mlt_image_none )
+			error = mlt_frame_get_image( frame, &image, &format, &width, &height, 0 ) || error;
+
+		pthread_mutex_lock( &job->mutex );
+		while ( job->shown != index && !job->stop )
+			pthread_cond_wait( &job->cond, &job->mutex );
+		stop = job->stop;
+		pthread_mutex_unlock( &job->mutex );
+
+		// Only the thread holding the next position to show gets here
+		if ( !stop && ( error || frame == NULL ) )
+			error = stop = 1;
+		else if ( !stop )
+			stop = job->callback( job->data, position, frame, image, width, height );
+		else
+			error = 0;
+		mlt_frame_close( frame );
+
+		pthread_mutex_lock( &job->mutex );
+		job->stop = job->stop || stop;
+		job->error = job->error || error;
+		job->shown ++;
+		pthread_cond_broadcast( &job->cond );
+	}
+	pthread_mutex_unlock( &job->mutex );
+
+	return NULL;
+}
+
+/** Render the images of a list of positions.
+ *
+ * \private \memberof mlt_producer_s
+ * \see mlt_producer_render_range
+ */
+
+static int render_positions( mlt_producer self, mlt_position in, mlt_position *positions, int count, mlt_image_format format, int width, int height, mlt_properties properties, int threads, mlt_producer_render_callback callback, void *data )
+{
+	mlt_profile profile;
+	mlt_position position;
+	pthread_t *workers = NULL;
+	render_range_job job;
+	int started = 0;
+
+	if ( self == NULL || callback == NULL )
+		return 1;
+
+	profile = mlt_service_profile( MLT_PRODUCER_SERVICE( self ) );
+	position = mlt_producer_position( self );
+
+	memset( &job, 0, sizeof( job ) );
+	job.producer = self;
+	job.format = format;
+	job.width = width > 0 ? width : profile ? profile->width : 0;
+	job.height = height > 0 ? height : profile ? profile->height : 0;
+	job.properties = properties;
+	job.callback = callback;
+	job.data = data;
+	job.positions = positions;
+	job.in = in;
+	job.count = count;
+	pthread_mutex_init( &job.mutex, NULL );
+	pthread_cond_init( &job.cond, NULL );
+
+	// Rendering nothing concurrently only adds threads that wait for each other
+	if ( threads > count )
+		threads = count;
+	if ( threads > 1 && format != mlt_image_none )
+		workers = malloc( ( threads - 1 ) * sizeof( pthread_t ) );
+	while ( workers != NULL && started < threads - 1 )
+	{
+		if ( pthread_create( &workers[ started ], NULL, render_range_thread, &job ) != 0 )
+			break;
+		started ++;
+	}
+	render_range_thread( &job );
+	while ( started -- )
+		pthread_join( workers[ started ], NULL );
+	free( workers );
+
+	pthread_cond_destroy( &job.cond );
+	pthread_mutex_destroy( &job.mutex );
+
+	mlt_producer_seek( self, position );
+
+	return job.error;
+}
+
+/** Render the images of a range of positions.
+ *
+ * This is meant for offline work such as thumbnails and analysis: it pulls the
+ * frames directly from the producer without a consumer, so there are no events,
+ * no frame dropping and no real time pacing. The images are rendered by
+ * \p threads threads, including the calling one, and the callback receives the
+ * frames one at a time in order of position. At most \p threads frames are in
+ * flight at once and their images are allocated from the memory pool, so their
+ * buffers are reused across the range.
+ *
+ * The values of \p properties are copied onto each frame before its image is
+ * rendered, which is where a consumer would set the likes of rescale.interp,
+ * consumer_aspect_ratio, consumer_deinterlace and deinterlace_method.
+ *
+ * With a format of mlt_image_none no image is rendered and the callback gets the
+ * frames in order on the calling thread, for example to get their audio.
+ *
+ * The producer must not be used by anything else while this runs, and its
+ * services must be safe to render concurrently when \p threads is more than 1.
+ * The position of the producer is restored afterwards.
+ *
+ * \public \memberof mlt_producer_s
+ * \param self a producer
+ * \param in the first position to render
+ * \param out the last position to render
+ * \param format the image format to request, or mlt_image_none for no image
+ * \param width the width to request, or 0 for the profile's
+ * \param height the height to request, or 0 for the profile's
+ * \param properties the properties to set on each frame, or NULL
+ * \param threads the number of threads to render with
+ * \param callback the function to receive each frame
+ * \param data the data to supply to the callback
+ * \return true if a frame could not be rendered
+ */
+
+int mlt_producer_render_range( mlt_producer self, mlt_position in, mlt_position out, mlt_image_format format, int width, int height, mlt_properties properties, int threads, mlt_producer_render_callback callback, void *data )
+{
+	return render_positions( self, in, NULL, out >= in ? out - in + 1 : 0, format, width, height, properties, threads, callback, data );
+}
+
+/** Render the images of a list of positions.
+ *
+ * This is mlt_producer_render_range() for positions that are not contiguous,
+ * such as the thumbnails of a filmstrip. The callback receives the frames in
+ * the order of the list.
+ *
+ * \public \memberof mlt_producer_s
+ * \param self a producer
+ * \param positions the positions to render
+ * \param count the number of positions
+ * \param format the image format to request, or mlt_image_none for no image
+ * \param width the width to request, or 0 for the profile's
+ * \param height the height to request, or 0 for the profile's
+ * \param properties the properties to set on each frame, or NULL
+ * \param threads the number of threads to render with
+ * \param callback the function to receive each frame
+ * \param data the data to supply to the callback
+ * \return true if a frame could not be rendered
+ * \see mlt_producer_render_range
+ */
+
+int mlt_producer_render_list( mlt_producer self, mlt_position *positions, int count, mlt_image_format format, int width, int height, mlt_properties properties, int threads, mlt_producer_render_callback callback, void *data )
+{
+	return render_positions( self, 0, positions, count, format, width, height, properties, threads, callback, data );
+}
+
 /** Close the producer.
  *
  * Destroys the producer and deallocates its resources managed by its
@@ -85,6 +85,19 @@ struct mlt_producer_s
  *  Public final methods
  */
 
+/** The signature of a function that receives the frames of mlt_producer_render_range().
+ *
+ * \param data the data supplied to mlt_producer_render_range
+ * \param position the position of the frame
+ * \param frame the frame, which is closed when the function returns
+ * \param image the image of the frame in the requested format, or NULL for mlt_image_none
+ * \param width the width of the image
+ * \param height the height of the image
+ * \return true to stop rendering
+ */
+
+typedef int ( *mlt_producer_render_callback )( void *data, mlt_position position, mlt_frame frame, uint8_t *image, int width, int height );
+
 #define MLT_PRODUCER_SERVICE( producer )	( &( producer )->parent )
 #define MLT_PRODUCER_PROPERTIES( producer )	MLT_SERVICE_PROPERTIES( MLT_PRODUCER_SERVICE( producer ) )
 
@@ -114,6 +127,8 @@ extern int mlt_producer_is_mix( mlt_producer self );
 extern int mlt_producer_is_blank( mlt_producer self );
 extern mlt_producer mlt_producer_cut_parent( mlt_producer self );
 extern int mlt_producer_optimise( mlt_producer self );
+extern int mlt_producer_render_range( mlt_producer self, mlt_position in, mlt_position out, mlt_image_format format, int width, int height, mlt_properties properties, int threads, mlt_producer_render_callback callback, void *data );
+extern int mlt_producer_render_list( mlt_producer self, mlt_position *positions, int count, mlt_image_format format, int width, int height, mlt_properties properties, int threads, mlt_producer_render_callback callback, void *data );
 extern void mlt_producer_close( mlt_producer self );
 
 #endif
@@ -34,11 +34,22 @@
 #include <string.h>
 #include <limits.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/** the version of the format of the repository cache file */
+#define CACHE_VERSION 2
 
 /** \brief Repository class
  *
  * The Repository is a collection of plugin modules and their services and service metadata.
  *
+ * The services of each module are remembered in a cache file, and when the cache is up to
+ * date with the modules directory and the paths and environment variables the modules watch,
+ * a module is only opened
+ * when one of its services is first created or asked for its metadata.
+ *
  * \extends mlt_properties_s
  * \properties \p language a cached list of user locales
  */
@@ -50,9 +61,384 @@ struct mlt_repository_s
 	mlt_properties filters;         /// a list of entry points for filters
 	mlt_properties producers;       /// a list of entry points for producers
 	mlt_properties transitions;     /// a list of entry points for transitions
+	mlt_properties watched;         /// a list of files and directories the services depend upon
+	mlt_properties environment;     /// a list of environment variables the services depend upon
+	const char *module;             /// the object file currently registering its services
+	int lazy;                       /// whether the services were read from the cache
+	pthread_mutex_t mutex;          /// serialises opening modules on demand
 };
 
+static mlt_properties get_service_properties( mlt_repository self, mlt_service_type type, const char *service );
+
+/** Open a module and let it register its services.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param object_name the full path of a file in the modules directory
+ */
+
+static void open_module( mlt_repository self, const char *object_name )
+{
+	int flags = RTLD_NOW;
+
+	// Only open each module once
+	if ( mlt_properties_get_data( &self->parent, object_name, NULL ) )
+		return;
+
+	// Very temporary hack to allow the quicktime plugins to work
+	// TODO: extend repository to allow this to be used on a case by case basis
+	if ( strstr( object_name, "libmltkino" ) )
+		flags |= RTLD_GLOBAL;
+
+	// Open the shared object
+	void *object = dlopen( object_name, flags );
+	if ( object != NULL )
+	{
+		// Get the registration function
+		mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
+
+		// Call the registration function
+		if ( symbol_ptr != NULL )
+		{
+			// Register the object file for closure - this must be set before the
+			// services since the properties list holds the name of the module
+			mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
+			self->module = mlt_properties_get_name( &self->parent, mlt_properties_count( &self->parent ) - 1 );
+			symbol_ptr( self );
+			self->module = NULL;
+		}
+		else
+		{
+			dlclose( object );
+		}
+	}
+	else if ( strstr( object_name, "libmlt" ) )
+	{
+		mlt_log( NULL, MLT_LOG_WARNING, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
+	}
+}
+
+/** Open every module in the repository directory.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param dir the directory listing
+ */
+
+static void open_modules( mlt_repository self, mlt_properties dir )
+{
+	int count = mlt_properties_count( dir );
+	int i;
+
+	for ( i = 0; i < count; i++ )
+		open_module( self, mlt_properties_get_value( dir, i ) );
+}
+
+/** Get the full path of a file in the cache directory.
+ *
+ * The cache directory is $XDG_CACHE_HOME or $HOME/.cache.
+ *
+ * \private \memberof mlt_repository_s
+ * \param name the name of the file
+ * \return a new string or NULL if there is no cache directory
+ */
+
+static char *cache_path( const char *name )
+{
+	char *base = getenv( "XDG_CACHE_HOME" );
+	char *filename = malloc( PATH_MAX );
+
+	if ( base && strlen( base ) )
+	{
+		snprintf( filename, PATH_MAX, "%s/%s", base, name );
+	}
+	else if ( getenv( "HOME" ) )
+	{
+		snprintf( filename, PATH_MAX, "%s/.cache/%s", getenv( "HOME" ), name );
+	}
+	else
+	{
+		free( filename );
+		filename = NULL;
+	}
+	return filename;
+}
+
+/** Open a new file to replace a cache file, creating the cache directory if needed.
+ *
+ * The file is written beside the cache file and moved into place by cache_commit()
+ * so that readers never see a partial cache.
+ *
+ * \private \memberof mlt_repository_s
+ * \param filename the name of the cache file
+ * \param temp set to a new string with the name of the file to give to cache_commit()
+ * \return the file or NULL if it could not be created
+ */
+
+static FILE *cache_create( const char *filename, char **temp )
+{
+	FILE *file;
+
+	*temp = malloc( strlen( filename ) + 20 );
+	sprintf( *temp, "%s.%d", filename, ( int )getpid() );
+	file = fopen( *temp, "w" );
+	if ( !file )
+	{
+		// Try again after creating the cache directory
+		char *slash = strrchr( *temp, '/' );
+		if ( slash && slash != *temp )
+		{
+			*slash = 0;
+			mkdir( *temp, 0755 );
+			*slash = '/';
+			file = fopen( *temp, "w" );
+		}
+	}
+	return file;
+}
+
+/** Close a file from cache_create() and move it into place if it was written.
+ *
+ * \private \memberof mlt_repository_s
+ * \param file the file
+ * \param temp the name of the file, which is freed
+ * \param filename the name of the cache file
+ * \return true if there was an error
+ */
+
+static int cache_commit( FILE *file, char *temp, const char *filename )
+{
+	int error = fclose( file ) != 0 || rename( temp, filename ) != 0;
+
+	if ( error )
+		remove( temp );
+	free( temp );
+	return error;
+}
+
+/** Get the name of the cache file for a modules directory.
+ *
+ * The environment variable MLT_REPOSITORY_CACHE overrides the default of a file in
+ * $XDG_CACHE_HOME or $HOME/.cache, and setting it empty disables the cache.
+ *
+ * \private \memberof mlt_repository_s
+ * \param directory the full path of the modules directory
+ * \return a new string or NULL if there is no cache
+ */
+
+static char *cache_filename( const char *directory )
+{
+	char *filename = getenv( "MLT_REPOSITORY_CACHE" );
+	unsigned int hash = 5381;
+	char name[ 30 ];
+	const char *p;
+
+	if ( filename )
+		return strlen( filename ) ? strdup( filename ) : NULL;
+
+	// A file per modules directory lets several installations share the cache directory
+	for ( p = directory; *p; p++ )
+		hash = hash * 33 + ( unsigned char )*p;
+
+	snprintf( name, sizeof( name ), "mlt-repository-%08x", hash );
+	return cache_path( name );
+}
+
+/** Determine whether a directory entry should be recorded in the cache.
+ *
+ * \private \memberof mlt_repository_s
+ * \param object_name the full path of a file in the modules directory
+ * \param st the status of the file
+ * \return true if the entry is a file whose change can alter the services
+ */
+
+static int cache_entry( const char *object_name, struct stat *st )
+{
+	const char *name = strrchr( object_name, '/' );
+	name = name ? name + 1 : object_name;
+	return name[0] != '.' && stat( object_name, st ) == 0 && !S_ISDIR( st->st_mode );
+}
+
+/** Register the services listed in a cache file without opening their modules.
+ *
+ * The cache is only used when it lists exactly the files in the modules directory with
+ * their current modification times and sizes, and the watched paths and environment
+ * variables are unchanged.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param filename the name of the cache file
+ * \param dir the directory listing
+ * \return true if the cache was valid and its services are registered
+ */
+
+static int read_cache( mlt_repository self, const char *filename, mlt_properties dir )
+{
+	FILE *file = fopen( filename, "r" );
+	mlt_properties files = mlt_properties_new();
+	mlt_properties names = mlt_properties_new();
+	char line[ PATH_MAX + 100 ];
+	int valid = 0;
+	int entries = 0;
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( dir ); i++ )
+	{
+		struct stat st;
+		if ( cache_entry( mlt_properties_get_value( dir, i ), &st ) )
+		{
+			snprintf( line, sizeof( line ), "%lld %lld", ( long long )st.st_mtime, ( long long )st.st_size );
+			mlt_properties_set( names, mlt_properties_get_value( dir, i ), line );
+			entries ++;
+		}
+	}
+
+	if ( file && fgets( line, sizeof( line ), file ) && atoi( line ) == CACHE_VERSION )
+	{
+		while ( fgets( line, sizeof( line ), file ) )
+		{
+			char *name;
+			line[ strcspn( line, "\n" ) ] = 0;
+			name = strchr( line, ' ' );
+			if ( !name )
+				break;
+			*name++ = 0;
+
+			if ( !strcmp( line, "file" ) )
+			{
+				// A file entry is "file <mtime> <size> <path>"
+				char *path = strchr( name, ' ' );
+				path = path ? strchr( path + 1, ' ' ) : NULL;
+				if ( !path )
+					break;
+				*path++ = 0;
+				if ( !mlt_properties_get( names, path ) || strcmp( mlt_properties_get( names, path ), name ) )
+					break;
+				snprintf( line, sizeof( line ), "%d", mlt_properties_count( files ) );
+				mlt_properties_set( files, line, path );
+			}
+			else if ( !strcmp( line, "watch" ) )
+			{
+				// A watch entry is "watch <mtime> <path>"
+				struct stat st;
+				char *path = strchr( name, ' ' );
+				long long mtime = -1;
+				if ( !path )
+					break;
+				*path++ = 0;
+				if ( stat( path, &st ) == 0 )
+					mtime = st.st_mtime;
+				if ( mtime != atoll( name ) )
+					break;
+			}
+			else if ( !strcmp( line, "env" ) )
+			{
+				// An env entry is "env <name>=<value>", or "env <name>" when it is not set
+				char *value = strchr( name, '=' );
+				if ( value )
+					*value++ = 0;
+				if ( !getenv( name ) != !value || ( value && strcmp( getenv( name ), value ) ) )
+					break;
+			}
+			else if ( !strcmp( line, "service" ) )
+			{
+				// A service entry is "service <type> <metadata> <file> <id>"
+				int type = 0, metadata = 0, index = 0, offset = 0;
+				mlt_properties service;
+				if ( mlt_properties_count( files ) != entries ||
+				     sscanf( name, "%d %d %d %n", &type, &metadata, &index, &offset ) < 3 ||
+				     offset == 0 || index < 0 || index >= entries )
+					break;
+				mlt_repository_register( self, type, name + offset, NULL );
+				service = get_service_properties( self, type, name + offset );
+				if ( service )
+				{
+					mlt_properties_set( service, "module", mlt_properties_get_value( files, index ) );
+					mlt_properties_set_int( service, "has_metadata", metadata );
+				}
+			}
+			else if ( !strcmp( line, "end" ) )
+			{
+				valid = mlt_properties_count( files ) == entries;
+				break;
+			}
+		}
+	}
+
+	if ( file )
+		fclose( file );
+	mlt_properties_close( files );
+	mlt_properties_close( names );
+
+	return valid;
+}
+
+/** Write the services of the opened modules to a cache file.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param filename the name of the cache file
+ * \param dir the directory listing
+ */
+
+static void write_cache( mlt_repository self, const char *filename, mlt_properties dir )
+{
+	mlt_properties lists[] = { self->producers, self->filters, self->transitions, self->consumers };
+	mlt_service_type types[] = { producer_type, filter_type, transition_type, consumer_type };
+	mlt_properties files = mlt_properties_new();
+	char *temp = NULL;
+	FILE *file = cache_create( filename, &temp );
+	int i, j;
+
+	if ( file )
+	{
+		fprintf( file, "%d MLT repository cache\n", CACHE_VERSION );
+		for ( i = 0; i < mlt_properties_count( dir ); i++ )
+		{
+			const char *object_name = mlt_properties_get_value( dir, i );
+			struct stat st;
+			if ( cache_entry( object_name, &st ) )
+			{
+				char index[ 20 ];
+				snprintf( index, sizeof( index ), "%d", mlt_properties_count( files ) );
+				mlt_properties_set( files, object_name, index );
+				fprintf( file, "file %lld %lld %s\n", ( long long )st.st_mtime, ( long long )st.st_size, object_name );
+			}
+		}
+		for ( i = 0; i < mlt_properties_count( self->watched ); i++ )
+			fprintf( file, "watch %s %s\n", mlt_properties_get_value( self->watched, i ), mlt_properties_get_name( self->watched, i ) );
+		for ( i = 0; i < mlt_properties_count( self->environment ); i++ )
+			fprintf( file, "env %s\n", mlt_properties_get_value( self->environment, i ) );
+		for ( i = 0; i < 4; i++ )
+		{
+			for ( j = 0; j < mlt_properties_count( lists[i] ); j++ )
+			{
+				mlt_properties service = mlt_properties_get_data_at( lists[i], j, NULL );
+				char *module = service ? mlt_properties_get( service, "module" ) : NULL;
+				char *index = module ? mlt_properties_get( files, module ) : NULL;
+				if ( index )
+					fprintf( file, "service %d %d %s %s\n", types[i],
+						mlt_properties_get_data( service, "metadata_cb", NULL ) != NULL, index,
+						mlt_properties_get_name( lists[i], j ) );
+			}
+		}
+		fprintf( file, "end of cache\n" );
+		cache_commit( file, temp, filename );
+	}
+	else
+	{
+		free( temp );
+	}
+
+	mlt_properties_close( files );
+}
+
 /** Construct a new repository.
+ *
+ * When the cache file of the directory is up to date, the services are registered from it
+ * and the modules are opened on demand, otherwise all of the modules are opened and the
+ * cache is written. The environment variable MLT_REPOSITORY_CACHE sets the name of the
+ * cache file, or disables it when empty.
  *
  * \public \memberof mlt_repository_s
  * \param directory the full path of a directory from which to read modules
@@ -72,48 +458,37 @@ mlt_repository mlt_repository_init( const char *directory )
 	self->filters = mlt_properties_new();
 	self->producers = mlt_properties_new();
 	self->transitions = mlt_properties_new();
+	self->watched = mlt_properties_new();
+	self->environment = mlt_properties_new();
+
+	pthread_mutex_init( &self->mutex, NULL );
 
 	// Get the directory list
 	mlt_properties dir = mlt_properties_new();
-	int count = mlt_properties_dir_list( dir, directory, NULL, 0 );
-	int i;
+	char *cache = cache_filename( directory );
+	mlt_properties_dir_list( dir, directory, NULL, 0 );
 
-	// Iterate over files
-	for ( i = 0; i < count; i++ )
+	if ( cache && read_cache( self, cache, dir ) )
 	{
-		int flags = RTLD_NOW;
-		const char *object_name = mlt_properties_get_value( dir, i);
-
-		// Very temporary hack to allow the quicktime plugins to work
-		// TODO: extend repository to allow this to be used on a case by case basis
-		if ( strstr( object_name, "libmltkino" ) )
-			flags |= RTLD_GLOBAL;
-
-		// Open the shared object
-		void *object = dlopen( object_name, flags );
-		if ( object != NULL )
-		{
-			// Get the registration function
-			mlt_repository_callback symbol_ptr = dlsym( object, "mlt_register" );
-
-			// Call the registration function
-			if ( symbol_ptr != NULL )
-			{
-				symbol_ptr( self );
+		self->lazy = 1;
+	}
+	else
+	{
+		// Discard anything registered from an invalid cache
+		mlt_properties_close( self->consumers );
+		mlt_properties_close( self->filters );
+		mlt_properties_close( self->producers );
+		mlt_properties_close( self->transitions );
+		self->consumers = mlt_properties_new();
+		self->filters = mlt_properties_new();
+		self->producers = mlt_properties_new();
+		self->transitions = mlt_properties_new();
 
-				// Register the object file for closure
-				mlt_properties_set_data( &self->parent, object_name, object, 0, ( mlt_destructor )dlclose, NULL );
-			}
-			else
-			{
-				dlclose( object );
-			}
-		}
-		else if ( strstr( object_name, "libmlt" ) )
-		{
-			mlt_log( NULL, MLT_LOG_WARNING, "%s: failed to dlopen %s\n  (%s)\n", __FUNCTION__, object_name, dlerror() );
-		}
+		open_modules( self, dir );
+		if ( cache )
+			write_cache( self, cache, dir );
 	}
+	free( cache );
 
 	mlt_properties_close( dir );
 
@@ -147,26 +522,285 @@ static mlt_properties new_service( void *symbol )
 
 void mlt_repository_register( mlt_repository self, mlt_service_type service_type, const char *service, mlt_register_callback symbol )
 {
+	mlt_properties properties = NULL;
+	mlt_properties existing = get_service_properties( self, service_type, service );
+
+	// A module opened on demand does not replace the service of another module
+	if ( existing && self->module && self->lazy && mlt_properties_get( existing, "module" ) &&
+	     strcmp( self->module, mlt_properties_get( existing, "module" ) ) )
+		return;
+
+	properties = new_service( symbol );
+	if ( self->module )
+		mlt_properties_set( properties, "module", self->module );
+
 	// Add the entry point to the corresponding service list
 	switch ( service_type )
 	{
 		case consumer_type:
-			mlt_properties_set_data( self->consumers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			mlt_properties_set_data( self->consumers, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
 			break;
 		case filter_type:
-			mlt_properties_set_data( self->filters, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			mlt_properties_set_data( self->filters, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
 			break;
 		case producer_type:
-			mlt_properties_set_data( self->producers, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			mlt_properties_set_data( self->producers, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
 			break;
 		case transition_type:
-			mlt_properties_set_data( self->transitions, service, new_service( symbol ), 0, ( mlt_destructor )mlt_properties_close, NULL );
+			mlt_properties_set_data( self->transitions, service, properties, 0, ( mlt_destructor )mlt_properties_close, NULL );
 			break;
 		default:
+			mlt_properties_close( properties );
 			break;
 	}
 }
 
+/** Declare that the services of a module depend upon a file or directory.
+ *
+ * A module that finds its services at run time, for example by scanning a directory for
+ * plugins, should call this within its mlt_register() for each place it looks, so that
+ * the repository cache is refreshed when one changes.
+ *
+ * \public \memberof mlt_repository_s
+ * \param self a repository
+ * \param path the full path of a file or directory, which need not exist
+ */
+
+void mlt_repository_watch( mlt_repository self, const char *path )
+{
+	struct stat st;
+	char mtime[ 30 ];
+
+	snprintf( mtime, sizeof( mtime ), "%lld", stat( path, &st ) == 0 ? ( long long )st.st_mtime : -1LL );
+	mlt_properties_set( self->watched, path, mtime );
+}
+
+/** Declare that the services of a module depend upon an environment variable.
+ *
+ * A module that looks for its services in places given by the environment, for example
+ * a search path, should call this within its mlt_register() for each variable it reads,
+ * so that the repository cache is refreshed when one is set, changed or unset.
+ *
+ * \public \memberof mlt_repository_s
+ * \param self a repository
+ * \param name the name of an environment variable
+ */
+
+void mlt_repository_watch_env( mlt_repository self, const char *name )
+{
+	const char *value = getenv( name );
+	char *entry = malloc( strlen( name ) + ( value ? strlen( value ) : 0 ) + 2 );
+
+	// Keep it as it is written to the cache, a value could look like an expression
+	if ( value )
+		sprintf( entry, "%s=%s", name, value );
+	else
+		strcpy( entry, name );
+	mlt_properties_set( self->environment, name, entry );
+	free( entry );
+}
+
+/** Write a string to a module cache, escaping the characters that separate its fields.
+ *
+ * \private \memberof mlt_repository_s
+ * \param file a file
+ * \param s a string
+ */
+
+static void cache_write_string( FILE *file, const char *s )
+{
+	for ( ; s && *s; s++ )
+	{
+		if ( *s == '\\' )
+			fputs( "\\\\", file );
+		else if ( *s == '\t' )
+			fputs( "\\t", file );
+		else if ( *s == '\n' )
+			fputs( "\\n", file );
+		else
+			fputc( *s, file );
+	}
+}
+
+/** Undo the escaping of cache_write_string() in place.
+ *
+ * \private \memberof mlt_repository_s
+ * \param s a string
+ * \return the string
+ */
+
+static char *cache_read_string( char *s )
+{
+	char *p = s, *q = s;
+
+	while ( *p )
+	{
+		if ( *p == '\\' && p[1] )
+		{
+			p++;
+			*q++ = *p == 't' ? '\t' : *p == 'n' ? '\n' : *p;
+			p++;
+		}
+		else
+		{
+			*q++ = *p++;
+		}
+	}
+	*q = 0;
+	return s;
+}
+
+/** Read a line of any length into a buffer that grows as needed.
+ *
+ * \private \memberof mlt_repository_s
+ * \param file a file
+ * \param line the buffer, which may be NULL initially and must be freed
+ * \param size the size of the buffer
+ * \return the line or NULL at the end of the file
+ */
+
+static char *cache_read_line( FILE *file, char **line, size_t *size )
+{
+	size_t used = 0;
+
+	while ( 1 )
+	{
+		if ( *size - used < 2 )
+		{
+			*size = *size ? *size * 2 : 4096;
+			*line = realloc( *line, *size );
+		}
+		if ( !fgets( *line + used, *size - used, file ) )
+			return used ? *line : NULL;
+		used += strlen( *line + used );
+		if ( ( *line )[ used - 1 ] == '\n' )
+			return *line;
+	}
+}
+
+/** Load a module cache.
+ *
+ * A module that describes its services by opening plugins, such as frei0r or LADSPA,
+ * can keep the descriptions in a file of the cache directory so that a plugin is only
+ * opened when it is new or has changed. The module decides what to store and how to
+ * detect a change, for example with the modification time of each plugin.
+ *
+ * Each line of the file is the name of an entry followed by its name=value properties,
+ * separated by tabs. Setting MLT_REPOSITORY_CACHE empty disables module caches as well.
+ *
+ * \public \memberof mlt_repository_s
+ * \param name the name of the file in the cache directory
+ * \return a new properties list that holds a properties list for each entry
+ */
+
+mlt_properties mlt_repository_cache_load( const char *name )
+{
+	mlt_properties cache = mlt_properties_new();
+	char *disabled = getenv( "MLT_REPOSITORY_CACHE" );
+	char *filename = disabled && !strlen( disabled ) ? NULL : cache_path( name );
+	FILE *file = filename ? fopen( filename, "r" ) : NULL;
+	char *line = NULL;
+	size_t size = 0;
+
+	while ( file && cache_read_line( file, &line, &size ) )
+	{
+		mlt_properties entry = mlt_properties_new();
+		char *save = NULL;
+		char *key = strtok_r( line, "\t\n", &save );
+		char *token;
+
+		while ( ( token = strtok_r( NULL, "\t\n", &save ) ) )
+		{
+			char *value = strchr( token, '=' );
+			if ( value )
+			{
+				*value++ = 0;
+				mlt_properties_set( entry, token, cache_read_string( value ) );
+			}
+		}
+		if ( key )
+			mlt_properties_set_data( cache, cache_read_string( key ), entry, 0, ( mlt_destructor )mlt_properties_close, NULL );
+		else
+			mlt_properties_close( entry );
+	}
+	if ( file )
+		fclose( file );
+	free( line );
+	free( filename );
+
+	return cache;
+}
+
+/** Save a module cache, creating the cache directory if needed.
+ *
+ * \public \memberof mlt_repository_s
+ * \param name the name of the file in the cache directory
+ * \param cache a properties list that holds a properties list for each entry
+ * \return true if the cache could not be written
+ * \see mlt_repository_cache_load
+ */
+
+int mlt_repository_cache_save( const char *name, mlt_properties cache )
+{
+	char *disabled = getenv( "MLT_REPOSITORY_CACHE" );
+	char *filename = disabled && !strlen( disabled ) ? NULL : cache_path( name );
+	char *temp = NULL;
+	FILE *file = filename ? cache_create( filename, &temp ) : NULL;
+	int error = file == NULL;
+	int i, j;
+
+	if ( file )
+	{
+		for ( i = 0; i < mlt_properties_count( cache ); i++ )
+		{
+			mlt_properties entry = mlt_properties_get_data_at( cache, i, NULL );
+			cache_write_string( file, mlt_properties_get_name( cache, i ) );
+			for ( j = 0; entry && j < mlt_properties_count( entry ); j++ )
+			{
+				fputc( '\t', file );
+				cache_write_string( file, mlt_properties_get_name( entry, j ) );
+				fputc( '=', file );
+				cache_write_string( file, mlt_properties_get_value( entry, j ) );
+			}
+			fputc( '\n', file );
+		}
+		error = cache_commit( file, temp, filename );
+	}
+	else
+	{
+		free( temp );
+	}
+	free( filename );
+
+	return error;
+}
+
+/** Get the name of a file in the cache directory for a module to keep data of its own.
+ *
+ * This is for caches that are not a list of properties, such as an index of some
+ * media, which the module reads and writes itself. The cache directory is created
+ * when needed. Setting MLT_REPOSITORY_CACHE empty disables these caches as well.
+ *
+ * \public \memberof mlt_repository_s
+ * \param name the name of the file in the cache directory
+ * \return a new string or NULL if there is no cache directory
+ */
+
+char *mlt_repository_cache_file( const char *name )
+{
+	char *disabled = getenv( "MLT_REPOSITORY_CACHE" );
+	char *filename = disabled && !strlen( disabled ) ? NULL : cache_path( name );
+	char *slash = filename ? strrchr( filename, '/' ) : NULL;
+
+	if ( slash && slash != filename )
+	{
+		*slash = 0;
+		mkdir( filename, 0755 );
+		*slash = '/';
+	}
+	return filename;
+}
+
 /** Get the repository properties for particular service class.
  *
  * \private \memberof mlt_repository_s
@@ -201,6 +835,35 @@ static mlt_properties get_service_properties( mlt_repository self, mlt_service_t
 	return service_properties;
 }
 
+/** Get the repository properties for a service, opening its module if needed.
+ *
+ * \private \memberof mlt_repository_s
+ * \param self a repository
+ * \param type a service class
+ * \param service the name of a service
+ * \return a properties list or NULL if error
+ */
+
+static mlt_properties load_service_properties( mlt_repository self, mlt_service_type type, const char *service )
+{
+	mlt_properties properties = get_service_properties( self, type, service );
+
+	if ( self->lazy && properties && mlt_properties_get_data( properties, "symbol", NULL ) == NULL )
+	{
+		pthread_mutex_lock( &self->mutex );
+		properties = get_service_properties( self, type, service );
+		if ( properties && mlt_properties_get_data( properties, "symbol", NULL ) == NULL && mlt_properties_get( properties, "module" ) )
+		{
+			char *module = strdup( mlt_properties_get( properties, "module" ) );
+			open_module( self, module );
+			free( module );
+			properties = get_service_properties( self, type, service );
+		}
+		pthread_mutex_unlock( &self->mutex );
+	}
+	return properties;
+}
+
 /** Construct a new instance of a service.
  *
  * \public \memberof mlt_repository_s
@@ -213,7 +876,7 @@ static mlt_properties get_service_properties( mlt_repository self, mlt_service_t
 
 void *mlt_repository_create( mlt_repository self, mlt_profile profile, mlt_service_type type, const char *service, const void *input )
 {
-	mlt_properties properties = get_service_properties( self, type, service );
+	mlt_properties properties = load_service_properties( self, type, service );
 	if ( properties != NULL )
 	{
 		mlt_register_callback symbol_ptr = mlt_properties_get_data( properties, "symbol", NULL );
@@ -236,7 +899,10 @@ void mlt_repository_close( mlt_repository self )
 	mlt_properties_close( self->filters );
 	mlt_properties_close( self->producers );
 	mlt_properties_close( self->transitions );
+	mlt_properties_close( self->watched );
+	mlt_properties_close( self->environment );
 	mlt_properties_close( &self->parent );
+	pthread_mutex_destroy( &self->mutex );
 	free( self );
 }
 
@@ -304,6 +970,11 @@ mlt_properties mlt_repository_transitions( mlt_repository self )
 void mlt_repository_register_metadata( mlt_repository self, mlt_service_type type, const char *service, mlt_metadata_callback callback, void *callback_data )
 {
 	mlt_properties service_properties = get_service_properties( self, type, service );
+
+	// Ignore the metadata of a service that belongs to another module
+	if ( service_properties && self->module && mlt_properties_get( service_properties, "module" ) &&
+	     strcmp( self->module, mlt_properties_get( service_properties, "module" ) ) )
+		return;
 	mlt_properties_set_data( service_properties, "metadata_cb", callback, 0, NULL, NULL );
 	mlt_properties_set_data( service_properties, "metadata_cb_data", callback_data, 0, NULL, NULL );
 }
@@ -324,6 +995,10 @@ mlt_properties mlt_repository_metadata( mlt_repository self, mlt_service_type ty
 	mlt_properties metadata = NULL;
 	mlt_properties properties = get_service_properties( self, type, service );
 
+	// Open the module of a service from the cache that has metadata
+	if ( properties && mlt_properties_get_int( properties, "has_metadata" ) )
+		properties = load_service_properties( self, type, service );
+
 	// If this is a valid service
 	if ( properties )
 	{
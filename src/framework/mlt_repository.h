@@ -64,6 +64,11 @@ extern mlt_properties mlt_repository_filters( mlt_repository self );
 extern mlt_properties mlt_repository_producers( mlt_repository self );
 extern mlt_properties mlt_repository_transitions( mlt_repository self );
 extern void mlt_repository_register_metadata( mlt_repository self, mlt_service_type type, const char *service, mlt_metadata_callback, void *callback_data );
+extern void mlt_repository_watch( mlt_repository self, const char *path );
+extern void mlt_repository_watch_env( mlt_repository self, const char *name );
+extern mlt_properties mlt_repository_cache_load( const char *name );
+extern int mlt_repository_cache_save( const char *name, mlt_properties cache );
+extern char *mlt_repository_cache_file( const char *name );
 extern mlt_properties mlt_repository_metadata( mlt_repository self, mlt_service_type type, const char *service );
 extern mlt_properties mlt_repository_languages( mlt_repository self );
 extern mlt_properties mlt_repository_presets( );
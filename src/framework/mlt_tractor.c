@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
 
 /* Forward references to static methods.
 */
@@ -257,13 +259,170 @@ mlt_producer mlt_tractor_get_track( mlt_tractor self, int index )
 	return mlt_multitrack_track( mlt_tractor_multitrack( self ), index );
 }
 
-static int producer_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+/** \brief A request to resolve the image or audio of a track frame on the thread pool
+ */
+
+typedef struct
+{
+	mlt_frame frame;
+	int audio;
+	mlt_image_format image_format;
+	mlt_audio_format audio_format;
+	int width;
+	int height;
+	int frequency;
+	int channels;
+	int samples;
+	int *pending;
+}
+tractor_job;
+
+// The thread pool shared by all parallel tractors, joined when the last of them closes
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static mlt_deque pool_jobs = NULL;
+static pthread_t *pool_thread_ids = NULL;
+static int pool_threads = 0;
+static int pool_users = 0;
+static int pool_generation = 0;
+
+static void pool_run( tractor_job *job )
+{
+	if ( job->audio )
+	{
+		void *buffer = NULL;
+		mlt_frame_get_audio( job->frame, &buffer, &job->audio_format, &job->frequency, &job->channels, &job->samples );
+	}
+	else
+	{
+		uint8_t *buffer = NULL;
+		mlt_frame_get_image( job->frame, &buffer, &job->image_format, &job->width, &job->height, 0 );
+	}
+
+	pthread_mutex_lock( &pool_mutex );
+	( *job->pending ) --;
+	pthread_cond_broadcast( &pool_cond );
+	pthread_mutex_unlock( &pool_mutex );
+}
+
+static void *pool_thread( void *arg )
+{
+	int generation = ( intptr_t )arg;
+	pthread_mutex_lock( &pool_mutex );
+	while ( generation == pool_generation )
+	{
+		tractor_job *job = mlt_deque_pop_front( pool_jobs );
+		if ( job )
+		{
+			pthread_mutex_unlock( &pool_mutex );
+			pool_run( job );
+			pthread_mutex_lock( &pool_mutex );
+		}
+		else
+		{
+			pthread_cond_wait( &pool_cond, &pool_mutex );
+		}
+	}
+	pthread_mutex_unlock( &pool_mutex );
+	return NULL;
+}
+
+/** Register a tractor as a user of the thread pool.
+ *
+ * \private \memberof mlt_tractor_s
+ */
+
+static void pool_acquire( )
+{
+	pthread_mutex_lock( &pool_mutex );
+	pool_users ++;
+	pthread_mutex_unlock( &pool_mutex );
+}
+
+/** Unregister a user of the thread pool and join its threads after the last one.
+ *
+ * The threads are detached from the pool under the lock, so a tractor that
+ * starts in the meantime simply gets a new set of threads.
+ * \private \memberof mlt_tractor_s
+ */
+
+static void pool_release( )
+{
+	pthread_t *ids = NULL;
+	int count = 0;
+	int i;
+
+	pthread_mutex_lock( &pool_mutex );
+	if ( -- pool_users == 0 )
+	{
+		ids = pool_thread_ids;
+		count = pool_threads;
+		pool_thread_ids = NULL;
+		pool_threads = 0;
+		pool_generation ++;
+		pthread_cond_broadcast( &pool_cond );
+	}
+	pthread_mutex_unlock( &pool_mutex );
+
+	for ( i = 0; i < count; i ++ )
+		pthread_join( ids[ i ], NULL );
+	free( ids );
+}
+
+/** Resolve the jobs concurrently and wait for all of them.
+ *
+ * The calling thread works on queued jobs while it waits so that nested
+ * parallel tractors can not starve the pool.
+ * \private \memberof mlt_tractor_s
+ * \param jobs an array of jobs
+ * \param count the number of jobs
+ * \param threads the number of pool threads to use
+ */
+
+static void pool_process( tractor_job *jobs, int count, int threads )
+{
+	int pending = count;
+	int i;
+
+	pthread_mutex_lock( &pool_mutex );
+	if ( pool_jobs == NULL )
+		pool_jobs = mlt_deque_init( );
+	if ( pool_threads < threads )
+	{
+		pthread_t *ids = realloc( pool_thread_ids, threads * sizeof( pthread_t ) );
+		if ( ids )
+		{
+			pool_thread_ids = ids;
+			while ( pool_threads < threads && pthread_create( &ids[ pool_threads ], NULL, pool_thread, ( void* )( intptr_t )pool_generation ) == 0 )
+				pool_threads ++;
+		}
+	}
+	for ( i = 0; i < count; i ++ )
+	{
+		jobs[ i ].pending = &pending;
+		mlt_deque_push_back( pool_jobs, &jobs[ i ] );
+	}
+	pthread_cond_broadcast( &pool_cond );
+
+	while ( pending > 0 )
+	{
+		tractor_job *job = mlt_deque_pop_front( pool_jobs );
+		if ( job )
+		{
+			pthread_mutex_unlock( &pool_mutex );
+			pool_run( job );
+			pthread_mutex_lock( &pool_mutex );
+		}
+		else
+		{
+			pthread_cond_wait( &pool_cond, &pool_mutex );
+		}
+	}
+	pthread_mutex_unlock( &pool_mutex );
+}
+
+static void pass_consumer_properties( mlt_properties properties, mlt_properties frame_properties )
 {
-	uint8_t *data = NULL;
-	int size = 0;
-	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
-	mlt_frame frame = mlt_frame_pop_service( self );
-	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
 	mlt_properties_set( frame_properties, "rescale.interp", mlt_properties_get( properties, "rescale.interp" ) );
 	mlt_properties_set_int( frame_properties, "resize_alpha", mlt_properties_get_int( properties, "resize_alpha" ) );
 	mlt_properties_set_int( frame_properties, "distort", mlt_properties_get_int( properties, "distort" ) );
@@ -272,6 +431,115 @@ static int producer_get_image( mlt_frame self, uint8_t **buffer, mlt_image_forma
 	mlt_properties_set( frame_properties, "deinterlace_method", mlt_properties_get( properties, "deinterlace_method" ) );
 	mlt_properties_set_int( frame_properties, "normalised_width", mlt_properties_get_int( properties, "normalised_width" ) );
 	mlt_properties_set_int( frame_properties, "normalised_height", mlt_properties_get_int( properties, "normalised_height" ) );
+}
+
+/** Prepare a track frame for rendering on the thread pool.
+ *
+ * The scaling is only passed when the consumer asked for one so that the
+ * producers keep their own defaults. A transition B frame gets what its
+ * get_image_b would otherwise read from the A frame while that one is being
+ * rendered by another thread, including the fallback to nearest scaling.
+ * \private \memberof mlt_tractor_s
+ * \param properties the tractor frame's properties
+ * \param frame_properties the track frame's properties
+ */
+
+static void pass_parallel_properties( mlt_properties properties, mlt_properties frame_properties )
+{
+	const char *rescale = mlt_properties_get( properties, "rescale.interp" );
+
+	mlt_properties_set_int( frame_properties, "resize_alpha", mlt_properties_get_int( properties, "resize_alpha" ) );
+	mlt_properties_set_int( frame_properties, "distort", mlt_properties_get_int( properties, "distort" ) );
+	mlt_properties_set_double( frame_properties, "consumer_aspect_ratio", mlt_properties_get_double( properties, "consumer_aspect_ratio" ) );
+	mlt_properties_set_int( frame_properties, "consumer_deinterlace", mlt_properties_get_int( properties, "consumer_deinterlace" ) );
+	mlt_properties_set( frame_properties, "deinterlace_method", mlt_properties_get( properties, "deinterlace_method" ) );
+	mlt_properties_set_int( frame_properties, "normalised_width", mlt_properties_get_int( properties, "normalised_width" ) );
+	mlt_properties_set_int( frame_properties, "normalised_height", mlt_properties_get_int( properties, "normalised_height" ) );
+
+	if ( mlt_properties_get_int( frame_properties, "_transition_b" ) )
+	{
+		if ( !mlt_properties_get( frame_properties, "rescale.interp" ) )
+			mlt_properties_set( frame_properties, "rescale.interp", !rescale || !strcmp( rescale, "none" ) ? "nearest" : rescale );
+		if ( mlt_properties_get_double( frame_properties, "aspect_ratio" ) == 0.0 )
+			mlt_properties_set_double( frame_properties, "aspect_ratio", mlt_properties_get_double( properties, "consumer_aspect_ratio" ) );
+		mlt_properties_set_int( frame_properties, "_transition_b", 2 );
+	}
+	else if ( rescale )
+	{
+		mlt_properties_set( frame_properties, "rescale.interp", rescale );
+	}
+}
+
+/** Resolve the image or audio of the independent track frames concurrently.
+ *
+ * The tracks are rendered with the request made of the tractor frame, so their
+ * results are waiting in the track frames when the transitions ask for them.
+ * \private \memberof mlt_tractor_s
+ * \param self the tractor's output frame
+ * \param name the property holding the deque of track frames
+ * \param job the template request
+ */
+
+static void parallel_prefetch( mlt_frame self, const char *name, tractor_job *job )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	mlt_deque frames = mlt_properties_get_data( properties, name, NULL );
+	int count = mlt_deque_count( frames );
+
+	if ( count > 0 )
+	{
+		tractor_job *jobs = malloc( count * sizeof( tractor_job ) );
+		int queued = 0;
+		int i;
+
+		for ( i = 0; i < count; i ++ )
+		{
+			mlt_frame frame = mlt_deque_peek( frames, i );
+			mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+
+			// The tracks stacked on the track below are left to the serial path
+			if ( mlt_properties_get_int( frame_properties, job->audio ? "_parallel_audio_chained" : "_parallel_image_chained" ) )
+				continue;
+			jobs[ queued ] = *job;
+			jobs[ queued ].frame = frame;
+			if ( !job->audio )
+			{
+				pass_parallel_properties( properties, frame_properties );
+
+				// The transitions that allow it ask their B frames for yuv422 (see _parallel_b)
+				if ( mlt_properties_get_int( frame_properties, "_transition_b" ) )
+					jobs[ queued ].image_format = mlt_image_yuv422;
+			}
+			queued ++;
+		}
+		if ( queued > 1 )
+			pool_process( jobs, queued, mlt_properties_get_int( properties, "_parallel" ) );
+		free( jobs );
+
+		// Only once
+		mlt_properties_set_data( properties, name, NULL, 0, NULL, NULL );
+	}
+}
+
+static int producer_get_image( mlt_frame self, uint8_t **buffer, mlt_image_format *format, int *width, int *height, int writable )
+{
+	uint8_t *data = NULL;
+	int size = 0;
+	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
+	mlt_frame frame = mlt_frame_pop_service( self );
+	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+	if ( mlt_properties_get_data( properties, "_parallel_image", NULL ) )
+	{
+		tractor_job job;
+		memset( &job, 0, sizeof( job ) );
+		job.image_format = *format;
+		job.width = *width;
+		job.height = *height;
+		parallel_prefetch( self, "_parallel_image", &job );
+	}
+
+	// Transitions read this frame while rendering their B frames, so it is only updated now
+	pass_consumer_properties( properties, frame_properties );
 	mlt_frame_get_image( frame, buffer, format, width, height, writable );
 	mlt_frame_set_image( self, *buffer, 0, NULL );
 	mlt_properties_set_int( properties, "width", *width );
@@ -294,6 +562,17 @@ static int producer_get_audio( mlt_frame self, void **buffer, mlt_audio_format *
 {
 	mlt_properties properties = MLT_FRAME_PROPERTIES( self );
 	mlt_frame frame = mlt_frame_pop_audio( self );
+	if ( mlt_properties_get_data( properties, "_parallel_audio", NULL ) )
+	{
+		tractor_job job;
+		memset( &job, 0, sizeof( job ) );
+		job.audio = 1;
+		job.audio_format = *format;
+		job.frequency = *frequency;
+		job.channels = *channels;
+		job.samples = *samples;
+		parallel_prefetch( self, "_parallel_audio", &job );
+	}
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 	mlt_frame_set_audio( self, *buffer, *format, mlt_audio_format_size( *format, *samples, *channels ), NULL );
 	mlt_properties_set_int( properties, "audio_frequency", *frequency );
@@ -355,6 +634,11 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 		// Determine whether this tractor feeds to the consumer or stops here
 		int global_feed = mlt_properties_get_int( properties, "global_feed" );
 
+		// Determine whether the tracks are resolved concurrently
+		int parallel = mlt_properties_get_int( properties, "parallel" );
+		mlt_deque parallel_image = NULL;
+		mlt_deque parallel_audio = NULL;
+
 		// If we don't have one, we're in trouble...
 		if ( multitrack != NULL )
 		{
@@ -379,6 +663,17 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 			mlt_producer target = MLT_MULTITRACK_PRODUCER( multitrack );
 			mlt_producer_seek( target, mlt_producer_frame( parent ) );
 			mlt_producer_set_speed( target, mlt_producer_get_speed( parent ) );
+			mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( target ), "_parallel", parallel > 0 );
+			if ( parallel > 0 )
+			{
+				if ( !mlt_properties_get_int( properties, "_pool_user" ) )
+				{
+					mlt_properties_set_int( properties, "_pool_user", 1 );
+					pool_acquire( );
+				}
+				parallel_image = mlt_deque_init( );
+				parallel_audio = mlt_deque_init( );
+			}
 
 			// We will create one frame and attach everything to it
 			*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( parent ) );
@@ -457,6 +752,18 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 					}
 				}
 
+				// Collect the tracks that nothing was stacked on since the multitrack,
+				// including those a transition is about to consume
+				if ( parallel_image && !done )
+				{
+					int depth = mlt_deque_count( MLT_FRAME_IMAGE_STACK( temp ) );
+					if ( !mlt_frame_is_test_card( temp ) && depth > 0 && depth == mlt_properties_get_int( temp_properties, "_multitrack_image_depth" ) )
+						mlt_deque_push_back( parallel_image, temp );
+					depth = mlt_deque_count( MLT_FRAME_AUDIO_STACK( temp ) );
+					if ( !mlt_frame_is_test_audio( temp ) && depth > 0 && depth == mlt_properties_get_int( temp_properties, "_multitrack_audio_depth" ) )
+						mlt_deque_push_back( parallel_audio, temp );
+				}
+
 				// Pick up first video and audio frames
 				if ( !done && !mlt_frame_is_test_audio( temp ) && !( mlt_properties_get_int( temp_properties, "hide" ) & 2 ) )
 				{
@@ -465,6 +772,7 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 					{
 						mlt_deque_push_front( MLT_FRAME_AUDIO_STACK( temp ), producer_get_audio );
 						mlt_deque_push_front( MLT_FRAME_AUDIO_STACK( temp ), audio );
+						mlt_properties_set_int( temp_properties, "_parallel_audio_chained", 1 );
 					}
 					audio = temp;
 				}
@@ -474,6 +782,7 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 					{
 						mlt_deque_push_front( MLT_FRAME_IMAGE_STACK( temp ), producer_get_image );
 						mlt_deque_push_front( MLT_FRAME_IMAGE_STACK( temp ), video );
+						mlt_properties_set_int( temp_properties, "_parallel_image_chained", 1 );
 					}
 					video = temp;
 					if ( first_video == NULL )
@@ -488,6 +797,20 @@ static int producer_get_frame( mlt_producer parent, mlt_frame_ptr frame, int tra
 				}
 			}
 
+			// Hand the independent tracks over to producer_get_image and producer_get_audio
+			if ( parallel_image )
+			{
+				mlt_properties_set_int( frame_properties, "_parallel", parallel );
+				if ( mlt_deque_count( parallel_image ) > 1 )
+					mlt_properties_set_data( frame_properties, "_parallel_image", parallel_image, 0, ( mlt_destructor )mlt_deque_close, NULL );
+				else
+					mlt_deque_close( parallel_image );
+				if ( mlt_deque_count( parallel_audio ) > 1 )
+					mlt_properties_set_data( frame_properties, "_parallel_audio", parallel_audio, 0, ( mlt_destructor )mlt_deque_close, NULL );
+				else
+					mlt_deque_close( parallel_audio );
+			}
+
 			// Now stack callbacks
 			if ( audio != NULL )
 			{
@@ -556,9 +879,12 @@ void mlt_tractor_close( mlt_tractor self )
 {
 	if ( self != NULL && mlt_properties_dec_ref( MLT_TRACTOR_PROPERTIES( self ) ) <= 0 )
 	{
+		int pool_user = mlt_properties_get_int( MLT_TRACTOR_PROPERTIES( self ), "_pool_user" );
 		self->parent.close = NULL;
 		mlt_producer_close( &self->parent );
 		free( self );
+		if ( pool_user )
+			pool_release( );
 	}
 }
 
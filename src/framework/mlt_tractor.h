@@ -38,6 +38,10 @@
  * \properties \em global_feed a flag to indicate whether this tractor feeds to the consumer or stops here
  * \properties \em global_queue is something for the data_feed functionality in the core module
  * \properties \em data_queue is something for the data_feed functionality in the core module
+ * \properties \em parallel the number of threads used to fetch the images and audio of the tracks
+ * concurrently before the transitions combine them, 0 (the default) disables it; tracks are fetched
+ * at the size requested of the tractor, so the B track of a transition is only fetched early when
+ * the transition sets \em _parallel_b to say it asks for B at that size in yuv422 (luma does)
  */
 
 struct mlt_tractor_s
@@ -331,6 +331,11 @@ static int get_image_b( mlt_frame b_frame, uint8_t **image, mlt_image_format *fo
 	mlt_properties a_props = MLT_FRAME_PROPERTIES( a_frame );
 	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
 
+	// A parallel tractor has passed the values of the A frame already,
+	// which is possibly being rendered by another thread
+	if ( mlt_properties_get_int( b_props, "_transition_b" ) == 2 )
+		return mlt_frame_get_image( b_frame, image, format, width, height, writable );
+
 	// Set scaling from A frame if not already provided.
 	if ( !mlt_properties_get( b_props, "rescale.interp" ) )
 	{
@@ -477,11 +482,25 @@ static int transition_get_frame( mlt_service service, mlt_frame_ptr frame, int i
 			int b_hide = mlt_properties_get_int( MLT_FRAME_PROPERTIES( b_frame_ptr ), "hide" );
 			if ( !( a_hide & type ) && !( b_hide & type ) )
 			{
+				mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame_ptr );
+				int b_depth = mlt_deque_count( MLT_FRAME_IMAGE_STACK( b_frame_ptr ) );
+
 				// Add hooks for pre-processing frames
 				mlt_frame_push_get_image( a_frame_ptr, get_image_a );
 				mlt_frame_push_frame( b_frame_ptr, a_frame_ptr );
 				mlt_frame_push_get_image( b_frame_ptr, get_image_b );
 
+				// get_image_b only reads the A frame, so a parallel tractor may still
+				// render the B frame on its own once it has passed those values
+				// (see pass_parallel_properties in mlt_tractor.c), but only for the
+				// transitions that ask for B at the size and format asked of A
+				if ( mlt_properties_get_int( properties, "_parallel_b" ) &&
+					 mlt_properties_get_int( b_props, "_multitrack_image_depth" ) == b_depth && b_depth > 0 )
+				{
+					mlt_properties_set_int( b_props, "_multitrack_image_depth", b_depth + 2 );
+					mlt_properties_set_int( b_props, "_transition_b", 1 );
+				}
+
 				// Process the transition
 				*frame = mlt_transition_process( self, a_frame_ptr, b_frame_ptr );
 
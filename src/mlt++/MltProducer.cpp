@@ -216,3 +216,15 @@ int Producer::clear( )
 {
 	return mlt_producer_clear( get_producer( ) );
 }
+
+int Producer::render_range( int in, int out, mlt_image_format format, int width, int height, Properties *properties, int threads, mlt_producer_render_callback callback, void *data )
+{
+	return mlt_producer_render_range( get_producer( ), in, out, format, width, height,
+		properties != NULL ? properties->get_properties( ) : NULL, threads, callback, data );
+}
+
+int Producer::render_list( mlt_position *positions, int count, mlt_image_format format, int width, int height, Properties *properties, int threads, mlt_producer_render_callback callback, void *data )
+{
+	return mlt_producer_render_list( get_producer( ), positions, count, format, width, height,
+		properties != NULL ? properties->get_properties( ) : NULL, threads, callback, data );
+}
@@ -70,6 +70,10 @@ namespace Mlt
 			bool runs_into( Producer &that );
 			void optimise( );
 			int clear( );
+			int render_range( int in, int out, mlt_image_format format, int width, int height,
+				Properties *properties, int threads, mlt_producer_render_callback callback, void *data = NULL );
+			int render_list( mlt_position *positions, int count, mlt_image_format format, int width, int height,
+				Properties *properties, int threads, mlt_producer_render_callback callback, void *data = NULL );
 	};
 }
 
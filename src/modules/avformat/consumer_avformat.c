@@ -70,81 +70,192 @@ void avformat_unlock( );
 // This structure should be extended and made globally available in mlt
 //
 
+/** A power of two ring buffer of audio samples.
+ *
+ * Counts passed to append, fetch and used are in samples times channels as
+ * for interleaved audio; planar (non-interleaved) formats are stored a plane
+ * per channel. A fifo created with a fixed size never reallocates and may be
+ * appended to by one thread while another fetches from it.
+*/
+
 typedef struct
 {
-	int16_t *buffer;
-	int size;
-	int used;
+	uint8_t *buffer;
+	unsigned int size;              // capacity in sample frames, a power of two
+	volatile unsigned int read;     // free running frame counters
+	volatile unsigned int write;
+	int sample_size;
+	int planar;
+	int lock_free;
 	double time;
 	int frequency;
 	int channels;
 }
 *sample_fifo, sample_fifo_s;
 
-sample_fifo sample_fifo_init( int frequency, int channels )
+static unsigned int sample_fifo_round( unsigned int size )
+{
+	unsigned int result = 1024;
+	while ( result < size )
+		result <<= 1;
+	return result;
+}
+
+/** Create a fifo - size is the fixed capacity in samples per channel for
+ * lock free use between two threads, or 0 to grow as required.
+*/
+
+sample_fifo sample_fifo_init( int frequency, int channels, mlt_audio_format format, int size )
 {
 	sample_fifo fifo = calloc( 1, sizeof( sample_fifo_s ) );
 	fifo->frequency = frequency;
 	fifo->channels = channels;
+	fifo->sample_size = format == mlt_audio_s16 ? sizeof( int16_t ) : 4;
+	fifo->planar = format == mlt_audio_s32 || format == mlt_audio_float;
+	fifo->lock_free = size > 0;
+	if ( fifo->lock_free )
+	{
+		fifo->size = sample_fifo_round( size );
+		fifo->buffer = malloc( fifo->size * fifo->sample_size * channels );
+	}
 	return fifo;
 }
 
-// sample_fifo_clear and check are temporarily aborted (not working as intended)
+int sample_fifo_used( sample_fifo fifo )
+{
+	unsigned int frames = fifo->write - fifo->read;
+	return frames * fifo->channels;
+}
 
-void sample_fifo_clear( sample_fifo fifo, double time )
+// Copy frames between the ring at offset and a linear buffer of total frames starting at index
+static void sample_fifo_copy( sample_fifo fifo, unsigned int offset, uint8_t *samples, int index, int frames, int total, int to_ring )
 {
-	int words = ( float )( time - fifo->time ) * fifo->frequency * fifo->channels;
-	if ( ( int )( ( float )time * 100 ) < ( int )( ( float )fifo->time * 100 ) && fifo->used > words && words > 0 )
+	unsigned int start = offset & ( fifo->size - 1 );
+	int first = FFMIN( frames, ( int )( fifo->size - start ) );
+	int i;
+
+	if ( fifo->planar )
 	{
-		memmove( fifo->buffer, &fifo->buffer[ words ], ( fifo->used - words ) * sizeof( int16_t ) );
-		fifo->used -= words;
-		fifo->time = time;
+		for ( i = 0; i < fifo->channels; i ++ )
+		{
+			uint8_t *plane = fifo->buffer + i * fifo->size * fifo->sample_size;
+			uint8_t *linear = samples + ( i * total + index ) * fifo->sample_size;
+			if ( to_ring )
+			{
+				memcpy( plane + start * fifo->sample_size, linear, first * fifo->sample_size );
+				memcpy( plane, linear + first * fifo->sample_size, ( frames - first ) * fifo->sample_size );
+			}
+			else
+			{
+				memcpy( linear, plane + start * fifo->sample_size, first * fifo->sample_size );
+				memcpy( linear + first * fifo->sample_size, plane, ( frames - first ) * fifo->sample_size );
+			}
+		}
 	}
-	else if ( ( int )( ( float )time * 100 ) != ( int )( ( float )fifo->time * 100 ) )
+	else
 	{
-		fifo->used = 0;
-		fifo->time = time;
+		int frame_size = fifo->sample_size * fifo->channels;
+		uint8_t *linear = samples + index * frame_size;
+		if ( to_ring )
+		{
+			memcpy( fifo->buffer + start * frame_size, linear, first * frame_size );
+			memcpy( fifo->buffer, linear + first * frame_size, ( frames - first ) * frame_size );
+		}
+		else
+		{
+			memcpy( linear, fifo->buffer + start * frame_size, first * frame_size );
+			memcpy( linear + first * frame_size, fifo->buffer, ( frames - first ) * frame_size );
+		}
 	}
 }
 
+// Unwrap the contents into a bigger buffer - only when not lock free
+static void sample_fifo_grow( sample_fifo fifo, unsigned int frames )
+{
+	unsigned int used = fifo->write - fifo->read;
+	unsigned int size = sample_fifo_round( used + frames );
+	uint8_t *buffer = malloc( size * fifo->sample_size * fifo->channels );
+
+	// Planes are unwrapped with a stride of the new size
+	if ( used )
+		sample_fifo_copy( fifo, fifo->read, buffer, 0, used, size, 0 );
+	free( fifo->buffer );
+	fifo->buffer = buffer;
+	fifo->size = size;
+	fifo->read = 0;
+	fifo->write = used;
+}
+
+// sample_fifo_clear and check are temporarily aborted (not working as intended)
+
+void sample_fifo_clear( sample_fifo fifo, double time )
+{
+	fifo->read = fifo->write;
+	fifo->time = time;
+}
+
 void sample_fifo_check( sample_fifo fifo, double time )
 {
-	if ( fifo->used == 0 )
+	if ( sample_fifo_used( fifo ) == 0 )
 	{
 		if ( ( int )( ( float )time * 100 ) < ( int )( ( float )fifo->time * 100 ) )
 			fifo->time = time;
 	}
 }
 
-void sample_fifo_append( sample_fifo fifo, int16_t *samples, int count )
+/** Append count samples (times channels), returning the number appended
+ * which is only less than count when a fixed size fifo is full.
+*/
+
+int sample_fifo_append( sample_fifo fifo, void *samples, int count )
 {
-	if ( ( fifo->size - fifo->used ) < count )
+	unsigned int frames = count / fifo->channels;
+	unsigned int space = fifo->size - ( fifo->write - fifo->read );
+
+	if ( space < frames )
 	{
-		fifo->size += count * 5;
-		fifo->buffer = realloc( fifo->buffer, fifo->size * sizeof( int16_t ) );
+		if ( fifo->lock_free )
+			frames = space;
+		else
+			sample_fifo_grow( fifo, frames );
 	}
 
-	memcpy( &fifo->buffer[ fifo->used ], samples, count * sizeof( int16_t ) );
-	fifo->used += count;
-}
+	if ( frames > 0 )
+	{
+		sample_fifo_copy( fifo, fifo->write, samples, 0, frames, frames, 1 );
 
-int sample_fifo_used( sample_fifo fifo )
-{
-	return fifo->used;
+		// Publish the samples before the position for the reading thread
+		if ( fifo->lock_free )
+			__sync_synchronize( );
+		fifo->write += frames;
+	}
+
+	return frames * fifo->channels;
 }
 
-int sample_fifo_fetch( sample_fifo fifo, int16_t *samples, int count )
+int sample_fifo_fetch( sample_fifo fifo, void *samples, int count )
 {
-	if ( count > fifo->used )
-		count = fifo->used;
+	unsigned int frames = count / fifo->channels;
+	unsigned int used = fifo->write - fifo->read;
 
-	memcpy( samples, fifo->buffer, count * sizeof( int16_t ) );
-	fifo->used -= count;
-	memmove( fifo->buffer, &fifo->buffer[ count ], fifo->used * sizeof( int16_t ) );
+	if ( frames > used )
+		frames = used;
 
-	fifo->time += ( double )count / fifo->channels / fifo->frequency;
+	if ( frames > 0 )
+	{
+		if ( fifo->lock_free )
+			__sync_synchronize( );
+		sample_fifo_copy( fifo, fifo->read, samples, 0, frames, frames, 0 );
+
+		// Finish reading before releasing the space to the writing thread
+		if ( fifo->lock_free )
+			__sync_synchronize( );
+		fifo->read += frames;
+	}
+
+	fifo->time += ( double )frames / fifo->frequency;
 
-	return count;
+	return frames * fifo->channels;
 }
 
 void sample_fifo_close( sample_fifo fifo )
@@ -939,6 +1050,699 @@ static inline long time_difference( struct timeval *time1 )
 	return time2.tv_sec * 1000000 + time2.tv_usec - time1->tv_sec * 1000000 - time1->tv_usec;
 }
 
+/** Extract the channels of one output stream from the interleaved source
+ * according to the channel mapping - j is the running channel offset.
+*/
+
+static void map_audio_channels( mlt_properties map, int current_channels, int16_t *source, int16_t *destination,
+	int samples, int channels, int total_channels, int *j )
+{
+	char key[27];
+	int dest_offset = 0; // channel offset into interleaved dest buffer
+
+	// Clear the destination audio buffer.
+	memset( destination, 0, AUDIO_ENCODE_BUFFER_SIZE );
+
+	// For each output channel
+	while ( dest_offset < current_channels && *j < total_channels )
+	{
+		int map_start = -1, map_channels = 0;
+		int source_offset = 0;
+		int k;
+
+		// Look for a mapping that starts at j
+		for ( k = 0; k < (MAX_AUDIO_STREAMS * 2) && map_start != *j; k++ )
+		{
+			sprintf( key, "%d.channels", k );
+			map_channels = mlt_properties_get_int( map, key );
+			sprintf( key, "%d.start", k );
+			if ( mlt_properties_get( map, key ) )
+				map_start = mlt_properties_get_int( map, key );
+			if ( map_start != *j )
+				source_offset += map_channels;
+		}
+
+		// If no mapping
+		if ( map_start != *j )
+		{
+			map_channels = current_channels;
+			source_offset = *j;
+		}
+
+		// Copy samples if source offset valid
+		if ( source_offset < channels )
+		{
+			// Interleave the audio buffer with the # channels for this stream/mapping.
+			for ( k = 0; k < map_channels; k++, ( *j )++, source_offset++, dest_offset++ )
+			{
+				int16_t *src = source + source_offset;
+				int16_t *dest = destination + dest_offset;
+				int s = samples + 1;
+
+				while ( --s ) {
+					*dest = *src;
+					dest += current_channels;
+					src += channels;
+				}
+			}
+		}
+		// Otherwise silence
+		else
+		{
+			*j += current_channels;
+			dest_offset += current_channels;
+		}
+	}
+}
+
+/** Copy the alpha mask into an RGB32 picture.
+*/
+
+static void apply_alpha( AVFrame *output, uint8_t *alpha, int width, int height )
+{
+	register int n;
+	uint8_t *p;
+	int i;
+
+	for ( i = 0; i < height; i ++ )
+	{
+		n = ( width + 7 ) / 8;
+		p = output->data[ 0 ] + i * output->linesize[ 0 ] + 3;
+
+		switch( width % 8 )
+		{
+			case 0:	do { *p = *alpha++; p += 4;
+			case 7:		 *p = *alpha++; p += 4;
+			case 6:		 *p = *alpha++; p += 4;
+			case 5:		 *p = *alpha++; p += 4;
+			case 4:		 *p = *alpha++; p += 4;
+			case 3:		 *p = *alpha++; p += 4;
+			case 2:		 *p = *alpha++; p += 4;
+			case 1:		 *p = *alpha++; p += 4;
+					}
+					while( --n );
+		}
+	}
+}
+
+static void free_picture( AVFrame *picture )
+{
+	if ( picture )
+		av_free( picture->data[0] );
+	av_free( picture );
+}
+
+/** A bounded queue between two stages of the encoding pipeline.
+ *
+ * Pushing blocks while the queue is full and popping blocks while it is empty;
+ * once every writer has called stage_queue_done, pop returns NULL when drained.
+*/
+
+typedef struct
+{
+	mlt_deque deque;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int size;
+	int writers;
+	int peak;
+	int64_t occupancy;
+	int64_t pushes;
+}
+*stage_queue, stage_queue_s;
+
+static stage_queue stage_queue_init( int size, int writers )
+{
+	stage_queue queue = calloc( 1, sizeof( stage_queue_s ) );
+	queue->deque = mlt_deque_init( );
+	pthread_mutex_init( &queue->mutex, NULL );
+	pthread_cond_init( &queue->cond, NULL );
+	queue->size = size;
+	queue->writers = writers;
+	return queue;
+}
+
+static void stage_queue_push( stage_queue queue, void *item )
+{
+	int count;
+	pthread_mutex_lock( &queue->mutex );
+	while ( mlt_deque_count( queue->deque ) >= queue->size )
+		pthread_cond_wait( &queue->cond, &queue->mutex );
+	mlt_deque_push_back( queue->deque, item );
+	count = mlt_deque_count( queue->deque );
+	queue->occupancy += count;
+	queue->pushes ++;
+	if ( count > queue->peak )
+		queue->peak = count;
+	pthread_cond_broadcast( &queue->cond );
+	pthread_mutex_unlock( &queue->mutex );
+}
+
+static void *stage_queue_pop( stage_queue queue )
+{
+	void *item;
+	pthread_mutex_lock( &queue->mutex );
+	while ( queue->writers > 0 && mlt_deque_count( queue->deque ) == 0 )
+		pthread_cond_wait( &queue->cond, &queue->mutex );
+	item = mlt_deque_pop_front( queue->deque );
+	pthread_cond_broadcast( &queue->cond );
+	pthread_mutex_unlock( &queue->mutex );
+	return item;
+}
+
+static void stage_queue_done( stage_queue queue )
+{
+	pthread_mutex_lock( &queue->mutex );
+	queue->writers --;
+	pthread_cond_broadcast( &queue->cond );
+	pthread_mutex_unlock( &queue->mutex );
+}
+
+/** Publish the average and peak occupancy of a queue as "<name>.occupancy" and "<name>.peak".
+*/
+
+static void stage_queue_stats( stage_queue queue, mlt_properties properties, const char *name )
+{
+	char key[64];
+	double occupancy;
+	int peak;
+
+	pthread_mutex_lock( &queue->mutex );
+	occupancy = queue->pushes ? ( double )queue->occupancy / queue->pushes : 0.0;
+	peak = queue->peak;
+	pthread_mutex_unlock( &queue->mutex );
+
+	snprintf( key, sizeof( key ), "%s.occupancy", name );
+	mlt_properties_set_double( properties, key, occupancy );
+	snprintf( key, sizeof( key ), "%s.peak", name );
+	mlt_properties_set_int( properties, key, peak );
+}
+
+static void stage_queue_close( stage_queue queue )
+{
+	mlt_deque_close( queue->deque );
+	pthread_mutex_destroy( &queue->mutex );
+	pthread_cond_destroy( &queue->cond );
+	free( queue );
+}
+
+/** The state shared by the stages of the encoding pipeline.
+ *
+ * The consumer thread renders frames and feeds the convert and audio stages,
+ * the convert stage feeds the video encoder and both encoders feed the muxer.
+ * Audio samples pass through the lock free fifo while the audio queue carries
+ * the channel map of each frame to wake the audio encoder.
+ * Only the consumer thread touches the consumer properties while it runs.
+*/
+
+typedef struct
+{
+	mlt_consumer consumer;
+	AVFormatContext *oc;
+	AVStream *video_st;
+	AVStream **audio_st;
+	int audio_channels[ MAX_AUDIO_STREAMS ];
+	int total_channels;
+	int audio_input_frame_size;
+	int width;
+	int height;
+	FILE *logfile;
+	sample_fifo fifo;
+	int channels;
+	stage_queue convert_queue;
+	stage_queue video_queue;
+	stage_queue audio_queue;
+	stage_queue mux_queue;
+	int error;
+}
+*encode_pipeline, encode_pipeline_s;
+
+static int encode_pipeline_failed( encode_pipeline self )
+{
+	int error;
+	pthread_mutex_lock( &self->mux_queue->mutex );
+	error = self->error;
+	pthread_mutex_unlock( &self->mux_queue->mutex );
+	return error;
+}
+
+/** Queue a copy of an encoded packet for the muxer - the encoders reuse their buffers.
+*/
+
+static void encode_pipeline_write( encode_pipeline self, AVPacket *pkt )
+{
+	AVPacket *copy = malloc( sizeof( AVPacket ) );
+	*copy = *pkt;
+	copy->data = av_malloc( pkt->size + FF_INPUT_BUFFER_PADDING_SIZE );
+	memcpy( copy->data, pkt->data, pkt->size );
+	stage_queue_push( self->mux_queue, copy );
+}
+
+static void *encode_pipeline_mux( void *arg )
+{
+	encode_pipeline self = arg;
+	AVPacket *pkt;
+
+	while ( ( pkt = stage_queue_pop( self->mux_queue ) ) )
+	{
+		// Keep draining after an error so that the encoders never block
+		if ( !encode_pipeline_failed( self ) && av_interleaved_write_frame( self->oc, pkt ) )
+		{
+			mlt_log_fatal( MLT_CONSUMER_SERVICE( self->consumer ), "error writing %s frame\n",
+				self->video_st && pkt->stream_index == self->video_st->index ? "video" : "audio" );
+			pthread_mutex_lock( &self->mux_queue->mutex );
+			self->error = 1;
+			pthread_mutex_unlock( &self->mux_queue->mutex );
+		}
+		av_free( pkt->data );
+		free( pkt );
+	}
+
+	return NULL;
+}
+
+static void *encode_pipeline_convert( void *arg )
+{
+	encode_pipeline self = arg;
+	AVStream *video_st = self->video_st;
+	int width = self->width;
+	int height = self->height;
+	mlt_frame frame;
+
+#ifdef SWSCALE
+	int flags = SWS_BILINEAR;
+#ifdef USE_MMX
+	flags |= SWS_CPU_CAPS_MMX;
+#endif
+#ifdef USE_SSE
+	flags |= SWS_CPU_CAPS_MMX2;
+#endif
+	struct SwsContext *context = sws_getContext( width, height, PIX_FMT_YUYV422,
+		width, height, video_st->codec->pix_fmt, flags, NULL, NULL, NULL);
+#endif
+
+	while ( ( frame = stage_queue_pop( self->convert_queue ) ) )
+	{
+		mlt_image_format img_fmt = mlt_image_yuv422;
+		int img_width = width;
+		int img_height = height;
+		uint8_t *image = NULL;
+		AVFrame *output = alloc_picture( video_st->codec->pix_fmt, width, height );
+		AVPicture input;
+
+		// The image was rendered by the consumer thread so this just fetches it
+		mlt_frame_get_image( frame, &image, &img_fmt, &img_width, &img_height, 0 );
+
+		// Convert straight from the frame's image rather than a padded copy
+		memset( &input, 0, sizeof( input ) );
+		input.data[0] = image;
+		input.linesize[0] = width * 2;
+#ifdef SWSCALE
+		sws_scale( context, (const uint8_t* const*) input.data, input.linesize, 0, height,
+			output->data, output->linesize);
+#else
+		img_convert( ( AVPicture * )output, video_st->codec->pix_fmt, &input, PIX_FMT_YUYV422, width, height );
+#endif
+
+		// Apply the alpha if applicable
+		if ( video_st->codec->pix_fmt == PIX_FMT_RGB32 )
+			apply_alpha( output, mlt_frame_get_alpha_mask( frame ), width, height );
+
+		mlt_properties_set_data( MLT_FRAME_PROPERTIES( frame ), "_avformat_picture", output, 0, ( mlt_destructor )free_picture, NULL );
+		stage_queue_push( self->video_queue, frame );
+	}
+
+#ifdef SWSCALE
+	sws_freeContext( context );
+#endif
+	stage_queue_done( self->video_queue );
+
+	return NULL;
+}
+
+static int encode_pipeline_encode_video( encode_pipeline self, uint8_t *outbuf, int outbuf_size, AVFrame *picture )
+{
+	AVStream *video_st = self->video_st;
+	AVCodecContext *c = video_st->codec;
+	int out_size = avcodec_encode_video( c, outbuf, outbuf_size, picture );
+
+	// If zero size, it means the image was buffered
+	if ( out_size > 0 )
+	{
+		AVPacket pkt;
+		av_init_packet( &pkt );
+
+		if ( c->coded_frame && c->coded_frame->pts != AV_NOPTS_VALUE )
+			pkt.pts= av_rescale_q( c->coded_frame->pts, c->time_base, video_st->time_base );
+		if( c->coded_frame && c->coded_frame->key_frame )
+			pkt.flags |= PKT_FLAG_KEY;
+		pkt.stream_index= video_st->index;
+		pkt.data= outbuf;
+		pkt.size= out_size;
+		encode_pipeline_write( self, &pkt );
+
+		// Dual pass logging
+		if ( self->logfile && c->stats_out )
+			fprintf( self->logfile, "%s", c->stats_out );
+	}
+	else if ( out_size < 0 && picture )
+	{
+		mlt_log_warning( MLT_CONSUMER_SERVICE( self->consumer ), "error with video encode %"PRId64"\n", picture->pts );
+	}
+
+	return out_size;
+}
+
+static void *encode_pipeline_video( void *arg )
+{
+	encode_pipeline self = arg;
+	int video_outbuf_size = VIDEO_BUFFER_SIZE;
+	uint8_t *video_outbuf = av_malloc( video_outbuf_size );
+	int frame_count = 0;
+	mlt_frame frame;
+
+	while ( ( frame = stage_queue_pop( self->video_queue ) ) )
+	{
+		mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+		AVFrame *output = mlt_properties_get_data( frame_properties, "_avformat_picture", NULL );
+
+		// Set the quality
+		output->quality = self->video_st->quality;
+
+		// Set frame interlace hints
+		output->interlaced_frame = !mlt_properties_get_int( frame_properties, "progressive" );
+		output->top_field_first = mlt_properties_get_int( frame_properties, "top_field_first" );
+		output->pts = frame_count ++;
+
+		encode_pipeline_encode_video( self, video_outbuf, video_outbuf_size, output );
+		mlt_frame_close( frame );
+	}
+
+	// Flush the delayed frames
+	while ( encode_pipeline_encode_video( self, video_outbuf, video_outbuf_size, NULL ) > 0 )
+		mlt_log_debug( MLT_CONSUMER_SERVICE( self->consumer ), "flushed video\n" );
+
+	stage_queue_done( self->mux_queue );
+	av_free( video_outbuf );
+
+	return NULL;
+}
+
+static void encode_pipeline_encode_audio( encode_pipeline self, AVStream *stream, uint8_t *outbuf, int16_t *samples )
+{
+	AVCodecContext *codec = stream->codec;
+	AVPacket pkt;
+
+	av_init_packet( &pkt );
+	pkt.size = avcodec_encode_audio( codec, outbuf, AUDIO_BUFFER_SIZE, samples );
+
+	if ( pkt.size > 0 )
+	{
+		if ( codec->coded_frame && codec->coded_frame->pts != AV_NOPTS_VALUE )
+			pkt.pts = av_rescale_q( codec->coded_frame->pts, codec->time_base, stream->time_base );
+		pkt.flags |= PKT_FLAG_KEY;
+		pkt.stream_index = stream->index;
+		pkt.data = outbuf;
+		encode_pipeline_write( self, &pkt );
+	}
+}
+
+/** Append the audio of a frame to the fifo, waiting for the audio encoder to make room.
+ *
+ * The fifo is sized for the usual number of samples per frame, but a frame
+ * may bring more, and no samples are dropped: while the fifo is full a copy of
+ * the channel map is queued to wake the audio encoder, which drains the fifo.
+*/
+
+static void encode_pipeline_append( encode_pipeline self, int16_t *pcm, int count, mlt_properties map )
+{
+	sample_fifo fifo = self->fifo;
+	stage_queue queue = self->audio_queue;
+	int done = sample_fifo_append( fifo, pcm, count );
+
+	while ( done < count )
+	{
+		mlt_properties wake = mlt_properties_new( );
+		mlt_properties_pass( wake, map, "" );
+		stage_queue_push( queue, wake );
+
+		pthread_mutex_lock( &queue->mutex );
+		while ( sample_fifo_used( fifo ) >= ( int )fifo->size * fifo->channels )
+			pthread_cond_wait( &queue->cond, &queue->mutex );
+		pthread_mutex_unlock( &queue->mutex );
+
+		done += sample_fifo_append( fifo, pcm + done, count - done );
+	}
+}
+
+static void *encode_pipeline_audio( void *arg )
+{
+	encode_pipeline self = arg;
+	AVStream **audio_st = self->audio_st;
+	mlt_properties map = mlt_properties_new( );
+	mlt_properties frame_map;
+	sample_fifo fifo = self->fifo;
+	int channels = self->channels;
+	int16_t *audio_buf_1 = av_malloc( AUDIO_ENCODE_BUFFER_SIZE );
+	int16_t *audio_buf_2 = av_malloc( AUDIO_ENCODE_BUFFER_SIZE );
+	uint8_t *audio_outbuf = av_malloc( AUDIO_BUFFER_SIZE );
+
+	while ( ( frame_map = stage_queue_pop( self->audio_queue ) ) )
+	{
+		mlt_properties_pass( map, frame_map, "" );
+		mlt_properties_close( frame_map );
+
+		while ( ( channels * self->audio_input_frame_size ) < sample_fifo_used( fifo ) )
+		{
+			int n = FFMIN( channels * self->audio_input_frame_size, ( int )( AUDIO_ENCODE_BUFFER_SIZE / sizeof( int16_t ) ) );
+			int samples = sample_fifo_fetch( fifo, audio_buf_1, n ) / channels;
+			int i, j = 0;
+
+			// For each output stream
+			for ( i = 0; i < MAX_AUDIO_STREAMS && audio_st[i] && j < self->total_channels; i++ )
+			{
+				// Optimized for single track and no channel remap
+				if ( !audio_st[1] && !mlt_properties_count( map ) )
+				{
+					encode_pipeline_encode_audio( self, audio_st[i], audio_outbuf, audio_buf_1 );
+				}
+				else
+				{
+					map_audio_channels( map, self->audio_channels[i], audio_buf_1, audio_buf_2,
+						samples, channels, self->total_channels, &j );
+					encode_pipeline_encode_audio( self, audio_st[i], audio_outbuf, audio_buf_2 );
+				}
+			}
+		}
+
+		// Wake the consumer thread if it waits for room in the fifo
+		pthread_mutex_lock( &self->audio_queue->mutex );
+		pthread_cond_broadcast( &self->audio_queue->cond );
+		pthread_mutex_unlock( &self->audio_queue->mutex );
+	}
+
+	// Flush the remaining samples and the delayed frames of the first stream
+	// TODO: flush all audio streams
+	if ( audio_st[0]->codec->frame_size > 1 ) for (;;)
+	{
+		AVCodecContext *c = audio_st[0]->codec;
+		AVPacket pkt;
+		av_init_packet( &pkt );
+		pkt.size = 0;
+
+		if ( channels * self->audio_input_frame_size < sample_fifo_used( fifo ) )
+		{
+			sample_fifo_fetch( fifo, audio_buf_1, channels * self->audio_input_frame_size );
+			pkt.size = avcodec_encode_audio( c, audio_outbuf, AUDIO_BUFFER_SIZE, audio_buf_1 );
+		}
+		if ( pkt.size <= 0 )
+			pkt.size = avcodec_encode_audio( c, audio_outbuf, AUDIO_BUFFER_SIZE, NULL );
+		mlt_log_debug( MLT_CONSUMER_SERVICE( self->consumer ), "flushing audio size %d\n", pkt.size );
+		if ( pkt.size <= 0 )
+			break;
+
+		if ( c->coded_frame && c->coded_frame->pts != AV_NOPTS_VALUE )
+			pkt.pts = av_rescale_q( c->coded_frame->pts, c->time_base, audio_st[0]->time_base );
+		pkt.flags |= PKT_FLAG_KEY;
+		pkt.stream_index = audio_st[0]->index;
+		pkt.data = audio_outbuf;
+		encode_pipeline_write( self, &pkt );
+	}
+
+	stage_queue_done( self->mux_queue );
+
+	mlt_properties_close( map );
+	av_free( audio_buf_1 );
+	av_free( audio_buf_2 );
+	av_free( audio_outbuf );
+
+	return NULL;
+}
+
+static void encode_pipeline_stats( encode_pipeline self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self->consumer );
+
+	if ( self->video_st )
+	{
+		stage_queue_stats( self->convert_queue, properties, "pipeline.convert" );
+		stage_queue_stats( self->video_queue, properties, "pipeline.video" );
+	}
+	if ( self->audio_st[0] )
+		stage_queue_stats( self->audio_queue, properties, "pipeline.audio" );
+	stage_queue_stats( self->mux_queue, properties, "pipeline.mux" );
+}
+
+/** Render frames and feed them through the encoding pipeline until stopped.
+ *
+ * This replaces the interleaved encoding loop of consumer_thread when the
+ * pipeline property is set: colour conversion, video encoding, audio encoding
+ * and muxing each run in their own thread connected by bounded queues.
+*/
+
+static void encode_pipeline_run( mlt_consumer consumer, AVFormatContext *oc, AVStream *video_st, AVStream **audio_st,
+	int audio_input_frame_size, int total_channels )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	int terminate_on_pause = mlt_properties_get_int( properties, "terminate_on_pause" );
+	int terminated = 0;
+	double fps = mlt_properties_get_double( properties, "fps" );
+	int frequency = mlt_properties_get_int( properties, "frequency" );
+	int channels = mlt_properties_get_int( properties, "channels" );
+	int depth = mlt_properties_get_int( properties, "pipeline_depth" );
+	int count = 0;
+	long int frames = 0;
+	pthread_t convert_thread, video_thread, audio_thread, mux_thread;
+	encode_pipeline_s pipeline;
+	encode_pipeline self = &pipeline;
+	char key[27];
+	int i;
+
+	if ( depth < 1 )
+		depth = 4;
+
+	memset( self, 0, sizeof( pipeline ) );
+	self->consumer = consumer;
+	self->oc = oc;
+	self->video_st = video_st;
+	self->audio_st = audio_st;
+	self->total_channels = total_channels;
+	self->audio_input_frame_size = audio_input_frame_size;
+	self->width = mlt_properties_get_int( properties, "width" );
+	self->height = mlt_properties_get_int( properties, "height" );
+	self->logfile = mlt_properties_get_data( properties, "_logfile", NULL );
+	for ( i = 0; i < MAX_AUDIO_STREAMS; i++ )
+	{
+		sprintf( key, "channels.%d", i );
+		self->audio_channels[i] = mlt_properties_get_int( properties, key );
+	}
+
+	// The audio queue bounds the fifo to a few frames more than the queue,
+	// a frame bringing more samples waits for the encoder in encode_pipeline_append
+	self->channels = channels;
+	if ( audio_st[0] )
+		self->fifo = sample_fifo_init( frequency, channels, mlt_audio_s16,
+			( depth + 2 ) * ( mlt_sample_calculator( fps, frequency, 0 ) + 1 ) + audio_input_frame_size );
+
+	// Each encoder is a writer of the mux queue
+	self->convert_queue = stage_queue_init( depth, 1 );
+	self->video_queue = stage_queue_init( depth, 1 );
+	self->audio_queue = stage_queue_init( depth, 1 );
+	self->mux_queue = stage_queue_init( depth * 2, ( video_st != NULL ) + ( audio_st[0] != NULL ) );
+
+	pthread_create( &mux_thread, NULL, encode_pipeline_mux, self );
+	if ( video_st )
+	{
+		pthread_create( &video_thread, NULL, encode_pipeline_video, self );
+		pthread_create( &convert_thread, NULL, encode_pipeline_convert, self );
+	}
+	if ( audio_st[0] )
+		pthread_create( &audio_thread, NULL, encode_pipeline_audio, self );
+
+	while ( mlt_properties_get_int( properties, "running" ) && !terminated && !encode_pipeline_failed( self ) )
+	{
+		mlt_frame frame = mlt_consumer_rt_frame( consumer );
+
+		if ( frame != NULL )
+		{
+			mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+
+			// Check for the terminated condition
+			terminated = terminate_on_pause && mlt_properties_get_double( frame_properties, "_speed" ) == 0.0;
+
+			// Get audio and append it to the fifo of the audio encoder
+			if ( !terminated && audio_st[0] )
+			{
+				mlt_audio_format aud_fmt = mlt_audio_s16;
+				int samples = mlt_sample_calculator( fps, frequency, count ++ );
+				int16_t *pcm = NULL;
+				mlt_properties map = mlt_properties_new( );
+
+				mlt_frame_get_audio( frame, (void**) &pcm, &aud_fmt, &frequency, &channels, &samples );
+
+				// Silence if not normal forward speed
+				if ( mlt_properties_get_double( frame_properties, "_speed" ) != 1.0 )
+					memset( pcm, 0, samples * channels * sizeof( int16_t ) );
+
+				// Save the audio channel remap properties for the encoder
+				mlt_properties_pass( map, frame_properties, "meta.map.audio." );
+
+				if ( channels != self->channels )
+					mlt_log_warning( MLT_CONSUMER_SERVICE( consumer ), "dropping audio with %d channels\n", channels );
+				else
+					encode_pipeline_append( self, pcm, samples * channels, map );
+				stage_queue_push( self->audio_queue, map );
+
+				if ( !video_st )
+					mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+			}
+
+			// Render the image here so that the other stages only convert and encode
+			if ( !terminated && video_st )
+			{
+				mlt_image_format img_fmt = mlt_image_yuv422;
+				int img_width = self->width;
+				int img_height = self->height;
+				uint8_t *image = NULL;
+
+				mlt_frame_get_image( frame, &image, &img_fmt, &img_width, &img_height, 0 );
+				mlt_events_fire( properties, "consumer-frame-show", frame, NULL );
+				stage_queue_push( self->convert_queue, frame );
+			}
+			else
+			{
+				mlt_frame_close( frame );
+			}
+
+			if ( ++ frames % 25 == 0 )
+				encode_pipeline_stats( self );
+		}
+	}
+
+	// Drain the stages in order
+	stage_queue_done( self->convert_queue );
+	stage_queue_done( self->audio_queue );
+	if ( video_st )
+	{
+		pthread_join( convert_thread, NULL );
+		pthread_join( video_thread, NULL );
+	}
+	if ( audio_st[0] )
+		pthread_join( audio_thread, NULL );
+	pthread_join( mux_thread, NULL );
+
+	encode_pipeline_stats( self );
+	if ( self->error )
+		mlt_events_fire( properties, "consumer-fatal-error", NULL );
+
+	stage_queue_close( self->convert_queue );
+	stage_queue_close( self->video_queue );
+	stage_queue_close( self->audio_queue );
+	stage_queue_close( self->mux_queue );
+	if ( self->fifo )
+		sample_fifo_close( self->fifo );
+}
+
 /** The main thread - the argument is simply the consumer.
 */
 
@@ -1263,11 +2067,17 @@ static void *consumer_thread( void *arg )
 	if ( !audio_st[0] && !video_st )
 		mlt_properties_set_int( properties, "running", 0 );
 
+	// Use the encoding pipeline when requested and the output is not paced in real time
+	int pipeline = mlt_properties_get_int( properties, "pipeline" ) && real_time_output <= 0 &&
+		!( fmt->flags & AVFMT_RAWPICTURE );
+	if ( pipeline && mlt_properties_get_int( properties, "running" ) )
+		encode_pipeline_run( consumer, oc, video_st, audio_st, audio_input_frame_size, total_channels );
+
 	// Get the starting time (can ignore the times above)
 	gettimeofday( &ante, NULL );
 
 	// Loop while running
-	while( mlt_properties_get_int( properties, "running" ) &&
+	while( !pipeline && mlt_properties_get_int( properties, "running" ) &&
 	       ( !terminated || ( video_st && mlt_deque_count( queue ) ) ) )
 	{
 		frame = mlt_consumer_rt_frame( consumer );
@@ -1296,7 +2106,7 @@ static void *consumer_thread( void *arg )
 				// Create the fifo if we don't have one
 				if ( fifo == NULL )
 				{
-					fifo = sample_fifo_init( frequency, channels );
+					fifo = sample_fifo_init( frequency, channels, mlt_audio_s16, 0 );
 					mlt_properties_set_data( properties, "sample_fifo", fifo, 0, ( mlt_destructor )sample_fifo_close, NULL );
 				}
 
@@ -1365,69 +2175,15 @@ static void *consumer_thread( void *arg )
 						}
 						else
 						{
-							// Extract the audio channels according to channel mapping
-							int dest_offset = 0; // channel offset into interleaved dest buffer
-
 							// Get the number of channels for this stream
 							sprintf( key, "channels.%d", i );
 							int current_channels = mlt_properties_get_int( properties, key );
 
-							// Clear the destination audio buffer.
+							// Extract the audio channels according to channel mapping
 							if ( !audio_buf_2 )
-								audio_buf_2 = av_mallocz( AUDIO_ENCODE_BUFFER_SIZE );
-							else
-								memset( audio_buf_2, 0, AUDIO_ENCODE_BUFFER_SIZE );
-
-							// For each output channel
-							while ( dest_offset < current_channels && j < total_channels )
-							{
-								int map_start = -1, map_channels = 0;
-								int source_offset = 0;
-								int k;
-
-								// Look for a mapping that starts at j
-								for ( k = 0; k < (MAX_AUDIO_STREAMS * 2) && map_start != j; k++ )
-								{
-									sprintf( key, "%d.channels", k );
-									map_channels = mlt_properties_get_int( frame_meta_properties, key );
-									sprintf( key, "%d.start", k );
-									if ( mlt_properties_get( frame_meta_properties, key ) )
-										map_start = mlt_properties_get_int( frame_meta_properties, key );
-									if ( map_start != j )
-										source_offset += map_channels;
-								}
-
-								// If no mapping
-								if ( map_start != j )
-								{
-									map_channels = current_channels;
-									source_offset = j;
-								}
-
-								// Copy samples if source offset valid
-								if ( source_offset < channels )
-								{
-									// Interleave the audio buffer with the # channels for this stream/mapping.
-									for ( k = 0; k < map_channels; k++, j++, source_offset++, dest_offset++ )
-									{
-										int16_t *src = audio_buf_1 + source_offset;
-										int16_t *dest = audio_buf_2 + dest_offset;
-										int s = samples + 1;
-
-										while ( --s ) {
-											*dest = *src;
-											dest += current_channels;
-											src += channels;
-										}
-									}
-								}
-								// Otherwise silence
-								else
-								{
-									j += current_channels;
-									dest_offset += current_channels;
-								}
-							}
+								audio_buf_2 = av_malloc( AUDIO_ENCODE_BUFFER_SIZE );
+							map_audio_channels( frame_meta_properties, current_channels, audio_buf_1, audio_buf_2,
+								samples, channels, total_channels, &j );
 							pkt.size = avcodec_encode_audio( codec, audio_outbuf, audio_outbuf_size, audio_buf_2 );
 						}
 
@@ -1517,30 +2273,7 @@ static void *consumer_thread( void *arg )
 
 						// Apply the alpha if applicable
 						if ( video_st->codec->pix_fmt == PIX_FMT_RGB32 )
-						{
-							uint8_t *alpha = mlt_frame_get_alpha_mask( frame );
-							register int n;
-
-							for ( i = 0; i < height; i ++ )
-							{
-								n = ( width + 7 ) / 8;
-								p = output->data[ 0 ] + i * output->linesize[ 0 ] + 3;
-
-								switch( width % 8 )
-								{
-									case 0:	do { *p = *alpha++; p += 4;
-									case 7:		 *p = *alpha++; p += 4;
-									case 6:		 *p = *alpha++; p += 4;
-									case 5:		 *p = *alpha++; p += 4;
-									case 4:		 *p = *alpha++; p += 4;
-									case 3:		 *p = *alpha++; p += 4;
-									case 2:		 *p = *alpha++; p += 4;
-									case 1:		 *p = *alpha++; p += 4;
-											}
-											while( --n );
-								}
-							}
-						}
+							apply_alpha( output, mlt_frame_get_alpha_mask( frame ), width, height );
 					}
 
 					if (oc->oformat->flags & AVFMT_RAWPICTURE) 
@@ -1638,7 +2371,7 @@ static void *consumer_thread( void *arg )
 	}
 
 	// Flush the encoder buffers
-	if ( real_time_output <= 0 )
+	if ( !pipeline && real_time_output <= 0 )
 	{
 		// Flush audio fifo
 		// TODO: flush all audio streams
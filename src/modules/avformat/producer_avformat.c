@@ -28,6 +28,7 @@
 #include <framework/mlt_deque.h>
 #include <framework/mlt_factory.h>
 #include <framework/mlt_cache.h>
+#include <framework/mlt_repository.h>
 
 // ffmpeg Header files
 #include <libavformat/avformat.h>
@@ -51,6 +52,8 @@ const char *avcodec_get_sample_fmt_name(int sample_fmt);
 #include <string.h>
 #include <pthread.h>
 #include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #if LIBAVUTIL_VERSION_INT < (50<<16)
 #define PIX_FMT_RGB32 PIX_FMT_RGBA32
@@ -71,10 +74,24 @@ const char *avcodec_get_sample_fmt_name(int sample_fmt);
 
 #define MAX_AUDIO_STREAMS (10)
 #define MAX_VDPAU_SURFACES (10)
+#define DECODE_AHEAD_DEFAULT (2)
+
+#define KEYFRAME_INDEX_MAGIC "MLTINDEX"
+#define KEYFRAME_INDEX_VERSION (2)
+#define KEYFRAME_INDEX_HEADER (52)
+#define KEYFRAME_INDEX_ENTRY (12)
 
 void avformat_lock( );
 void avformat_unlock( );
 
+/** A keyframe of the video stream found by the keyframe index */
+
+struct keyframe_s
+{
+	int position;    ///< the frame number computed from the presentation time stamp
+	int64_t dts;     ///< the time stamp to give to av_seek_frame
+};
+
 struct producer_avformat_s
 {
 	mlt_producer parent;
@@ -111,6 +128,22 @@ struct producer_avformat_s
 	int colorspace;
 	pthread_mutex_t video_mutex;
 	pthread_mutex_t audio_mutex;
+	pthread_t ahead_thread;
+	pthread_mutex_t ahead_mutex;
+	pthread_cond_t ahead_cond;
+	int ahead_running;
+	int ahead_count;
+	mlt_position ahead_request;
+	mlt_position ahead_position;
+	mlt_position ahead_limit;
+	mlt_image_format ahead_format;
+	int keyframe_index;
+	struct keyframe_s *keyframes;
+	int keyframes_count;
+	int keyframes_size;
+	int keyframes_until;
+	int keyframes_contiguous;
+	int keyframes_dirty;
 #ifdef VDPAU
 	struct
 	{
@@ -134,9 +167,11 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 static void producer_avformat_close( producer_avformat );
 static void producer_close( mlt_producer parent );
 static void producer_set_up_video( producer_avformat self, mlt_frame frame );
+static int video_open( producer_avformat self );
 static void producer_set_up_audio( producer_avformat self, mlt_frame frame );
 static void apply_properties( void *obj, mlt_properties properties, int flags );
 static int video_codec_init( producer_avformat self, int index, mlt_properties properties );
+static void *decode_ahead_thread( void *arg );
 
 #ifdef VDPAU
 #include "vdpau.c"
@@ -1046,6 +1081,276 @@ static int allocate_buffer( mlt_frame frame, AVCodecContext *codec_context, uint
 	return size;
 }
 
+/** Get the frame number of a video packet time stamp.
+ *
+ * This must agree with how producer_get_image determines the position of decoded pictures.
+*/
+
+static int keyframe_position( producer_avformat self, AVFormatContext *context, AVStream *stream, int64_t pts, double source_fps )
+{
+	if ( self->first_pts > 0 )
+		pts -= self->first_pts;
+	else if ( context->start_time != AV_NOPTS_VALUE )
+		pts -= context->start_time;
+	return ( int )( av_q2d( stream->time_base ) * pts * source_fps + 0.1 );
+}
+
+/** Find the last keyframe at or before a position.
+ *
+ * \return the index of the keyframe or -1 if there is none
+*/
+
+static int keyframe_find( producer_avformat self, int position )
+{
+	int lower = 0;
+	int upper = self->keyframes_count - 1;
+	int result = -1;
+
+	while ( lower <= upper )
+	{
+		int middle = ( lower + upper ) / 2;
+		if ( self->keyframes[ middle ].position <= position )
+		{
+			result = middle;
+			lower = middle + 1;
+		}
+		else
+		{
+			upper = middle - 1;
+		}
+	}
+	return result;
+}
+
+/** Add a keyframe to the index unless it is already known.
+*/
+
+static void keyframe_add( producer_avformat self, int position, int64_t dts )
+{
+	int i = keyframe_find( self, position );
+
+	if ( i >= 0 && self->keyframes[ i ].position == position )
+		return;
+	if ( self->keyframes_count == self->keyframes_size )
+	{
+		int size = self->keyframes_size ? self->keyframes_size * 2 : 256;
+		struct keyframe_s *keyframes = realloc( self->keyframes, size * sizeof( struct keyframe_s ) );
+		if ( !keyframes )
+			return;
+		self->keyframes = keyframes;
+		self->keyframes_size = size;
+	}
+
+	// Usually this appends
+	i ++;
+	if ( i < self->keyframes_count )
+		memmove( &self->keyframes[ i + 1 ], &self->keyframes[ i ], ( self->keyframes_count - i ) * sizeof( struct keyframe_s ) );
+	self->keyframes[ i ].position = position;
+	self->keyframes[ i ].dts = dts;
+	self->keyframes_count ++;
+	self->keyframes_dirty = 1;
+}
+
+/** Get the file name of the keyframe index cache.
+ *
+ * The index is kept in the cache directory unless keyframe_index_beside asks
+ * for {resource}.mltindex beside the media.
+ *
+ * \return a file name to free or NULL if the resource is not a regular file
+*/
+
+static char *keyframe_index_file( producer_avformat self, struct stat *file_stat )
+{
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( self->parent );
+	char *resource = mlt_properties_get( properties, "resource" );
+	char *result = NULL;
+
+	if ( resource && !stat( resource, file_stat ) && S_ISREG( file_stat->st_mode ) )
+	{
+		if ( mlt_properties_get_int( properties, "keyframe_index_beside" ) )
+		{
+			result = malloc( strlen( resource ) + strlen( ".mltindex" ) + 1 );
+			if ( result )
+				sprintf( result, "%s.mltindex", resource );
+		}
+		else
+		{
+			unsigned int hash = 5381;
+			char name[ 30 ];
+			const char *p;
+
+			for ( p = resource; *p; p++ )
+				hash = hash * 33 + ( unsigned char )*p;
+			snprintf( name, sizeof( name ), "mlt-index-%08x", hash );
+			result = mlt_repository_cache_file( name );
+		}
+	}
+	return result;
+}
+
+/** Read and write the little endian numbers of the keyframe index cache.
+*/
+
+static uint64_t keyframe_index_get( const uint8_t *p, int bytes )
+{
+	uint64_t value = 0;
+	while ( bytes-- )
+		value = ( value << 8 ) | p[ bytes ];
+	return value;
+}
+
+static void keyframe_index_put( uint8_t *p, uint64_t value, int bytes )
+{
+	while ( bytes-- )
+	{
+		*p++ = value & 0xff;
+		value >>= 8;
+	}
+}
+
+/** Load the keyframe index from its cache file.
+ *
+ * The file starts with a header of KEYFRAME_INDEX_HEADER bytes: the magic
+ * "MLTINDEX", then as little endian integers the version, the video stream,
+ * the size and modification time of the media (64 bits), first_pts (64 bits),
+ * the last position covered, the number of keyframes and the length of the name
+ * of the media. The name follows, and then a 32 bit position and a 64 bit dts
+ * for each keyframe.
+ *
+ * \return true if the index was loaded
+*/
+
+static int keyframe_index_load( producer_avformat self )
+{
+	struct stat file_stat;
+	char *filename = keyframe_index_file( self, &file_stat );
+	char *resource = mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" );
+	FILE *file = filename ? fopen( filename, "rb" ) : NULL;
+	int loaded = 0;
+
+	if ( file )
+	{
+		uint8_t header[ KEYFRAME_INDEX_HEADER ];
+		size_t length = strlen( resource );
+		char *name = malloc( length + 1 );
+
+		if ( name && fread( header, 1, KEYFRAME_INDEX_HEADER, file ) == KEYFRAME_INDEX_HEADER
+			&& !memcmp( header, KEYFRAME_INDEX_MAGIC, 8 )
+			&& keyframe_index_get( header + 8, 4 ) == KEYFRAME_INDEX_VERSION
+			&& keyframe_index_get( header + 12, 4 ) == self->video_index
+			&& keyframe_index_get( header + 16, 8 ) == file_stat.st_size
+			&& keyframe_index_get( header + 24, 8 ) == file_stat.st_mtime
+			&& keyframe_index_get( header + 48, 4 ) == length
+			&& fread( name, 1, length, file ) == length && !memcmp( name, resource, length ) )
+		{
+			int count = keyframe_index_get( header + 44, 4 );
+			uint8_t entry[ KEYFRAME_INDEX_ENTRY ];
+
+			while ( count-- > 0 && fread( entry, 1, KEYFRAME_INDEX_ENTRY, file ) == KEYFRAME_INDEX_ENTRY )
+				keyframe_add( self, ( int32_t )keyframe_index_get( entry, 4 ), ( int64_t )keyframe_index_get( entry + 4, 8 ) );
+			self->first_pts = ( int64_t )keyframe_index_get( header + 32, 8 );
+			self->keyframes_until = ( int32_t )keyframe_index_get( header + 40, 4 );
+			self->keyframes_dirty = 0;
+			loaded = 1;
+		}
+		free( name );
+		fclose( file );
+	}
+	free( filename );
+
+	return loaded;
+}
+
+/** Save the keyframe index to its cache file.
+ *
+ * A new file is written and moved into place so readers never see part of one.
+*/
+
+static void keyframe_index_save( producer_avformat self )
+{
+	struct stat file_stat;
+	char *filename = keyframe_index_file( self, &file_stat );
+	char *resource = mlt_properties_get( MLT_PRODUCER_PROPERTIES( self->parent ), "resource" );
+	char *temp = filename ? malloc( strlen( filename ) + 20 ) : NULL;
+	FILE *file = NULL;
+
+	if ( temp )
+	{
+		sprintf( temp, "%s.%d", filename, ( int )getpid() );
+		file = fopen( temp, "wb" );
+	}
+	if ( file )
+	{
+		uint8_t header[ KEYFRAME_INDEX_HEADER ];
+		uint8_t entry[ KEYFRAME_INDEX_ENTRY ];
+		size_t length = strlen( resource );
+		int error;
+		int i;
+
+		memcpy( header, KEYFRAME_INDEX_MAGIC, 8 );
+		keyframe_index_put( header + 8, KEYFRAME_INDEX_VERSION, 4 );
+		keyframe_index_put( header + 12, self->video_index, 4 );
+		keyframe_index_put( header + 16, file_stat.st_size, 8 );
+		keyframe_index_put( header + 24, file_stat.st_mtime, 8 );
+		keyframe_index_put( header + 32, ( int64_t )self->first_pts, 8 );
+		keyframe_index_put( header + 40, ( uint32_t )self->keyframes_until, 4 );
+		keyframe_index_put( header + 44, self->keyframes_count, 4 );
+		keyframe_index_put( header + 48, length, 4 );
+		error = fwrite( header, 1, KEYFRAME_INDEX_HEADER, file ) != KEYFRAME_INDEX_HEADER
+			|| fwrite( resource, 1, length, file ) != length;
+		for ( i = 0; !error && i < self->keyframes_count; i++ )
+		{
+			keyframe_index_put( entry, ( uint32_t )self->keyframes[ i ].position, 4 );
+			keyframe_index_put( entry + 4, self->keyframes[ i ].dts, 8 );
+			error = fwrite( entry, 1, KEYFRAME_INDEX_ENTRY, file ) != KEYFRAME_INDEX_ENTRY;
+		}
+		error = fclose( file ) || error;
+		if ( error || rename( temp, filename ) )
+		{
+			mlt_log_warning( MLT_PRODUCER_SERVICE( self->parent ), "failed to write the keyframe index %s\n", filename );
+			remove( temp );
+		}
+		self->keyframes_dirty = 0;
+	}
+	free( temp );
+	free( filename );
+}
+
+/** Build the keyframe index by reading the packets of the whole file without decoding them.
+ *
+ * The positions are taken with the first_pts producer_get_image uses, which the
+ * scan leaves as it was.
+*/
+
+static void keyframe_index_scan( producer_avformat self, AVFormatContext *context, AVStream *stream, double source_fps )
+{
+	AVPacket pkt;
+	int last_position = -1;
+
+	av_init_packet( &pkt );
+	av_seek_frame( context, -1, 0, AVSEEK_FLAG_BACKWARD );
+	while ( av_read_frame( context, &pkt ) >= 0 )
+	{
+		if ( pkt.stream_index == self->video_index && pkt.pts != AV_NOPTS_VALUE )
+		{
+			if ( ( pkt.flags & PKT_FLAG_KEY ) )
+			{
+				keyframe_add( self, keyframe_position( self, context, stream, pkt.pts, source_fps ),
+					pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts );
+			}
+			last_position = FFMAX( last_position, keyframe_position( self, context, stream, pkt.pts, source_fps ) );
+		}
+		av_free_packet( &pkt );
+	}
+	self->keyframes_until = last_position;
+	mlt_log_verbose( MLT_PRODUCER_SERVICE( self->parent ), "keyframe index: %d keyframes in %d frames\n",
+		self->keyframes_count, last_position + 1 );
+
+	// Rewind
+	av_seek_frame( context, -1, 0, AVSEEK_FLAG_BACKWARD );
+	self->keyframes_contiguous = 1;
+}
+
 /** Get an image from a frame.
 */
 
@@ -1064,7 +1369,14 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	// Get the producer properties
 	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
 
-	pthread_mutex_lock( &self->video_mutex );
+	// Frames decoded in the background by decode_ahead_thread
+	int is_ahead = mlt_properties_get_int( frame_properties, "avformat.decode_ahead" );
+	mlt_image_format requested_format = *format;
+
+	// Open the video on first use; on failure the test card is shown instead
+	if ( !video_open( self ) )
+		return 1;
+	mlt_properties_set_int( frame_properties, "colorspace", self->colorspace );
 
 	// Fetch the video format context
 	AVFormatContext *context = self->video_format;
@@ -1075,9 +1387,51 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	// Get codec context
 	AVCodecContext *codec_context = stream->codec;
 
+	// Whether an image was obtained, the cache is searched before waiting on the decoder
+	int got_image = 0;
+
 	// Get the image cache
 	if ( ! self->image_cache && ! mlt_properties_get_int( properties, "noimagecache" ) )
-		self->image_cache = mlt_cache_init();
+	{
+		mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
+		if ( ! self->image_cache )
+		{
+			mlt_cache cache = mlt_cache_init();
+
+			// Decode a few frames ahead by default when the media can be sought back to;
+			// the cache must at least hold the frames decoded ahead
+			int decode_ahead = mlt_properties_get( properties, "decode_ahead" ) ?
+				mlt_properties_get_int( properties, "decode_ahead" ) : ( self->seekable ? DECODE_AHEAD_DEFAULT : 0 );
+			int cache_size = mlt_properties_get_int( properties, "image_cache_size" );
+			if ( cache_size <= 0 )
+				cache_size = 10 + decode_ahead;
+			else if ( cache_size < decode_ahead + 2 )
+				cache_size = decode_ahead + 2;
+			mlt_cache_set_size( cache, cache_size );
+			self->image_cache = cache;
+
+			// Start the decode ahead thread
+			if ( decode_ahead > 0 && !self->ahead_running )
+			{
+				pthread_mutex_init( &self->ahead_mutex, NULL );
+				pthread_cond_init( &self->ahead_cond, NULL );
+				self->ahead_count = decode_ahead;
+				self->ahead_request = POSITION_INVALID;
+				self->ahead_position = POSITION_INVALID;
+				self->ahead_running = 1;
+				if ( pthread_create( &self->ahead_thread, NULL, decode_ahead_thread, self ) )
+				{
+					// Decode on request only
+					self->ahead_running = 0;
+					pthread_cond_destroy( &self->ahead_cond );
+					pthread_mutex_destroy( &self->ahead_mutex );
+				}
+			}
+		}
+		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+	}
+
+	// The cache has its own lock, so a hit does not wait for the decoder
 	if ( self->image_cache )
 	{
 		mlt_cache_item item = mlt_cache_get( self->image_cache, (void*) position );
@@ -1093,25 +1447,19 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				*height = 1080;
 
 			// Cache hit
+			// Share the cached image, mlt_frame_get_image copies it if it is to be written
 			int size = mlt_image_format_size( *format, *width, *height, NULL );
-			if ( writable )
-			{
-				*buffer = mlt_pool_alloc( size );
-				mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
-				memcpy( *buffer, original, size );
-				mlt_cache_item_close( item );
-			}
-			else
-			{
-				*buffer = original;
-				mlt_properties_set_data( frame_properties, "avformat.image_cache", item, 0, ( mlt_destructor )mlt_cache_item_close, NULL );
-				mlt_frame_set_image( frame, *buffer, size, NULL );
-			}
-			self->got_picture = 1;
+			*buffer = original;
+			mlt_frame_set_image_shared( frame, *buffer, size );
+			mlt_cache_item_close( item );
+			got_image = 1;
 
 			goto exit_get_image;
 		}
 	}
+
+	pthread_mutex_lock( &self->video_mutex );
+
 	// Cache miss
 	int image_size = 0;
 
@@ -1142,11 +1490,35 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	int last_position = self->last_position;
 
+	// Accept a keyframe before the position rather than decoding up to it
+	int seek_keyframe = mlt_properties_get_int( properties, "seek_keyframe" );
+
 	// Turn on usage of new seek API and PTS for seeking
 	int use_new_seek = codec_context->codec_id == CODEC_ID_H264 && !strcmp( context->iformat->name, "mpegts" );
 	if ( mlt_properties_get( properties, "new_seek" ) )
 		use_new_seek = mlt_properties_get_int( properties, "new_seek" );
 
+	// Load or build the keyframe index - positions are then always taken from the PTS
+	if ( !self->keyframe_index && self->seekable && mlt_properties_get_int( properties, "keyframe_index" ) )
+	{
+		self->keyframe_index = 1;
+		self->keyframes_until = -1;
+		self->keyframes_contiguous = last_position == POSITION_INITIAL;
+		if ( !keyframe_index_load( self ) && mlt_properties_get_int( properties, "keyframe_index" ) > 1 )
+		{
+			keyframe_index_scan( self, context, stream, source_fps );
+			avcodec_flush_buffers( codec_context );
+			self->last_position = last_position = POSITION_INVALID;
+		}
+	}
+	if ( self->keyframe_index && self->invalid_pts_counter <= 20 )
+		use_new_seek = 1;
+
+	// The keyframe at or before the requested position if the index covers it
+	int keyframe = -1;
+	if ( self->keyframe_index && req_position <= self->keyframes_until )
+		keyframe = keyframe_find( self, req_position );
+
 	// Seek if necessary
 	if ( position != self->video_expected || last_position < 0 )
 	{
@@ -1161,8 +1533,28 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 			ignore = ( int )( ( position - self->video_expected ) / fps * source_fps );
 			codec_context->skip_loop_filter = AVDISCARD_NONREF;
 		}
+		else if ( self->seekable && keyframe >= 0 )
+		{
+			// Only seek if there is a keyframe between where we are and where we want to be
+			if ( req_position <= self->current_position || self->keyframes[ keyframe ].position > self->current_position
+				|| last_position < 0 )
+			{
+				mlt_log_debug( MLT_PRODUCER_SERVICE(producer), "seeking keyframe %d dts %"PRId64" position %d\n",
+					self->keyframes[ keyframe ].position, self->keyframes[ keyframe ].dts, req_position );
+				codec_context->skip_loop_filter = AVDISCARD_NONREF;
+				av_seek_frame( context, self->video_index, self->keyframes[ keyframe ].dts, AVSEEK_FLAG_BACKWARD );
+				avcodec_flush_buffers( codec_context );
+				self->current_position = POSITION_INVALID;
+				self->last_position = POSITION_INVALID;
+				av_freep( &self->av_frame );
+				self->keyframes_contiguous = 1;
+			}
+		}
 		else if ( self->seekable && ( position < self->video_expected || position - self->video_expected >= 12 || last_position < 0 ) )
 		{
+			// We can not extend the keyframe index from wherever this lands
+			self->keyframes_contiguous = req_position == 0;
+
 			if ( use_new_seek && last_position == POSITION_INITIAL )
 			{
 				// find first key frame
@@ -1291,14 +1683,33 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 		while( ret >= 0 && !got_picture )
 		{
+			int flush = 0;
+
 			// Read a packet
 			ret = av_read_frame( context, &pkt );
 
+			// At the end of the file an empty packet drains the frames the decoder
+			// (or its frame threads) still holds instead of repeating the last one
+			if ( ret < 0 && ( ( codec_context->codec->capabilities & CODEC_CAP_DELAY ) || codec_context->thread_count > 1 ) )
+			{
+				av_init_packet( &pkt );
+				pkt.data = NULL;
+				pkt.size = 0;
+				pkt.stream_index = self->video_index;
+				flush = 1;
+				ret = 0;
+			}
+
 			// We only deal with video from the selected video_index
-			if ( ret >= 0 && pkt.stream_index == self->video_index && pkt.size > 0 )
+			if ( ret >= 0 && pkt.stream_index == self->video_index && ( pkt.size > 0 || flush ) )
 			{
 				// Determine time code of the packet
-				if ( use_new_seek )
+				if ( flush )
+				{
+					// The position comes with the picture or is the requested one
+					int_position = req_position;
+				}
+				else if ( use_new_seek )
 				{
 					int64_t pts = pkt.pts;
 					if ( self->first_pts > 0 )
@@ -1350,6 +1761,18 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 				}
 				self->last_position = int_position;
 
+				// Extend the keyframe index while reading
+				if ( self->keyframe_index && self->keyframes_contiguous && use_new_seek && pkt.pts != AV_NOPTS_VALUE )
+				{
+					if ( pkt.flags & PKT_FLAG_KEY )
+						keyframe_add( self, int_position, pkt.dts != AV_NOPTS_VALUE ? pkt.dts : pkt.pts );
+					if ( int_position > self->keyframes_until )
+					{
+						self->keyframes_until = int_position;
+						self->keyframes_dirty = 1;
+					}
+				}
+
 				// Decode the image
 				if ( must_decode || int_position >= req_position )
 				{
@@ -1383,6 +1806,10 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 					{
 						decode_errors = 0;
 					}
+
+					// Nothing left in the decoder
+					if ( flush && !got_picture )
+						ret = -1;
 				}
 
 				if ( got_picture )
@@ -1399,7 +1826,11 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 						mlt_log_debug( MLT_PRODUCER_SERVICE(producer), "got frame %d, key %d\n", int_position, self->av_frame->key_frame );
 					}
 					// Handle ignore
-					if ( int_position < req_position )
+					if ( int_position < req_position && seek_keyframe && self->av_frame->key_frame )
+					{
+						ignore = 0;
+					}
+					else if ( int_position < req_position )
 					{
 						ignore = 0;
 						got_picture = 0;
@@ -1482,10 +1913,11 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	if ( self->got_picture && image_size > 0 && self->image_cache )
 	{
-		// Copy buffer to image cache	
-		uint8_t *image = mlt_pool_alloc( image_size );
-		memcpy( image, *buffer, image_size );
-		mlt_cache_put( self->image_cache, (void*) position, image, *format, mlt_pool_release );
+		// Share the buffer with the image cache
+		mlt_cache_put( self->image_cache, (void*) position, mlt_pool_retain( *buffer ), *format, mlt_pool_release );
+		mlt_frame_set_image_shared( frame, *buffer, image_size );
+		// The frame already held a reference from allocate_buffer()
+		mlt_pool_release( *buffer );
 	}
 	// Try to duplicate last image if there was a decoding failure
 	else if ( !image_size && self->av_frame && self->av_frame->linesize[0] )
@@ -1521,10 +1953,28 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 
 	// Regardless of speed, we expect to get the next frame (cos we ain't too bright)
 	self->video_expected = position + 1;
+	got_image = self->got_picture;
+
+	pthread_mutex_unlock( &self->video_mutex );
 
 exit_get_image:
 
-	pthread_mutex_unlock( &self->video_mutex );
+	// Tell the decode ahead thread where we are unless playing in reverse
+	if ( self->ahead_running && !is_ahead && mlt_properties_get_double( frame_properties, "_speed" ) >= 0 )
+	{
+		pthread_mutex_lock( &self->ahead_mutex );
+		if ( position < self->ahead_request || position >= self->ahead_position )
+			self->ahead_position = position + 1;
+		self->ahead_request = position;
+		self->ahead_limit = mlt_producer_get_length( producer ) - 1;
+		self->ahead_format = requested_format;
+		pthread_cond_signal( &self->ahead_cond );
+		pthread_mutex_unlock( &self->ahead_mutex );
+	}
+
+	// Nothing more to do for a frame decoded ahead - it is only wanted in the cache
+	if ( is_ahead )
+		return !got_image;
 
 	// Set the progressive flag
 	if ( mlt_properties_get( properties, "force_progressive" ) )
@@ -1544,7 +1994,62 @@ exit_get_image:
 	mlt_properties_set_int( properties, "meta.media.progressive", mlt_properties_get_int( frame_properties, "progressive" ) );
 	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 
-	return !self->got_picture;
+	return !got_image;
+}
+
+/** Keep the image cache filled with the frames following the last requested one.
+ *
+ * Images are decoded through producer_get_image with a private frame so that
+ * forward playback finds them in the image cache rather than waiting on the decoder.
+*/
+
+static void *decode_ahead_thread( void *arg )
+{
+	producer_avformat self = arg;
+	mlt_producer producer = self->parent;
+
+	pthread_mutex_lock( &self->ahead_mutex );
+	while ( self->ahead_running )
+	{
+		mlt_position position = self->ahead_position;
+
+		// Wait until we are needed
+		if ( self->ahead_request < 0 || position > self->ahead_request + self->ahead_count || position > self->ahead_limit )
+		{
+			pthread_cond_wait( &self->ahead_cond, &self->ahead_mutex );
+			continue;
+		}
+		self->ahead_position ++;
+		mlt_image_format format = self->ahead_format;
+		pthread_mutex_unlock( &self->ahead_mutex );
+
+		mlt_cache_item item = mlt_cache_get( self->image_cache, (void*) position );
+		if ( item )
+		{
+			// Already decoded
+			mlt_cache_item_close( item );
+		}
+		else if ( self->video_format && self->video_codec && self->video_index > -1 )
+		{
+			mlt_frame frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+			if ( frame )
+			{
+				uint8_t *buffer = NULL;
+				int width = 0;
+				int height = 0;
+
+				mlt_properties_set_position( MLT_FRAME_PROPERTIES( frame ), "avformat_position", position );
+				mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "avformat.decode_ahead", 1 );
+				mlt_frame_push_service( frame, self );
+				producer_get_image( frame, &buffer, &format, &width, &height, 0 );
+				mlt_frame_close( frame );
+			}
+		}
+		pthread_mutex_lock( &self->ahead_mutex );
+	}
+	pthread_mutex_unlock( &self->ahead_mutex );
+
+	return NULL;
 }
 
 /** Process properties as AVOptions and apply to AV context obj
@@ -1609,12 +2114,47 @@ static int video_codec_init( producer_avformat self, int index, mlt_properties p
 		int thread_count = mlt_properties_get_int( properties, "threads" );
 		if ( thread_count == 0 && getenv( "MLT_AVFORMAT_THREADS" ) )
 			thread_count = atoi( getenv( "MLT_AVFORMAT_THREADS" ) );
+#ifdef FF_THREAD_FRAME
+		// By default use a thread per processor where the decoder can thread frames
+		if ( thread_count == 0 && !mlt_properties_get( properties, "threads" ) )
+			thread_count = FFMIN( FFMAX( sysconf( _SC_NPROCESSORS_ONLN ), 1 ), 16 );
+#endif
+#ifdef VDPAU
+		if ( self->vdpau )
+			thread_count = 1;
+#endif
 		if ( thread_count > 1 )
+		{
 			codec_context->thread_count = thread_count;
+#ifdef FF_THREAD_FRAME
+			// Use both frame and slice threading where the decoder supports it
+			codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+			if ( mlt_properties_get( properties, "thread_type" ) )
+			{
+				if ( !strcmp( mlt_properties_get( properties, "thread_type" ), "frame" ) )
+					codec_context->thread_type = FF_THREAD_FRAME;
+				else if ( !strcmp( mlt_properties_get( properties, "thread_type" ), "slice" ) )
+					codec_context->thread_type = FF_THREAD_SLICE;
+			}
+#endif
+		}
+
+		// Decode at a reduced resolution - this must be set before opening the codec
+		if ( codec && mlt_properties_get_int( properties, "lowres" ) > 0 )
+			codec_context->lowres = FFMIN( mlt_properties_get_int( properties, "lowres" ), codec->max_lowres );
 
 		// If we don't have a codec and we can't initialise it, we can't do much more...
 		avformat_lock( );
-		if ( codec && avcodec_open( codec_context, codec ) >= 0 )
+		int error = codec ? avcodec_open( codec_context, codec ) : -1;
+		if ( error < 0 && codec && codec_context->thread_count > 1 )
+		{
+			// Fall back to a single thread for a decoder that fails to open threaded
+			mlt_log_warning( MLT_PRODUCER_SERVICE( self->parent ), "failed to open the video decoder with %d threads, using one\n",
+				codec_context->thread_count );
+			codec_context->thread_count = 1;
+			error = avcodec_open( codec_context, codec );
+		}
+		if ( error >= 0 )
 		{
 			// Now store the codec with its destructor
 			self->video_codec = codec_context;
@@ -1730,10 +2270,14 @@ static int video_codec_init( producer_avformat self, int index, mlt_properties p
 	return self->video_codec && self->video_index > -1;
 }
 
-/** Set up video handling.
+/** Open the video context and codec on demand.
+
+    This is deferred from get_frame to get_image so that a consumer with
+    video_off, an audio export or a loudness scan say, neither reopens the
+    video context nor sets up the decoder of any clip.
 */
 
-static void producer_set_up_video( producer_avformat self, mlt_frame frame )
+static int video_open( producer_avformat self )
 {
 	// Get the producer
 	mlt_producer producer = self->parent;
@@ -1741,12 +2285,18 @@ static void producer_set_up_video( producer_avformat self, mlt_frame frame )
 	// Get the properties
 	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
 
-	// Fetch the video format context
-	AVFormatContext *context = self->video_format;
-
 	// Get the video_index
 	int index = mlt_properties_get_int( properties, "video_index" );
 
+	// Nothing to do when it is already set up
+	if ( self->video_format && self->video_codec && index == self->video_index )
+		return 1;
+
+	mlt_service_lock( MLT_PRODUCER_SERVICE( producer ) );
+
+	// Fetch the video format context
+	AVFormatContext *context = self->video_format;
+
 	// Reopen the file if necessary
 	if ( !context && index > -1 )
 	{
@@ -1804,30 +2354,67 @@ static void producer_set_up_video( producer_avformat self, mlt_frame frame )
 		self->video_codec = NULL;
 	}
 
+	// Get the codec
+	int result = context && index > -1 && video_codec_init( self, index, properties );
+
+	mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
+
+	return result;
+}
+
+/** Set up video handling.
+
+    The frame gets the dimensions found when the producer was opened, while
+    the context and codec are only needed once an image is requested.
+*/
+
+static void producer_set_up_video( producer_avformat self, mlt_frame frame )
+{
+	// Get the producer
+	mlt_producer producer = self->parent;
+
+	// Get the properties
+	mlt_properties properties = MLT_PRODUCER_PROPERTIES( producer );
+
 	// Get the frame properties
 	mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
 
-	// Get the codec
-	if ( context && index > -1 && video_codec_init( self, index, properties ) )
+	// Get the video_index
+	int index = mlt_properties_get_int( properties, "video_index" );
+
+	// Without validation the file was not opened yet to learn its dimensions
+	if ( index > -1 && !mlt_properties_get_int( properties, "width" ) )
+	{
+		video_open( self );
+		index = mlt_properties_get_int( properties, "video_index" );
+	}
+
+	// A video_index of -1 after opening means there is no usable video stream
+	if ( index > -1 && self->video_index > -1 )
 	{
+		// The decoder may scale the stream, with lowres say, once it is open
+		int width = self->video_codec ? self->video_codec->width : mlt_properties_get_int( properties, "width" );
+		int height = self->video_codec ? self->video_codec->height : mlt_properties_get_int( properties, "height" );
+
 		// Set the frame properties
 		double force_aspect_ratio = mlt_properties_get_double( properties, "force_aspect_ratio" );
 		double aspect_ratio = ( force_aspect_ratio > 0.0 ) ?
 			force_aspect_ratio : mlt_properties_get_double( properties, "aspect_ratio" );
 
 		// Set the width and height
-		mlt_properties_set_int( frame_properties, "width", self->video_codec->width );
-		mlt_properties_set_int( frame_properties, "height", self->video_codec->height );
+		mlt_properties_set_int( frame_properties, "width", width );
+		mlt_properties_set_int( frame_properties, "height", height );
 		// real_width and real_height are deprecated in favor of meta.media.width and .height
-		mlt_properties_set_int( properties, "meta.media.width", self->video_codec->width );
-		mlt_properties_set_int( properties, "meta.media.height", self->video_codec->height );
-		mlt_properties_set_int( frame_properties, "real_width", self->video_codec->width );
-		mlt_properties_set_int( frame_properties, "real_height", self->video_codec->height );
+		mlt_properties_set_int( properties, "meta.media.width", width );
+		mlt_properties_set_int( properties, "meta.media.height", height );
+		mlt_properties_set_int( frame_properties, "real_width", width );
+		mlt_properties_set_int( frame_properties, "real_height", height );
 		mlt_properties_set_double( frame_properties, "aspect_ratio", aspect_ratio );
-		mlt_properties_set_int( frame_properties, "colorspace", self->colorspace );
+		if ( self->video_codec )
+			mlt_properties_set_int( frame_properties, "colorspace", self->colorspace );
 
 		// Workaround 1088 encodings missing cropping info.
-		if ( self->video_codec->height == 1088 && mlt_profile_dar( mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) ) ) == 16.0/9.0 )
+		if ( height == 1088 && mlt_profile_dar( mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) ) ) == 16.0/9.0 )
 		{
 			mlt_properties_set_int( properties, "meta.media.height", 1080 );
 			mlt_properties_set_int( frame_properties, "real_height", 1080 );
@@ -2427,6 +3014,24 @@ static int producer_get_frame( mlt_producer producer, mlt_frame_ptr frame, int i
 static void producer_avformat_close( producer_avformat self )
 {
 	mlt_log_debug( NULL, "producer_avformat_close\n" );
+
+	// Stop the decode ahead thread
+	if ( self->ahead_running )
+	{
+		pthread_mutex_lock( &self->ahead_mutex );
+		self->ahead_running = 0;
+		pthread_cond_signal( &self->ahead_cond );
+		pthread_mutex_unlock( &self->ahead_mutex );
+		pthread_join( self->ahead_thread, NULL );
+		pthread_mutex_destroy( &self->ahead_mutex );
+		pthread_cond_destroy( &self->ahead_cond );
+	}
+
+	// Keep the keyframe index for next time
+	if ( self->keyframes_dirty )
+		keyframe_index_save( self );
+	free( self->keyframes );
+
 	// Close the file
 	av_free( self->av_frame );
 	avformat_lock();
@@ -0,0 +1,281 @@
+/*
+ * consumer_filmstrip.c -- render thumbnails of many positions into one image
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "consumer_source.h"
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The filmstrip being rendered.
+*/
+
+typedef struct
+{
+	consumer_source source;
+	mlt_position *positions;
+	int count;
+	int shown;
+	int width;
+	int height;
+	int columns;
+	uint8_t *sprite;
+	int stride;
+	int errors;
+}
+filmstrip_job;
+
+static int consumer_start( mlt_consumer self );
+static int consumer_is_stopped( mlt_consumer self );
+
+mlt_consumer consumer_filmstrip_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_consumer self = mlt_consumer_new( profile );
+
+	if ( self != NULL )
+	{
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+
+		self->start = consumer_start;
+		self->is_stopped = consumer_is_stopped;
+
+		mlt_properties_set( properties, "resource", arg );
+		mlt_properties_set_int( properties, "count", 10 );
+		mlt_properties_set_int( properties, "width", 160 );
+		mlt_properties_set_int( properties, "height", 90 );
+		mlt_properties_set_int( properties, "lowres", -1 );
+	}
+
+	return self;
+}
+
+/** Parse the positions to render or spread them evenly over the producer.
+*/
+
+static mlt_position *get_positions( mlt_properties properties, mlt_producer producer, int *count )
+{
+	char *list = mlt_properties_get( properties, "positions" );
+	mlt_position *positions = NULL;
+	int i;
+
+	*count = 0;
+	if ( list != NULL )
+	{
+		mlt_tokeniser tokeniser = mlt_tokeniser_init( );
+		int n = mlt_tokeniser_parse_new( tokeniser, list, "," );
+		positions = calloc( n > 0 ? n : 1, sizeof( mlt_position ) );
+		for ( i = 0; positions && i < n; i ++ )
+			positions[ ( *count ) ++ ] = atoi( mlt_tokeniser_get_string( tokeniser, i ) );
+		mlt_tokeniser_close( tokeniser );
+	}
+	else
+	{
+		int n = mlt_properties_get_int( properties, "count" );
+		int playtime = mlt_producer_get_playtime( producer );
+		if ( n > 0 && playtime > 0 )
+		{
+			positions = calloc( n, sizeof( mlt_position ) );
+			for ( i = 0; positions && i < n; i ++ )
+				positions[ ( *count ) ++ ] = n > 1 ? ( int64_t )i * ( playtime - 1 ) / ( n - 1 ) : 0;
+		}
+	}
+
+	return positions;
+}
+
+/** Set a property of the producer for the render unless the application set it.
+
+	The previous value, or NULL, is kept for restore_property.
+*/
+
+static void override_property( mlt_properties properties, const char *name, int value, char **previous )
+{
+	char *current = mlt_properties_get( properties, name );
+	*previous = current ? strdup( current ) : NULL;
+	if ( current == NULL )
+		mlt_properties_set_int( properties, name, value );
+}
+
+static void restore_property( mlt_properties properties, const char *name, char *previous )
+{
+	mlt_properties_set( properties, name, previous );
+	free( previous );
+}
+
+/** Copy an image into its place in the sprite, scaling it if the producer did not.
+*/
+
+static void place_image( filmstrip_job *job, int index, uint8_t *image, int width, int height )
+{
+	uint8_t *dest = job->sprite + ( index / job->columns ) * job->height * job->stride + ( index % job->columns ) * job->width * 3;
+	int x, y;
+
+	if ( width == job->width && height == job->height )
+	{
+		for ( y = 0; y < height; y ++ )
+			memcpy( dest + y * job->stride, image + y * width * 3, width * 3 );
+	}
+	else if ( width > 0 && height > 0 )
+	{
+		for ( y = 0; y < job->height; y ++ )
+		{
+			uint8_t *p = dest + y * job->stride;
+			uint8_t *line = image + ( y * height / job->height ) * width * 3;
+			for ( x = 0; x < job->width; x ++ )
+			{
+				uint8_t *q = line + ( x * width / job->width ) * 3;
+				*p ++ = q[ 0 ];
+				*p ++ = q[ 1 ];
+				*p ++ = q[ 2 ];
+			}
+		}
+	}
+}
+
+/** Receive the thumbnails from mlt_producer_render_list in the order of the positions.
+*/
+
+static int filmstrip_frame( void *data, mlt_position position, mlt_frame frame, uint8_t *image, int width, int height )
+{
+	filmstrip_job *job = data;
+	if ( image != NULL && mlt_properties_get_int( MLT_FRAME_PROPERTIES( frame ), "format" ) == mlt_image_rgb24 )
+		place_image( job, job->shown, image, width, height );
+	else
+		job->errors ++;
+	job->shown ++;
+	return 0;
+}
+
+static int write_ppm( const char *filename, uint8_t *image, int width, int height )
+{
+	FILE *file = fopen( filename, "wb" );
+	int error = file == NULL;
+
+	if ( file != NULL )
+	{
+		error = fprintf( file, "P6\n%d %d\n255\n", width, height ) < 0 ||
+			fwrite( image, width * 3, height, file ) != height;
+		error = fclose( file ) || error;
+	}
+
+	return error;
+}
+
+/** Render the thumbnails from the producer with its filters and properties.
+
+	The producer is asked to decode at a reduced resolution (see the avformat
+	lowres property) and optionally to show the keyframe before each position
+	(seek_keyframe) unless the application set those, and restored afterwards.
+*/
+
+static int render_filmstrip( filmstrip_job *job )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( job->source.consumer );
+	mlt_properties producer_properties = MLT_PRODUCER_PROPERTIES( job->source.producer );
+	mlt_properties frame_properties = consumer_source_properties( &job->source );
+	int lowres = mlt_properties_get_int( properties, "lowres" );
+	int threads = consumer_source_threads( &job->source, job->count );
+	char *lowres_previous = NULL;
+	char *keyframe_previous = NULL;
+	int error;
+
+	// Pick the largest reduction of the decoded picture that still covers a thumbnail;
+	// meta.media.* is only filled in once frames are fetched, so use the size set on open
+	if ( lowres < 0 )
+	{
+		int width = mlt_properties_get_int( producer_properties, "width" );
+		int height = mlt_properties_get_int( producer_properties, "height" );
+		lowres = 0;
+		while ( lowres < 3 && width >> ( lowres + 1 ) >= job->width && height >> ( lowres + 1 ) >= job->height )
+			lowres ++;
+	}
+	if ( lowres > 0 )
+		override_property( producer_properties, "lowres", lowres, &lowres_previous );
+	if ( mlt_properties_get_int( properties, "keyframes" ) )
+		override_property( producer_properties, "seek_keyframe", 1, &keyframe_previous );
+
+	error = mlt_producer_render_list( job->source.producer, job->positions, job->count, mlt_image_rgb24,
+		job->width, job->height, frame_properties, threads, filmstrip_frame, job );
+
+	if ( lowres > 0 )
+		restore_property( producer_properties, "lowres", lowres_previous );
+	if ( mlt_properties_get_int( properties, "keyframes" ) )
+		restore_property( producer_properties, "seek_keyframe", keyframe_previous );
+	mlt_properties_close( frame_properties );
+
+	return error;
+}
+
+static int consumer_start( mlt_consumer self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	filmstrip_job job;
+
+	memset( &job, 0, sizeof( job ) );
+	consumer_source_init( &job.source, self );
+	job.width = mlt_properties_get_int( properties, "width" );
+	job.height = mlt_properties_get_int( properties, "height" );
+	job.columns = mlt_properties_get_int( properties, "columns" );
+
+	if ( job.source.producer != NULL )
+		job.positions = get_positions( properties, job.source.producer, &job.count );
+
+	if ( job.count > 0 && job.width > 0 && job.height > 0 )
+	{
+		int rows;
+
+		if ( job.columns <= 0 || job.columns > job.count )
+			job.columns = job.count;
+		rows = ( job.count + job.columns - 1 ) / job.columns;
+		job.stride = job.columns * job.width * 3;
+		job.sprite = calloc( rows * job.height, job.stride );
+
+		if ( job.sprite != NULL )
+		{
+			char *resource = mlt_properties_get( properties, "resource" );
+
+			if ( render_filmstrip( &job ) || job.errors > 0 )
+				mlt_log_warning( MLT_CONSUMER_SERVICE( self ), "%d of %d thumbnails failed\n", job.count - job.shown + job.errors, job.count );
+			if ( resource != NULL && strcmp( resource, "" ) && write_ppm( resource, job.sprite, job.columns * job.width, rows * job.height ) )
+				mlt_log_error( MLT_CONSUMER_SERVICE( self ), "failed to write %s\n", resource );
+
+			mlt_properties_set_int( properties, "sprite_width", job.columns * job.width );
+			mlt_properties_set_int( properties, "sprite_height", rows * job.height );
+			mlt_properties_set_data( properties, "sprite", job.sprite, job.stride * rows * job.height, free, NULL );
+		}
+	}
+	else
+	{
+		mlt_log_error( MLT_CONSUMER_SERVICE( self ), "nothing to render\n" );
+	}
+
+	free( job.positions );
+	consumer_source_close( &job.source );
+
+	mlt_consumer_stop( self );
+	mlt_consumer_stopped( self );
+
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer self )
+{
+	return 1;
+}
@@ -0,0 +1,759 @@
+/*
+ * consumer_peaks.c -- a multi-resolution index of the audio levels of a producer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "consumer_source.h"
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PEAKS_MAGIC "MLTPEAKS"
+#define PEAKS_VERSION 2
+#define PEAKS_HEADER 36
+#define PEAKS_ENTRY 8
+#define PEAKS_BLOCK 256
+#define PEAKS_CHUNK 250
+#define PEAKS_MAX_LEVELS 48
+
+/** The summary of a block of samples of one channel.
+*/
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+	float power;
+}
+peaks_entry;
+
+/** The levels of the index, each summarising blocks twice as long as the one before.
+
+	Level 0 summarises PEAKS_BLOCK samples per entry and the last level has a single
+	entry for the whole producer. The entries of a level are stored block by block
+	with one entry per channel.
+*/
+
+typedef struct
+{
+	int frequency;
+	int channels;
+	int64_t samples;
+	int levels;
+	int64_t count[ PEAKS_MAX_LEVELS ];
+	int64_t offset[ PEAKS_MAX_LEVELS ];
+	int64_t size;
+	peaks_entry *entries;
+}
+peaks_index;
+
+/** The work shared by the threads scanning a producer.
+*/
+
+typedef struct
+{
+	consumer_source source;
+	peaks_index *index;
+	double *sums;
+	double fps;
+	int length;
+	int chunk;
+	int chunks;
+	int next;
+	int threads;
+	int errors;
+	pthread_mutex_t mutex;
+}
+peaks_job;
+
+static int consumer_start( mlt_consumer self );
+static int consumer_is_stopped( mlt_consumer self );
+
+mlt_consumer consumer_peaks_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	mlt_consumer self = mlt_consumer_new( profile );
+
+	if ( self != NULL )
+	{
+		self->start = consumer_start;
+		self->is_stopped = consumer_is_stopped;
+
+		mlt_properties_set( MLT_CONSUMER_PROPERTIES( self ), "resource", arg );
+	}
+
+	return self;
+}
+
+static void peaks_index_close( void *arg )
+{
+	peaks_index *index = arg;
+	if ( index != NULL )
+		free( index->entries );
+	free( index );
+}
+
+static peaks_index *peaks_index_new( int frequency, int channels, int64_t samples )
+{
+	peaks_index *index = calloc( 1, sizeof( peaks_index ) );
+
+	if ( index != NULL )
+	{
+		int64_t count = samples > 0 ? ( samples + PEAKS_BLOCK - 1 ) / PEAKS_BLOCK : 1;
+		int64_t i;
+
+		index->frequency = frequency;
+		index->channels = channels;
+		index->samples = samples;
+		while ( index->levels < PEAKS_MAX_LEVELS )
+		{
+			index->count[ index->levels ] = count;
+			index->offset[ index->levels ] = index->size;
+			index->size += count * channels;
+			index->levels ++;
+			if ( count == 1 )
+				break;
+			count = ( count + 1 ) / 2;
+		}
+		index->entries = malloc( index->size * sizeof( peaks_entry ) );
+		if ( index->entries == NULL )
+		{
+			free( index );
+			return NULL;
+		}
+		for ( i = 0; i < index->size; i ++ )
+		{
+			index->entries[ i ].min = INT16_MAX;
+			index->entries[ i ].max = INT16_MIN;
+			index->entries[ i ].power = 0;
+		}
+	}
+
+	return index;
+}
+
+/** The number of samples summarised by an entry of a level.
+*/
+
+static int64_t block_length( peaks_index *index, int level, int64_t block )
+{
+	int64_t size = ( int64_t )PEAKS_BLOCK << level;
+	int64_t length = index->samples - block * size;
+	return length < size ? ( length > 0 ? length : 0 ) : size;
+}
+
+/** Turn the sums of squares of level 0 into powers and derive the other levels from it.
+*/
+
+static void peaks_index_finish( peaks_index *index, double *sums )
+{
+	int channels = index->channels;
+	int64_t i;
+	int level, c;
+
+	for ( i = 0; i < index->count[ 0 ]; i ++ )
+	{
+		int64_t length = block_length( index, 0, i );
+		for ( c = 0; c < channels; c ++ )
+		{
+			peaks_entry *entry = &index->entries[ i * channels + c ];
+			if ( entry->min > entry->max )
+				entry->min = entry->max = 0;
+			entry->power = length > 0 ? sums[ i * channels + c ] / length / ( 32768.0 * 32768.0 ) : 0;
+		}
+	}
+
+	for ( level = 1; level < index->levels; level ++ )
+	{
+		peaks_entry *below = index->entries + index->offset[ level - 1 ];
+		peaks_entry *entries = index->entries + index->offset[ level ];
+		for ( i = 0; i < index->count[ level ]; i ++ )
+		{
+			int64_t first = 2 * i;
+			int64_t second = first + 1 < index->count[ level - 1 ] ? first + 1 : first;
+			int64_t length0 = block_length( index, level - 1, first );
+			int64_t length1 = second != first ? block_length( index, level - 1, second ) : 0;
+			for ( c = 0; c < channels; c ++ )
+			{
+				peaks_entry *a = &below[ first * channels + c ];
+				peaks_entry *b = &below[ second * channels + c ];
+				peaks_entry *entry = &entries[ i * channels + c ];
+				entry->min = a->min < b->min ? a->min : b->min;
+				entry->max = a->max > b->max ? a->max : b->max;
+				entry->power = length0 + length1 > 0 ? ( a->power * length0 + b->power * length1 ) / ( length0 + length1 ) : 0;
+			}
+		}
+	}
+}
+
+/** Summarise a range of samples as a number of pixels.
+
+	Each pixel is answered from the coarsest level whose blocks are no longer than
+	the samples of the pixel, so it takes at most a few entries whatever the zoom.
+	The result holds the minimum, maximum and RMS level of each channel of each
+	pixel, normalised to -1.0 to 1.0.
+*/
+
+static void peaks_index_query( peaks_index *index, int64_t start, int64_t end, int pixels, float *result )
+{
+	int channels = index->channels;
+	int64_t per_pixel = ( end - start ) / pixels;
+	int level = 0;
+	int64_t size;
+	int x, c;
+
+	while ( level + 1 < index->levels && ( ( int64_t )PEAKS_BLOCK << ( level + 1 ) ) <= per_pixel )
+		level ++;
+	size = ( int64_t )PEAKS_BLOCK << level;
+
+	for ( x = 0; x < pixels; x ++ )
+	{
+		int64_t a = start + ( end - start ) * x / pixels;
+		int64_t b = start + ( end - start ) * ( x + 1 ) / pixels;
+		int64_t first = a / size;
+		int64_t last = ( b > a ? b - 1 : a ) / size;
+		float *out = result + x * channels * 3;
+
+		if ( a < 0 || a >= index->samples )
+		{
+			memset( out, 0, channels * 3 * sizeof( float ) );
+			continue;
+		}
+		if ( last >= index->count[ level ] )
+			last = index->count[ level ] - 1;
+
+		for ( c = 0; c < channels; c ++ )
+		{
+			peaks_entry *entries = index->entries + index->offset[ level ] + c;
+			int min = INT16_MAX;
+			int max = INT16_MIN;
+			double power = 0;
+			int64_t total = 0;
+			int64_t i;
+
+			for ( i = first; i <= last; i ++ )
+			{
+				peaks_entry *entry = &entries[ i * channels ];
+				int64_t length = block_length( index, level, i );
+				if ( entry->min < min )
+					min = entry->min;
+				if ( entry->max > max )
+					max = entry->max;
+				power += entry->power * length;
+				total += length;
+			}
+			out[ c * 3 ] = min / 32768.0;
+			out[ c * 3 + 1 ] = max / 32768.0;
+			out[ c * 3 + 2 ] = total > 0 ? sqrt( power / total ) : 0;
+		}
+	}
+}
+
+/** Read and write the fields of an index file, which are little endian whatever the machine.
+*/
+
+static uint64_t get_le( const uint8_t *p, int bytes )
+{
+	uint64_t value = 0;
+	while ( bytes -- )
+		value = ( value << 8 ) | p[ bytes ];
+	return value;
+}
+
+static void put_le( uint8_t *p, uint64_t value, int bytes )
+{
+	while ( bytes -- )
+	{
+		*p ++ = value & 0xff;
+		value >>= 8;
+	}
+}
+
+static uint32_t float_bits( float value )
+{
+	union { float f; uint32_t u; } bits;
+	bits.f = value;
+	return bits.u;
+}
+
+static float bits_float( uint32_t value )
+{
+	union { float f; uint32_t u; } bits;
+	bits.u = value;
+	return bits.f;
+}
+
+/** Load an index from a file if it was made of the same media with the same parameters.
+
+	The file starts with a header of PEAKS_HEADER bytes: the magic "MLTPEAKS", then
+	as little endian integers the version, sample rate, channels, block length and
+	the length of the key (32 bits each) followed by the samples per channel (64 bits).
+	The key follows and then the entries of all the levels, each a 16 bit minimum,
+	a 16 bit maximum and the power as a 32 bit IEEE float.
+*/
+
+static peaks_index *peaks_index_load( const char *filename, const char *key, int frequency, int channels, int64_t samples )
+{
+	FILE *file = fopen( filename, "rb" );
+	peaks_index *index = NULL;
+
+	if ( file != NULL )
+	{
+		uint8_t header[ PEAKS_HEADER ];
+		size_t key_length = strlen( key );
+		char *file_key = malloc( key_length + 1 );
+
+		if ( file_key != NULL && fread( header, 1, PEAKS_HEADER, file ) == PEAKS_HEADER
+			&& !memcmp( header, PEAKS_MAGIC, 8 ) && get_le( header + 8, 4 ) == PEAKS_VERSION
+			&& get_le( header + 12, 4 ) == frequency && get_le( header + 16, 4 ) == channels
+			&& get_le( header + 20, 4 ) == PEAKS_BLOCK && get_le( header + 24, 4 ) == key_length
+			&& ( int64_t )get_le( header + 28, 8 ) == samples
+			&& fread( file_key, 1, key_length, file ) == key_length && !memcmp( file_key, key, key_length ) )
+		{
+			index = peaks_index_new( frequency, channels, samples );
+			if ( index != NULL )
+			{
+				uint8_t entry[ PEAKS_ENTRY ];
+				int64_t i;
+
+				for ( i = 0; i < index->size; i ++ )
+				{
+					if ( fread( entry, 1, PEAKS_ENTRY, file ) != PEAKS_ENTRY )
+						break;
+					index->entries[ i ].min = ( int16_t )get_le( entry, 2 );
+					index->entries[ i ].max = ( int16_t )get_le( entry + 2, 2 );
+					index->entries[ i ].power = bits_float( get_le( entry + 4, 4 ) );
+				}
+				if ( i < index->size || fgetc( file ) != EOF )
+				{
+					peaks_index_close( index );
+					index = NULL;
+				}
+			}
+		}
+		free( file_key );
+		fclose( file );
+	}
+
+	return index;
+}
+
+/** Save an index, writing a new file and moving it into place so readers never see part of one.
+*/
+
+static int peaks_index_save( peaks_index *index, const char *filename, const char *key )
+{
+	char *temp = malloc( strlen( filename ) + 20 );
+	FILE *file = NULL;
+	int error = 1;
+
+	if ( temp != NULL )
+	{
+		sprintf( temp, "%s.%d", filename, ( int )getpid( ) );
+		file = fopen( temp, "wb" );
+	}
+	if ( file != NULL )
+	{
+		uint8_t header[ PEAKS_HEADER ];
+		uint8_t entry[ PEAKS_ENTRY ];
+		size_t key_length = strlen( key );
+		int64_t i;
+
+		memcpy( header, PEAKS_MAGIC, 8 );
+		put_le( header + 8, PEAKS_VERSION, 4 );
+		put_le( header + 12, index->frequency, 4 );
+		put_le( header + 16, index->channels, 4 );
+		put_le( header + 20, PEAKS_BLOCK, 4 );
+		put_le( header + 24, key_length, 4 );
+		put_le( header + 28, index->samples, 8 );
+		error = fwrite( header, 1, PEAKS_HEADER, file ) != PEAKS_HEADER || fwrite( key, 1, key_length, file ) != key_length;
+		for ( i = 0; !error && i < index->size; i ++ )
+		{
+			put_le( entry, ( uint16_t )index->entries[ i ].min, 2 );
+			put_le( entry + 2, ( uint16_t )index->entries[ i ].max, 2 );
+			put_le( entry + 4, float_bits( index->entries[ i ].power ), 4 );
+			error = fwrite( entry, 1, PEAKS_ENTRY, file ) != PEAKS_ENTRY;
+		}
+		error = fclose( file ) || error;
+		error = error || rename( temp, filename );
+		if ( error )
+			remove( temp );
+	}
+	free( temp );
+
+	return error;
+}
+
+/** Merge the summary of a block, or the part of it a thread has seen, into level 0.
+*/
+
+static void merge_block( peaks_job *job, int64_t block, int16_t *min, int16_t *max, double *sums, int shared )
+{
+	peaks_index *index = job->index;
+	peaks_entry *entries = index->entries + block * index->channels;
+	int c;
+
+	if ( shared )
+		pthread_mutex_lock( &job->mutex );
+	for ( c = 0; c < index->channels; c ++ )
+	{
+		if ( min[ c ] < entries[ c ].min )
+			entries[ c ].min = min[ c ];
+		if ( max[ c ] > entries[ c ].max )
+			entries[ c ].max = max[ c ];
+		job->sums[ block * index->channels + c ] += sums[ c ];
+		min[ c ] = INT16_MAX;
+		max[ c ] = INT16_MIN;
+		sums[ c ] = 0;
+	}
+	if ( shared )
+		pthread_mutex_unlock( &job->mutex );
+}
+
+/** The state of a thread scanning a chunk with mlt_producer_render_range.
+*/
+
+typedef struct
+{
+	peaks_job *job;
+	int16_t *min;
+	int16_t *max;
+	double *sums;
+	int64_t block;
+	int64_t chunk_start;
+	int64_t chunk_end;
+}
+peaks_scan;
+
+/** Summarise the audio of a frame, which mlt_producer_render_range gives in order.
+*/
+
+static int peaks_frame( void *data, mlt_position position, mlt_frame frame, uint8_t *image, int width, int height )
+{
+	peaks_scan *scan = data;
+	peaks_job *job = scan->job;
+	peaks_index *index = job->index;
+	int channels = index->channels;
+	int64_t start = mlt_sample_calculator_to_now( job->fps, index->frequency, position );
+	int expected = mlt_sample_calculator_to_now( job->fps, index->frequency, position + 1 ) - start;
+	mlt_audio_format format = mlt_audio_s16;
+	int frequency = index->frequency;
+	int frame_channels = channels;
+	int samples = expected;
+	int16_t *pcm = NULL;
+	int i, c;
+
+	if ( !mlt_frame_get_audio( frame, ( void** )&pcm, &format, &frequency, &frame_channels, &samples )
+		&& pcm != NULL && format == mlt_audio_s16 && frame_channels > 0 )
+	{
+		int used = frame_channels < channels ? frame_channels : channels;
+		if ( samples > expected )
+			samples = expected;
+		for ( i = 0; i < samples; i ++, pcm += frame_channels )
+		{
+			int64_t sample_block = ( start + i ) / PEAKS_BLOCK;
+			if ( sample_block != scan->block )
+			{
+				if ( scan->block >= 0 )
+					merge_block( job, scan->block, scan->min, scan->max, scan->sums, scan->block * PEAKS_BLOCK < scan->chunk_start );
+				scan->block = sample_block;
+			}
+			for ( c = 0; c < used; c ++ )
+			{
+				if ( pcm[ c ] < scan->min[ c ] )
+					scan->min[ c ] = pcm[ c ];
+				if ( pcm[ c ] > scan->max[ c ] )
+					scan->max[ c ] = pcm[ c ];
+				scan->sums[ c ] += ( double )pcm[ c ] * pcm[ c ];
+			}
+		}
+	}
+	else
+	{
+		pthread_mutex_lock( &job->mutex );
+		job->errors ++;
+		pthread_mutex_unlock( &job->mutex );
+	}
+
+	return 0;
+}
+
+/** Scan chunks of the producer until there are none left.
+
+	The chunks are contiguous ranges of frames, so a block of level 0 is summarised
+	by a single thread except where it straddles the boundary of a chunk, and only
+	those blocks are merged under the lock. Each thread scans a producer of its own
+	opened from the source property. Otherwise a single thread scans the whole of
+	the connected producer in order, as its filters may expect.
+*/
+
+static void *peaks_thread( void *arg )
+{
+	peaks_job *job = arg;
+	peaks_index *index = job->index;
+	mlt_producer own = job->threads > 1 ? consumer_source_open( &job->source ) : NULL;
+	mlt_producer producer = own ? own : job->source.producer;
+	int channels = index->channels;
+	peaks_scan scan;
+	int c;
+
+	scan.job = job;
+	scan.min = malloc( channels * sizeof( int16_t ) );
+	scan.max = malloc( channels * sizeof( int16_t ) );
+	scan.sums = malloc( channels * sizeof( double ) );
+	for ( c = 0; scan.min && scan.max && scan.sums && c < channels; c ++ )
+	{
+		scan.min[ c ] = INT16_MAX;
+		scan.max[ c ] = INT16_MIN;
+		scan.sums[ c ] = 0;
+	}
+
+	while ( producer != NULL && scan.min && scan.max && scan.sums )
+	{
+		int chunk, position, end;
+
+		pthread_mutex_lock( &job->mutex );
+		chunk = job->next ++;
+		pthread_mutex_unlock( &job->mutex );
+		if ( chunk >= job->chunks )
+			break;
+
+		position = chunk * job->chunk;
+		end = position + job->chunk < job->length ? position + job->chunk : job->length;
+		scan.block = -1;
+		scan.chunk_start = mlt_sample_calculator_to_now( job->fps, index->frequency, position );
+		scan.chunk_end = mlt_sample_calculator_to_now( job->fps, index->frequency, end );
+
+		if ( mlt_producer_render_range( producer, position, end - 1, mlt_image_none, 0, 0, NULL, 1, peaks_frame, &scan ) )
+		{
+			pthread_mutex_lock( &job->mutex );
+			job->errors ++;
+			pthread_mutex_unlock( &job->mutex );
+		}
+
+		if ( scan.block >= 0 )
+			merge_block( job, scan.block, scan.min, scan.max, scan.sums,
+				scan.block * PEAKS_BLOCK < scan.chunk_start || ( scan.block + 1 ) * PEAKS_BLOCK > scan.chunk_end );
+	}
+
+	free( scan.min );
+	free( scan.max );
+	free( scan.sums );
+	mlt_producer_close( own );
+
+	return NULL;
+}
+
+/** Hash a string, continuing from a previous hash.
+*/
+
+static unsigned int string_hash( const char *string, unsigned int hash )
+{
+	while ( *string )
+		hash = hash * 33 + ( unsigned char )*string ++;
+	return hash;
+}
+
+/** Hash the properties of a service and its filters that change what it renders.
+
+	Private properties and the meta.* properties a producer sets once it has
+	read the media are left out, as is the cut of the producer, which is part
+	of the key.
+*/
+
+static unsigned int properties_hash( mlt_properties properties, int cut, unsigned int hash )
+{
+	int i;
+
+	for ( i = 0; i < mlt_properties_count( properties ); i ++ )
+	{
+		char *name = mlt_properties_get_name( properties, i );
+		char *value = mlt_properties_get_value( properties, i );
+		if ( name == NULL || value == NULL || name[ 0 ] == '_' || !strncmp( name, "meta.", 5 ) || ( cut &&
+			( !strcmp( name, "in" ) || !strcmp( name, "out" ) || !strcmp( name, "length" ) || !strcmp( name, "eof" ) ) ) )
+			continue;
+		hash = string_hash( value, string_hash( name, hash ) );
+	}
+	return hash;
+}
+
+static unsigned int service_hash( mlt_service service )
+{
+	unsigned int hash = properties_hash( MLT_SERVICE_PROPERTIES( service ), 1, 5381 );
+	mlt_filter filter;
+	int i;
+
+	for ( i = 0; ( filter = mlt_service_filter( service, i ) ) != NULL; i ++ )
+		hash = properties_hash( MLT_FILTER_PROPERTIES( filter ), 0, hash );
+	return hash;
+}
+
+/** Scan the whole producer into a new index.
+*/
+
+static peaks_index *peaks_index_scan( peaks_job *job, int frequency, int channels, int64_t samples )
+{
+	job->index = peaks_index_new( frequency, channels, samples );
+	job->sums = job->index ? calloc( job->index->count[ 0 ] * channels, sizeof( double ) ) : NULL;
+	if ( job->sums == NULL )
+	{
+		peaks_index_close( job->index );
+		return NULL;
+	}
+
+	// Only the producers opened from the source can be scanned in parallel
+	job->chunk = job->source.source != NULL ? PEAKS_CHUNK : job->length;
+	job->chunks = ( job->length + job->chunk - 1 ) / job->chunk;
+	job->threads = job->source.source != NULL ? consumer_source_threads( &job->source, job->chunks ) : 1;
+	consumer_source_run( &job->source, job->threads, peaks_thread, job );
+
+	if ( job->errors > 0 )
+		mlt_log_warning( MLT_CONSUMER_SERVICE( job->source.consumer ), "no audio for %d of %d frames\n", job->errors, job->length );
+
+	peaks_index_finish( job->index, job->sums );
+	free( job->sums );
+
+	return job->index;
+}
+
+static int consumer_start( mlt_consumer self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( self ) );
+	mlt_producer counter = NULL;
+	peaks_job job;
+
+	memset( &job, 0, sizeof( job ) );
+	consumer_source_init( &job.source, self );
+	job.fps = mlt_profile_fps( profile );
+	pthread_mutex_init( &job.mutex, NULL );
+
+	counter = job.source.producer;
+	if ( counter == NULL )
+		counter = consumer_source_open( &job.source );
+
+	if ( counter != NULL && job.fps > 0 && mlt_producer_get_playtime( counter ) > 0 )
+	{
+		mlt_properties counter_properties = MLT_PRODUCER_PROPERTIES( counter );
+		char *media = mlt_properties_get( counter_properties, "resource" );
+		char *resource = mlt_properties_get( properties, "resource" );
+		int frequency = mlt_properties_get_int( properties, "frequency" );
+		int channels = mlt_properties_get_int( properties, "channels" );
+		int pixels = mlt_properties_get_int( properties, "pixels" );
+		int in = mlt_producer_get_in( counter );
+		char *filename = NULL;
+		char key[ 256 ];
+		struct stat file_stat;
+		peaks_index *index;
+		int64_t samples;
+
+		job.length = mlt_producer_get_playtime( counter );
+		samples = mlt_sample_calculator_to_now( job.fps, frequency, job.length );
+
+		// The index is only valid for the same media, cut, frame rate and processing
+		memset( &file_stat, 0, sizeof( file_stat ) );
+		if ( media != NULL )
+			stat( media, &file_stat );
+		snprintf( key, sizeof( key ), "%"PRId64" %"PRId64" %d %d %d/%d %08x", ( int64_t )file_stat.st_size, ( int64_t )file_stat.st_mtime,
+			in, job.length, profile->frame_rate_num, profile->frame_rate_den, service_hash( MLT_PRODUCER_SERVICE( counter ) ) );
+
+		if ( resource != NULL && strcmp( resource, "" ) )
+		{
+			filename = strdup( resource );
+		}
+		else if ( media != NULL && file_stat.st_size > 0 && mlt_properties_get_int( properties, "beside" ) )
+		{
+			filename = malloc( strlen( media ) + strlen( ".mltpeaks" ) + 1 );
+			sprintf( filename, "%s.mltpeaks", media );
+		}
+		else if ( media != NULL && file_stat.st_size > 0 )
+		{
+			char name[ 40 ];
+			snprintf( name, sizeof( name ), "mlt-peaks-%08x", string_hash( media, string_hash( key, 5381 ) ) );
+			filename = mlt_repository_cache_file( name );
+		}
+
+		// Reuse the index of the previous query, the one kept in the file or scan it
+		index = mlt_properties_get_data( properties, "_index", NULL );
+		if ( index == NULL || mlt_properties_get( properties, "_index_key" ) == NULL
+			|| strcmp( mlt_properties_get( properties, "_index_key" ), key ) || index->frequency != frequency
+			|| index->channels != channels || index->samples != samples
+			|| mlt_properties_get_data( properties, "_index_producer", NULL ) != ( job.source.owned ? NULL : job.source.producer ) )
+		{
+			index = filename ? peaks_index_load( filename, key, frequency, channels, samples ) : NULL;
+			if ( index == NULL && channels > 0 && frequency > 0 )
+			{
+				index = peaks_index_scan( &job, frequency, channels, samples );
+				if ( index != NULL && filename != NULL && peaks_index_save( index, filename, key ) )
+					mlt_log_warning( MLT_CONSUMER_SERVICE( self ), "failed to write %s\n", filename );
+			}
+			mlt_properties_set_data( properties, "_index", index, 0, peaks_index_close, NULL );
+			mlt_properties_set( properties, "_index_key", key );
+			mlt_properties_set_data( properties, "_index_producer", job.source.owned ? NULL : job.source.producer, 0, NULL, NULL );
+		}
+
+		if ( index != NULL )
+		{
+			mlt_properties_set_int64( properties, "samples", index->samples );
+			mlt_properties_set_int( properties, "levels", index->levels );
+			if ( pixels > 0 )
+			{
+				int query_in = mlt_properties_get_int( properties, "in" );
+				int query_out = mlt_properties_get( properties, "out" ) ? mlt_properties_get_int( properties, "out" ) : job.length - 1;
+				int64_t start = mlt_sample_calculator_to_now( job.fps, frequency, query_in );
+				int64_t end = mlt_sample_calculator_to_now( job.fps, frequency, query_out + 1 );
+				float *peaks = calloc( pixels * channels * 3, sizeof( float ) );
+
+				if ( peaks != NULL && end > start )
+					peaks_index_query( index, start, end, pixels, peaks );
+				mlt_properties_set_data( properties, "peaks", peaks, pixels * channels * 3 * sizeof( float ), free, NULL );
+			}
+		}
+		else
+		{
+			mlt_log_error( MLT_CONSUMER_SERVICE( self ), "failed to index the audio\n" );
+		}
+		free( filename );
+	}
+	else
+	{
+		mlt_log_error( MLT_CONSUMER_SERVICE( self ), "nothing to index\n" );
+	}
+
+	if ( counter != job.source.producer )
+		mlt_producer_close( counter );
+	consumer_source_close( &job.source );
+	pthread_mutex_destroy( &job.mutex );
+
+	mlt_consumer_stop( self );
+	mlt_consumer_stopped( self );
+
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer self )
+{
+	return 1;
+}
@@ -0,0 +1,150 @@
+/*
+ * consumer_source.c -- the producer of a consumer that renders it on several threads
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "consumer_source.h"
+
+#include <framework/mlt_factory.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/** Find the producer to render.
+
+	The "source" property of the consumer, given to the loader, takes
+	precedence over the connected producer. The connected producer is rendered
+	as it is, with its filters and properties, so it is never opened again.
+*/
+
+void consumer_source_init( consumer_source *self, mlt_consumer consumer )
+{
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( consumer ) );
+	mlt_service service = mlt_service_producer( MLT_CONSUMER_SERVICE( consumer ) );
+	char *source = mlt_properties_get( MLT_CONSUMER_PROPERTIES( consumer ), "source" );
+
+	memset( self, 0, sizeof( consumer_source ) );
+	self->consumer = consumer;
+
+	if ( source != NULL && strcmp( source, "" ) )
+	{
+		self->source = strdup( source );
+		self->producer = mlt_factory_producer( profile, NULL, source );
+		self->owned = 1;
+		return;
+	}
+
+	switch ( mlt_service_identify( service ) )
+	{
+		case producer_type:
+		case playlist_type:
+		case tractor_type:
+		case multitrack_type:
+			self->producer = ( mlt_producer )service;
+			break;
+		default:
+			break;
+	}
+}
+
+/** Open another producer of the source property for a thread.
+
+	Returns NULL when the producer is the connected one, which can not be
+	opened again without losing its filters and properties.
+*/
+
+mlt_producer consumer_source_open( consumer_source *self )
+{
+	mlt_profile profile = mlt_service_profile( MLT_CONSUMER_SERVICE( self->consumer ) );
+	return self->source != NULL ? mlt_factory_producer( profile, NULL, self->source ) : NULL;
+}
+
+/** Get the properties a consumer sets on its frames for mlt_producer_render_range().
+
+	These come from the "rescale" (bilinear by default), "deinterlace" (on by
+	default), "deinterlace_method", "distort" and "aspect_ratio" properties.
+*/
+
+mlt_properties consumer_source_properties( consumer_source *self )
+{
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( self->consumer );
+	mlt_properties frame_properties = mlt_properties_new( );
+	char *interp = mlt_properties_get( properties, "rescale" );
+	char *deinterlace = mlt_properties_get( properties, "deinterlace" );
+
+	mlt_properties_set( frame_properties, "rescale.interp", interp ? interp : "bilinear" );
+	mlt_properties_set_int( frame_properties, "consumer_deinterlace", deinterlace ? atoi( deinterlace ) : 1 );
+	mlt_properties_set( frame_properties, "deinterlace_method", mlt_properties_get( properties, "deinterlace_method" ) );
+	mlt_properties_set_int( frame_properties, "distort", mlt_properties_get_int( properties, "distort" ) );
+	mlt_properties_set_double( frame_properties, "consumer_aspect_ratio", mlt_properties_get_double( properties, "aspect_ratio" ) );
+
+	return frame_properties;
+}
+
+/** Get the number of threads for count pieces of work from the "threads" property.
+
+	The default of 0 is a thread per CPU.
+*/
+
+int consumer_source_threads( consumer_source *self, int count )
+{
+	int threads = mlt_properties_get_int( MLT_CONSUMER_PROPERTIES( self->consumer ), "threads" );
+
+	if ( threads <= 0 )
+		threads = sysconf( _SC_NPROCESSORS_ONLN );
+	if ( threads > count )
+		threads = count;
+	if ( threads < 1 )
+		threads = 1;
+
+	return threads;
+}
+
+/** Run a thread function on the calling thread and threads - 1 others and wait for them.
+
+	The position of the producer, which the threads may share, is restored
+	afterwards.
+*/
+
+void consumer_source_run( consumer_source *self, int threads, void *( *thread )( void * ), void *arg )
+{
+	mlt_position position = self->producer ? mlt_producer_position( self->producer ) : 0;
+	pthread_t *workers = calloc( threads, sizeof( pthread_t ) );
+	int i;
+
+	for ( i = 1; workers && i < threads; i ++ )
+		if ( pthread_create( &workers[ i ], NULL, thread, arg ) != 0 )
+			break;
+	thread( arg );
+	while ( workers && -- i > 0 )
+		pthread_join( workers[ i ], NULL );
+	free( workers );
+
+	if ( self->producer != NULL )
+		mlt_producer_seek( self->producer, position );
+}
+
+void consumer_source_close( consumer_source *self )
+{
+	if ( self->owned )
+		mlt_producer_close( self->producer );
+	self->producer = NULL;
+	free( self->source );
+	self->source = NULL;
+}
@@ -0,0 +1,47 @@
+/*
+ * consumer_source.h -- the producer of a consumer that renders it on several threads
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _CONSUMER_SOURCE_H_
+#define _CONSUMER_SOURCE_H_
+
+#include <framework/mlt_consumer.h>
+#include <framework/mlt_producer.h>
+
+/** The producer a consumer renders and how its threads may open their own.
+
+	Used by the consumers that render a connected producer, or a "source"
+	property, at many positions at once (filmstrip and peaks).
+*/
+
+typedef struct
+{
+	mlt_consumer consumer;
+	mlt_producer producer;      // the connected producer, the one opened from source or NULL
+	char *source;               // the source property to open more producers with, or NULL
+	int owned;                  // true when the producer was opened from source
+}
+consumer_source;
+
+extern void consumer_source_init( consumer_source *self, mlt_consumer consumer );
+extern mlt_producer consumer_source_open( consumer_source *self );
+extern mlt_properties consumer_source_properties( consumer_source *self );
+extern int consumer_source_threads( consumer_source *self, int count );
+extern void consumer_source_run( consumer_source *self, int threads, void *( *thread )( void * ), void *arg );
+extern void consumer_source_close( consumer_source *self );
+
+#endif
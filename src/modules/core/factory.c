@@ -21,7 +21,9 @@
 #include <framework/mlt.h>
 #include <string.h>
 
+extern mlt_consumer consumer_filmstrip_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_consumer consumer_null_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_consumer consumer_peaks_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audiochannels_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audioconvert_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_filter filter_audiowave_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
@@ -56,7 +58,9 @@ extern mlt_transition transition_mix_init( mlt_profile profile, mlt_service_type
 
 MLT_REPOSITORY
 {
+	MLT_REGISTER( consumer_type, "filmstrip", consumer_filmstrip_init );
 	MLT_REGISTER( consumer_type, "null", consumer_null_init );
+	MLT_REGISTER( consumer_type, "peaks", consumer_peaks_init );
 	MLT_REGISTER( filter_type, "audiochannels", filter_audiochannels_init );
 	MLT_REGISTER( filter_type, "audioconvert", filter_audioconvert_init );
 	MLT_REGISTER( filter_type, "audiowave", filter_audiowave_init );
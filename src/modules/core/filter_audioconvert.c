@@ -21,6 +21,7 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_audio.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,251 +36,16 @@ static int convert_audio( mlt_frame frame, void **audio, mlt_audio_format *forma
 
 	if ( *format != requested_format )
 	{
+		void *buffer = mlt_pool_alloc( size );
+
 		mlt_log_debug( NULL, "[filter audioconvert] %s -> %s %d channels %d samples\n",
 			mlt_audio_format_name( *format ), mlt_audio_format_name( requested_format ),
 			channels, samples );
-		switch ( *format )
-		{
-		case mlt_audio_s16:
-			switch ( requested_format )
-			{
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int16_t *q = (int16_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (int32_t) *q << 16;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int16_t *q = (int16_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (float)( *q ) / 32768.0;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_s32:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-						*p++ = *( q + c * samples + s ) >> 16;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = (float)( *q++ ) / 2147483648.0;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_float:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				float *q = (float*) *audio;
-				int s, c;
-				for ( s = 0; s < samples; s++ )
-					for ( c = 0; c < channels; c++ )
-					{
-						float f = *( q + c * samples + s );
-						f = f > 1.0 ? 1.0 : f < -1.0 ? -1.0 : f;
-						*p++ = 32767 * f;
-					}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = f > 1.0 ? 1.0 : f < -1.0 ? -1.0 : f;
-					*p++ = ( f > 0 ? 2147483647LL : 2147483648LL ) * f;
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_s32le:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				int32_t *q = (int32_t*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-					*p++ = *q++ >> 16;
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int32_t *q = (int32_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = *q;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					int32_t *q = (int32_t*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = (float)( *q ) / 2147483648.0;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		case mlt_audio_f32le:
-			switch ( requested_format )
-			{
-			case mlt_audio_s16:
-			{
-				int16_t *buffer = mlt_pool_alloc( size );
-				int16_t *p = buffer;
-				float *q = (float*) *audio;
-				int i = samples * channels + 1;
-				while ( --i )
-				{
-					float f = *q++;
-					f = f > 1.0 ? 1.0 : f < -1.0 ? -1.0 : f;
-					*p++ = 32767 * f;
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_float:
-			{
-				float *buffer = mlt_pool_alloc( size );
-				float *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					float *q = (float*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						*p++ = *q;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			case mlt_audio_s32:
-			{
-				int32_t *buffer = mlt_pool_alloc( size );
-				int32_t *p = buffer;
-				int c;
-				for ( c = 0; c < channels; c++ )
-				{
-					float *q = (float*) *audio + c;
-					int i = samples + 1;
-					while ( --i )
-					{
-						float f = *q;
-						f = f > 1.0 ? 1.0 : f < -1.0 ? -1.0 : f;
-						*p++ = ( f > 0 ? 2147483647LL : 2147483648LL ) * f;
-						q += channels;
-					}
-				}
-				*audio = buffer;
-				error = 0;
-				break;
-			}
-			default:
-				break;
-			}
-			break;
-		default:
-			break;
-		}
+		error = ( size > 0 && buffer == NULL ) || mlt_audio_convert( buffer, requested_format, *audio, *format, samples, channels );
+		if ( !error )
+			*audio = buffer;
+		else
+			mlt_pool_release( buffer );
 	}
 	if ( !error )
 	{
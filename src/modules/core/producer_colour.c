@@ -143,6 +143,9 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 		mlt_properties_set_int( producer_props, "_format", *format );
 		mlt_properties_set( producer_props, "_resource", now );
 
+		// Share our image with the frame - it is copied only if someone writes to it
+		mlt_frame_set_image_shared( frame, image, size );
+
 		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 
 		switch ( *format )
@@ -197,6 +200,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	}
 	else
 	{
+		mlt_frame_set_image_shared( frame, image, size );
 		mlt_service_unlock( MLT_PRODUCER_SERVICE( producer ) );
 	}
 
@@ -208,12 +212,7 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	if ( alpha )
 		memset( alpha, color.a, alpha_size );
 
-	// Clone our image
-	*buffer = mlt_pool_alloc( size );
-	memcpy( *buffer, image, size );
-
-	// Now update properties so we free the copy after
-	mlt_frame_set_image( frame, *buffer, size, mlt_pool_release );
+	*buffer = image;
 	mlt_frame_set_alpha( frame, alpha, alpha_size, mlt_pool_release );
 	mlt_properties_set_double( properties, "aspect_ratio", mlt_properties_get_double( producer_props, "aspect_ratio" ) );
 	mlt_properties_set_int( properties, "real_width", *width );
@@ -103,6 +103,7 @@ static int producer_get_audio( mlt_frame frame, int16_t **buffer, mlt_audio_form
 	int size = 0;
 
 	// Correct the returns if necessary
+	*format = mlt_audio_s16;
 	*samples = *samples <= 0 ? 1920 : *samples;
 	*channels = *channels <= 0 ? 2 : *channels;
 	*frequency = *frequency <= 0 ? 48000 : *frequency;
@@ -151,6 +151,7 @@ static int producer_get_audio( mlt_frame this, int16_t **buffer, mlt_audio_forma
 
 	FILE *pipe = mlt_properties_get_data( properties, "audio.pipe", NULL );
 
+	*format = mlt_audio_s16;
 	*frequency = 48000;
 	*channels = 2;
 	*samples = 1920;
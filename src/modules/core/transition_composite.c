@@ -941,6 +941,7 @@ static mlt_geometry composite_calculate( mlt_transition this, struct geometry_s
 				length *= cycle;
 			mlt_geometry_refresh( start, mlt_properties_get( properties, "geometry" ), length, normalised_width, normalised_height );
 		}
+		mlt_geometry_set_smooth( start, mlt_properties_get_int( properties, "smooth" ) );
 
 		// Do the calculation
 		geometry_calculate( this, result, position );
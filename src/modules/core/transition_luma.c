@@ -529,6 +529,9 @@ mlt_transition transition_luma_init( mlt_profile profile, mlt_service_type type,
 		// Inform apps and framework that this is a video only transition
 		mlt_properties_set_int( MLT_TRANSITION_PROPERTIES( transition ), "_transition_type", 1 );
 
+		// The B frame is requested at the size and format of the A frame, so a parallel tractor may fetch it early
+		mlt_properties_set_int( MLT_TRANSITION_PROPERTIES( transition ), "_parallel_b", 1 );
+
 		return transition;
 	}
 	return NULL;
@@ -20,54 +20,71 @@
 
 #include <framework/mlt_transition.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_audio.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 
+/** Get the audio of a frame as planar floats, silenced if it was only a placeholder.
+*/
+
+static int get_float_audio( mlt_frame frame, float **buffer, int *frequency, int *channels, int *samples )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	mlt_audio_format format = mlt_audio_float;
+	void *audio = NULL;
+	int error = mlt_frame_get_audio( frame, &audio, &format, frequency, channels, samples );
+
+	if ( !error && audio != NULL && format != mlt_audio_float )
+	{
+		int size = mlt_audio_format_size( mlt_audio_float, *samples, *channels );
+		float *converted = mlt_pool_alloc( size );
+		if ( converted != NULL && !mlt_audio_convert( converted, mlt_audio_float, audio, format, *samples, *channels ) )
+		{
+			mlt_frame_set_audio( frame, converted, mlt_audio_float, size, mlt_pool_release );
+			audio = converted;
+		}
+		else
+		{
+			mlt_pool_release( converted );
+			error = 1;
+		}
+	}
+	*buffer = audio;
+	if ( !error && audio != NULL && mlt_properties_get_int( properties, "silent_audio" ) )
+		memset( audio, 0, *samples * *channels * sizeof( float ) );
+	mlt_properties_set_int( properties, "silent_audio", 0 );
+
+	return error || audio == NULL;
+}
+
+/** Move the planes of a buffer together after its samples were cut.
+*/
+
+static void compact_planes( float *buffer, int length, int samples, int channels )
+{
+	int c;
+	if ( samples < length )
+		for ( c = 1; c < channels; c++ )
+			memmove( buffer + c * samples, buffer + c * length, samples * sizeof( float ) );
+}
+
 static int mix_audio( mlt_frame this, mlt_frame that, float weight_start, float weight_end, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
-	int ret = 0;
-	int16_t *src, *dest;
+	float *src, *dest;
 	int frequency_src = *frequency, frequency_dest = *frequency;
 	int channels_src = *channels, channels_dest = *channels;
 	int samples_src = *samples, samples_dest = *samples;
-	int i, j;
-	double d = 0, s = 0;
-
-	mlt_frame_get_audio( that, (void**) &src, format, &frequency_src, &channels_src, &samples_src );
-	mlt_frame_get_audio( this, (void**) &dest, format, &frequency_dest, &channels_dest, &samples_dest );
-
-	int silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( this ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( this ), "silent_audio", 0 );
-	if ( silent )
-		memset( dest, 0, samples_dest * channels_dest * sizeof( int16_t ) );
-
-	silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( that ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( that ), "silent_audio", 0 );
-	if ( silent )
-		memset( src, 0, samples_src * channels_src * sizeof( int16_t ) );
-
-	if ( channels_src > 6 )
-		channels_src = 0;
-	if ( channels_dest > 6 )
-		channels_dest = 0;
-	if ( samples_src > 4000 )
-		samples_src = 0;
-	if ( samples_dest > 4000 )
-		samples_dest = 0;
+	int c;
 
-	// determine number of samples to process
-	*samples = samples_src < samples_dest ? samples_src : samples_dest;
-	*channels = channels_src < channels_dest ? channels_src : channels_dest;
-	*buffer = dest;
-	*frequency = frequency_dest;
-
-	// Compute a smooth ramp over start to end
-	float weight = weight_start;
-	float weight_step = ( weight_end - weight_start ) / *samples;
+	if ( get_float_audio( that, &src, &frequency_src, &channels_src, &samples_src ) ||
+	     get_float_audio( this, &dest, &frequency_dest, &channels_dest, &samples_dest ) )
+		return 1;
+	*format = mlt_audio_float;
 
 	if ( src == dest )
 	{
@@ -75,89 +92,148 @@ static int mix_audio( mlt_frame this, mlt_frame that, float weight_start, float
 		*channels = channels_src;
 		*buffer = src;
 		*frequency = frequency_src;
-		return ret;
+		return 0;
 	}
 
-	// Mixdown
-	for ( i = 0; i < *samples; i++ )
+	// determine number of samples to process
+	*samples = samples_src < samples_dest ? samples_src : samples_dest;
+	*channels = channels_src < channels_dest ? channels_src : channels_dest;
+	*buffer = dest;
+	*frequency = frequency_dest;
+
+	// Crossfade each channel with a smooth ramp over start to end
+	for ( c = 0; c < *channels; c++ )
 	{
-		for ( j = 0; j < *channels; j++ )
+		const float *inputs[ 2 ] = { dest + c * samples_dest, src + c * samples_src };
+		float start[ 2 ] = { 1.0 - weight_start, weight_start };
+		float end[ 2 ] = { 1.0 - weight_end, weight_end };
+		mlt_audio_mix( dest + c * samples_dest, inputs, start, end, 2, *samples );
+	}
+	compact_planes( dest, samples_dest, *samples, *channels );
+
+	return 0;
+}
+
+/** Get the transition and b frame of a combining transition applied just below on the stack.
+
+	The tractor applies each transition to the result of the ones before it, so a
+	mix of many tracks is a chain of combining transitions on the a frame. Taking
+	the rest of the chain here lets all of the tracks be summed in one pass.
+*/
+
+static mlt_frame pop_chained_combine( mlt_frame frame, mlt_get_audio get_audio )
+{
+	mlt_deque stack = MLT_FRAME_AUDIO_STACK( frame );
+	int count = mlt_deque_count( stack );
+
+	if ( count >= 3 && mlt_deque_peek_back( stack ) == get_audio )
+	{
+		mlt_transition effect = mlt_deque_peek( stack, count - 3 );
+		if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES( effect ), "combine" ) )
 		{
-			if ( j < channels_dest )
-				d = (double) dest[ i * channels_dest + j ];
-			if ( j < channels_src )
-				s = (double) src[ i * channels_src + j ];
-			dest[ i * channels_dest + j ] = s * weight + d * ( 1.0 - weight );
+			mlt_frame b_frame;
+			mlt_deque_pop_back( stack );
+			b_frame = mlt_deque_pop_back( stack );
+			mlt_deque_pop_back( stack );
+			return b_frame;
 		}
-		weight += weight_step;
 	}
-
-	return ret;
+	return NULL;
 }
 
 // Replacement for broken mlt_frame_audio_mix - this filter uses an inline low pass filter
 // to allow mixing without volume hacking
-static int combine_audio( mlt_frame this, mlt_frame that, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+static int combine_audio( mlt_frame this, mlt_deque b_frames, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
 {
-	int ret = 0;
-	int16_t *src, *dest;
-	int frequency_src = *frequency, frequency_dest = *frequency;
-	int channels_src = *channels, channels_dest = *channels;
-	int samples_src = *samples, samples_dest = *samples;
-	int i, j;
-	double vp[ 6 ];
-	double b_weight = 1.0;
-
+	int count = mlt_deque_count( b_frames ) + 1;
+	const float **inputs = calloc( count, sizeof( float* ) );
+	float **buffers = calloc( count, sizeof( float* ) );
+	int *lengths = calloc( count, sizeof( int ) );
+	float *gains = calloc( count, sizeof( float ) );
+	float *dest;
+	int frequency_dest = *frequency;
+	int channels_dest = *channels;
+	int samples_dest = *samples;
+	int min_channels = INT_MAX;
+	int min_samples = INT_MAX;
+	int used = 1;
+	int error = 0;
+	int i, j, c;
+
+	if ( inputs == NULL || buffers == NULL || lengths == NULL || gains == NULL )
+		error = 1;
+
+	// The volume of the a frame is taken before it is applied when the audio is fetched
+	gains[ 0 ] = 1.0;
 	if ( mlt_properties_get_int( MLT_FRAME_PROPERTIES( this ), "meta.mixdown" ) )
-		b_weight = 1.0 - mlt_properties_get_double( MLT_FRAME_PROPERTIES( this ), "meta.volume" );
-
-	mlt_frame_get_audio( that, (void**) &src, format, &frequency_src, &channels_src, &samples_src );
-	mlt_frame_get_audio( this, (void**) &dest, format, &frequency_dest, &channels_dest, &samples_dest );
-
-	int silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( this ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( this ), "silent_audio", 0 );
-	if ( silent )
-		memset( dest, 0, samples_dest * channels_dest * sizeof( int16_t ) );
+		gains[ 0 ] = 1.0 - mlt_properties_get_double( MLT_FRAME_PROPERTIES( this ), "meta.volume" );
 
-	silent = mlt_properties_get_int( MLT_FRAME_PROPERTIES( that ), "silent_audio" );
-	mlt_properties_set_int( MLT_FRAME_PROPERTIES( that ), "silent_audio", 0 );
-	if ( silent )
-		memset( src, 0, samples_src * channels_src * sizeof( int16_t ) );
-
-	if ( src == dest )
+	// Fetch the tracks from the top down as the chained transitions would have done
+	for ( i = 1; !error && i < count; i++ )
 	{
-		*samples = samples_src;
-		*channels = channels_src;
-		*buffer = src;
-		*frequency = frequency_src;
-		return ret;
+		mlt_frame b_frame = mlt_deque_peek( b_frames, i - 1 );
+		int frequency_src = *frequency, channels_src = *channels, samples_src = *samples;
+		float *src;
+
+		if ( get_float_audio( b_frame, &src, &frequency_src, &channels_src, &samples_src ) )
+			continue;
+		buffers[ used ] = src;
+		lengths[ used ] = samples_src;
+		gains[ used ] = 1.0;
+		min_channels = channels_src < min_channels ? channels_src : min_channels;
+		min_samples = samples_src < min_samples ? samples_src : min_samples;
+		used ++;
 	}
+	if ( error || get_float_audio( this, &dest, &frequency_dest, &channels_dest, &samples_dest ) )
+	{
+		free( inputs );
+		free( buffers );
+		free( lengths );
+		free( gains );
+		return 1;
+	}
+	buffers[ 0 ] = dest;
+	lengths[ 0 ] = samples_dest;
+	*format = mlt_audio_float;
+
+	// A track that shares the buffer of the a frame is already in it
+	for ( i = 1; i < used; i++ )
+		if ( buffers[ i ] == dest )
+			gains[ i ] = 0.0;
 
 	// determine number of samples to process
-	*samples = samples_src < samples_dest ? samples_src : samples_dest;
-	*channels = channels_src < channels_dest ? channels_src : channels_dest;
+	*samples = samples_dest < min_samples ? samples_dest : min_samples;
+	*channels = channels_dest < min_channels ? channels_dest : min_channels;
 	*buffer = dest;
 	*frequency = frequency_dest;
 
-	for ( j = 0; j < *channels; j++ )
-		vp[ j ] = ( double )dest[ j ];
-
 	double Fc = 0.5;
 	double B = exp(-2.0 * M_PI * Fc);
 	double A = 1.0 - B;
-	double v;
 
-	for ( i = 0; i < *samples; i++ )
+	for ( c = 0; c < *channels; c++ )
 	{
-		for ( j = 0; j < *channels; j++ )
+		float *p = dest + c * samples_dest;
+		float vp = p[ 0 ];
+
+		for ( i = 0; i < used; i++ )
+			inputs[ i ] = buffers[ i ] + c * lengths[ i ];
+		mlt_audio_mix( p, inputs, gains, gains, used, *samples );
+
+		for ( j = 0; j < *samples; j++ )
 		{
-			v = ( double )( b_weight * dest[ i * channels_dest + j ] + src[ i * channels_src + j ] );
-			v = v < -32767 ? -32767 : v > 32768 ? 32768 : v;
-			vp[ j ] = dest[ i * channels_dest + j ] = ( int16_t )( v * A + vp[ j ] * B );
+			float v = p[ j ] < -1.0 ? -1.0 : p[ j ] > 1.0 ? 1.0 : p[ j ];
+			vp = p[ j ] = v * A + vp * B;
 		}
 	}
+	compact_planes( dest, samples_dest, *samples, *channels );
+
+	free( inputs );
+	free( buffers );
+	free( lengths );
+	free( gains );
 
-	return ret;
+	return 0;
 }
 
 /** Get the audio.
@@ -174,8 +250,9 @@ static int transition_get_audio( mlt_frame frame, void **buffer, mlt_audio_forma
 	// Get the properties of the b frame
 	mlt_properties b_props = MLT_FRAME_PROPERTIES( b_frame );
 
-	// We can only mix s16
-	*format = mlt_audio_s16;
+	// Mix in float and return what was asked for
+	mlt_audio_format requested_format = *format;
+	int error;
 
 	if ( mlt_properties_get_int( MLT_TRANSITION_PROPERTIES( effect ), "combine" ) == 0 )
 	{
@@ -190,11 +267,32 @@ static int transition_get_audio( mlt_frame frame, void **buffer, mlt_audio_forma
 			mix_end = 1 - mix_end;
 		}
 
-		mix_audio( frame, b_frame, mix_start, mix_end, buffer, format, frequency, channels, samples );
+		error = mix_audio( frame, b_frame, mix_start, mix_end, buffer, format, frequency, channels, samples );
 	}
 	else
 	{
-		combine_audio( frame, b_frame, buffer, format, frequency, channels, samples );
+		mlt_deque b_frames = mlt_deque_init( );
+		mlt_deque_push_back( b_frames, b_frame );
+		while ( ( b_frame = pop_chained_combine( frame, transition_get_audio ) ) != NULL )
+			mlt_deque_push_back( b_frames, b_frame );
+		error = combine_audio( frame, b_frames, buffer, format, frequency, channels, samples );
+		mlt_deque_close( b_frames );
+	}
+
+	if ( !error && requested_format != mlt_audio_none && requested_format != *format )
+	{
+		int size = mlt_audio_format_size( requested_format, *samples, *channels );
+		void *converted = mlt_pool_alloc( size );
+		if ( converted != NULL && !mlt_audio_convert( converted, requested_format, *buffer, *format, *samples, *channels ) )
+		{
+			mlt_frame_set_audio( frame, converted, requested_format, size, mlt_pool_release );
+			*buffer = converted;
+			*format = requested_format;
+		}
+		else
+		{
+			mlt_pool_release( converted );
+		}
 	}
 
 	return 0;
@@ -67,7 +67,7 @@ static void check_thread_safe( mlt_properties properties, const char *name )
 	mlt_properties_close( not_thread_safe );
 }
 
-static mlt_properties fill_param_info ( mlt_service_type type, const char *service_name, char *name )
+static mlt_properties fill_param_info ( mlt_service_type type, const char *service_name, mlt_properties plugin )
 {
 	char file[ PATH_MAX ];
 	char servicetype[ 1024 ]="";
@@ -94,30 +94,18 @@ static mlt_properties fill_param_info ( mlt_service_type type, const char *servi
 		return mlt_properties_parse_yaml( file );
 	}
 
-	void* handle=dlopen(name,RTLD_LAZY);
-	if (!handle) return NULL;
-	void (*plginfo)(f0r_plugin_info_t*)=dlsym(handle,"f0r_get_plugin_info");
-	void (*param_info)(f0r_param_info_t*,int param_index)=dlsym(handle,"f0r_get_param_info");
-	void (*f0r_init)(void)=dlsym(handle,"f0r_init");
-	void (*f0r_deinit)(void)=dlsym(handle,"f0r_deinit");
-	if (!plginfo || !param_info) {
-		dlclose(handle);
-		return NULL;
-	}
 	mlt_properties metadata = mlt_properties_new();
-	f0r_plugin_info_t info;
 	char string[48];
 	int j=0;
+	int num_params = mlt_properties_get_int( plugin, "num_params" );
 
-	f0r_init();
-	plginfo(&info);
-	snprintf ( string, sizeof(string) , "%d.%d" , info.major_version , info.minor_version );
+	snprintf ( string, sizeof(string) , "%d.%d" , mlt_properties_get_int( plugin, "major_version" ), mlt_properties_get_int( plugin, "minor_version" ) );
 	mlt_properties_set ( metadata, "schema_version" , "0.1" );
-	mlt_properties_set ( metadata, "title" , info.name );
+	mlt_properties_set ( metadata, "title" , mlt_properties_get( plugin, "name" ) );
 	mlt_properties_set ( metadata, "version", string );
 	mlt_properties_set ( metadata, "identifier" , service_name );
-	mlt_properties_set ( metadata, "description" , info.explanation );
-	mlt_properties_set ( metadata, "creator" , info.author );
+	mlt_properties_set ( metadata, "description" , mlt_properties_get( plugin, "explanation" ) );
+	mlt_properties_set ( metadata, "creator" , mlt_properties_get( plugin, "author" ) );
 	switch (type){
 		case producer_type:
 			mlt_properties_set ( metadata, "type" , "producer" );
@@ -138,40 +126,40 @@ static mlt_properties fill_param_info ( mlt_service_type type, const char *servi
 	mlt_properties_set_data ( metadata , "tags" , tags , 0 , ( mlt_destructor )mlt_properties_close, NULL );
 	mlt_properties_set ( tags , "0" , "Video" );
 
-	for (j=0;j<info.num_params;j++){
+	for (j=0;j<num_params;j++){
+		char key[64];
 		snprintf ( string , sizeof(string), "%d" , j );
 		mlt_properties pnum = mlt_properties_new ( );
 		mlt_properties_set_data ( parameter , string , pnum , 0 , ( mlt_destructor )mlt_properties_close, NULL );
-		f0r_param_info_t paraminfo;
-		param_info(&paraminfo,j);
-		mlt_properties_set ( pnum , "identifier" , paraminfo.name );
-		mlt_properties_set ( pnum , "title" , paraminfo.name );
-		mlt_properties_set ( pnum , "description" , paraminfo.explanation);
-		if ( paraminfo.type == F0R_PARAM_DOUBLE ){
+		snprintf ( key, sizeof(key), "param.%d.name", j );
+		mlt_properties_set ( pnum , "identifier" , mlt_properties_get( plugin, key ) );
+		mlt_properties_set ( pnum , "title" , mlt_properties_get( plugin, key ) );
+		snprintf ( key, sizeof(key), "param.%d.explanation", j );
+		mlt_properties_set ( pnum , "description" , mlt_properties_get( plugin, key ) );
+		snprintf ( key, sizeof(key), "param.%d.type", j );
+		int paramtype = mlt_properties_get_int( plugin, key );
+		if ( paramtype == F0R_PARAM_DOUBLE ){
 			mlt_properties_set ( pnum , "type" , "float" );
 			mlt_properties_set ( pnum , "minimum" , "0" );
 			mlt_properties_set ( pnum , "maximum" , "1" );
 			mlt_properties_set ( pnum , "readonly" , "no" );
 			mlt_properties_set ( pnum , "widget" , "spinner" );
 		}else
-		if ( paraminfo.type == F0R_PARAM_BOOL ){
+		if ( paramtype == F0R_PARAM_BOOL ){
 			mlt_properties_set ( pnum , "type" , "boolean" );
 			mlt_properties_set ( pnum , "minimum" , "0" );
 			mlt_properties_set ( pnum , "maximum" , "1" );
 			mlt_properties_set ( pnum , "readonly" , "no" );
 		}else
-		if ( paraminfo.type == F0R_PARAM_COLOR ){
+		if ( paramtype == F0R_PARAM_COLOR ){
 			mlt_properties_set ( pnum , "type" , "color" );
 			mlt_properties_set ( pnum , "readonly" , "no" );
 		}else
-		if ( paraminfo.type == F0R_PARAM_STRING ){
+		if ( paramtype == F0R_PARAM_STRING ){
 			mlt_properties_set ( pnum , "type" , "string" );
 			mlt_properties_set ( pnum , "readonly" , "no" );
 		}
 	}
-	f0r_deinit();
-	dlclose(handle);
-	free(name);
 
 	return metadata;
 }
@@ -323,6 +311,77 @@ static void * create_frei0r_item ( mlt_profile profile, mlt_service_type type, c
 }
 
 
+
+/** Get the description of a plugin file from the cache when it has not changed,
+ * otherwise open the plugin to describe it.
+*/
+
+static mlt_properties describe_plugin( mlt_properties cache, const char *name, int *changed )
+{
+	mlt_properties plugin = mlt_properties_get_data( cache, name, NULL );
+	struct stat st;
+	char string[ 64 ];
+
+	if ( stat( name, &st ) != 0 )
+		return NULL;
+
+	snprintf( string, sizeof(string), "%lld %lld", ( long long )st.st_mtime, ( long long )st.st_size );
+	if ( plugin && mlt_properties_get( plugin, "stat" ) && !strcmp( mlt_properties_get( plugin, "stat" ), string ) )
+	{
+		mlt_properties_inc_ref( plugin );
+		return plugin;
+	}
+
+	*changed = 1;
+	plugin = mlt_properties_new();
+	mlt_properties_set( plugin, "stat", string );
+	mlt_properties_set_int( plugin, "plugin_type", -1 );
+
+	void* handle=dlopen(name,RTLD_LAZY);
+	if (handle){
+		void (*plginfo)(f0r_plugin_info_t*)=dlsym(handle,"f0r_get_plugin_info");
+		void (*param_info)(f0r_param_info_t*,int param_index)=dlsym(handle,"f0r_get_param_info");
+		void (*f0r_init)(void)=dlsym(handle,"f0r_init");
+		void (*f0r_deinit)(void)=dlsym(handle,"f0r_deinit");
+
+		if (plginfo){
+			f0r_plugin_info_t info;
+			int j;
+
+			plginfo(&info);
+			mlt_properties_set_int( plugin, "plugin_type", info.plugin_type );
+			mlt_properties_set_int( plugin, "color_model", info.color_model );
+			mlt_properties_set_int( plugin, "frei0r_version", info.frei0r_version );
+			mlt_properties_set_int( plugin, "major_version", info.major_version );
+			mlt_properties_set_int( plugin, "minor_version", info.minor_version );
+			mlt_properties_set( plugin, "name", info.name );
+			mlt_properties_set( plugin, "author", info.author );
+			mlt_properties_set( plugin, "explanation", info.explanation );
+
+			if (param_info && f0r_init && f0r_deinit){
+				mlt_properties_set_int( plugin, "num_params", info.num_params );
+				f0r_init();
+				for (j=0;j<info.num_params;j++){
+					f0r_param_info_t paraminfo;
+					param_info(&paraminfo,j);
+					snprintf( string, sizeof(string), "param.%d.name", j );
+					mlt_properties_set( plugin, string, paraminfo.name );
+					snprintf( string, sizeof(string), "param.%d.type", j );
+					mlt_properties_set_int( plugin, string, paraminfo.type );
+					snprintf( string, sizeof(string), "param.%d.explanation", j );
+					mlt_properties_set( plugin, string, paraminfo.explanation );
+				}
+				f0r_deinit();
+			}
+		}
+		dlclose(handle);
+	}else{
+		dlerror();
+	}
+
+	return plugin;
+}
+
 MLT_REPOSITORY
 {
 	int i=0;
@@ -333,8 +392,14 @@ MLT_REPOSITORY
 		":"
 	);
 	char dirname[PATH_MAX];
+	mlt_repository_watch_env( repository, "FREI0R_PATH" );
+	mlt_repository_watch_env( repository, "MLT_FREI0R_PLUGIN_PATH" );
+	mlt_repository_watch_env( repository, "HOME" );
 	snprintf( dirname, PATH_MAX, "%s/frei0r/blacklist.txt", mlt_environment( "MLT_DATA" ) );
 	mlt_properties blacklist = mlt_properties_load( dirname );
+	mlt_properties cache = mlt_repository_cache_load( "mlt-frei0r" );
+	mlt_properties plugins = mlt_properties_new( );
+	int changed = 0;
 
 	while (dircount--){
 
@@ -345,6 +410,7 @@ MLT_REPOSITORY
 			snprintf(dirname, PATH_MAX, "%s", directory);
 		else
 			snprintf(dirname, PATH_MAX, "%s%s", getenv("HOME"), strchr(directory, '/'));
+		mlt_repository_watch( repository, dirname );
 		mlt_properties_dir_list(direntries, dirname ,"*" LIBSUF, 1);
 
 		for (i=0; i<mlt_properties_count(direntries);i++){
@@ -362,46 +428,43 @@ MLT_REPOSITORY
 			if ( mlt_properties_get( blacklist, firstname ) )
 				continue;
 
-			void* handle=dlopen(strcat(name, LIBSUF),RTLD_LAZY);
-			if (handle){
-				void (*plginfo)(f0r_plugin_info_t*)=dlsym(handle,"f0r_get_plugin_info");
-
-				if (plginfo){
-					f0r_plugin_info_t info;
-					plginfo(&info);
-					if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_SOURCE){
-						if (mlt_properties_get(mlt_repository_producers(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( producer_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( producer_type, pluginname, fill_param_info, strdup(name) );
-					}
-					else if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_FILTER){
-						if (mlt_properties_get(mlt_repository_filters(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( filter_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( filter_type, pluginname, fill_param_info, strdup(name) );
-					}
-					else if (firstname && info.plugin_type==F0R_PLUGIN_TYPE_MIXER2 ){
-						if (mlt_properties_get(mlt_repository_transitions(repository), pluginname))
-						{
-							dlclose(handle);
-							continue;
-						}
-						MLT_REGISTER( transition_type, pluginname, create_frei0r_item );
-						MLT_REGISTER_METADATA( transition_type, pluginname, fill_param_info, strdup(name) );
-					}
+			mlt_properties plugin = describe_plugin( cache, strcat(name, LIBSUF), &changed );
+			if (plugin){
+				int plugin_type = mlt_properties_get_int( plugin, "plugin_type" );
+
+				// Keep the description for the metadata and the cache
+				mlt_properties_set_data( plugins, name, plugin, 0, ( mlt_destructor )mlt_properties_close, NULL );
+
+				if (firstname && plugin_type==F0R_PLUGIN_TYPE_SOURCE){
+					if (mlt_properties_get(mlt_repository_producers(repository), pluginname))
+						continue;
+					MLT_REGISTER( producer_type, pluginname, create_frei0r_item );
+					MLT_REGISTER_METADATA( producer_type, pluginname, fill_param_info, plugin );
+				}
+				else if (firstname && plugin_type==F0R_PLUGIN_TYPE_FILTER){
+					if (mlt_properties_get(mlt_repository_filters(repository), pluginname))
+						continue;
+					MLT_REGISTER( filter_type, pluginname, create_frei0r_item );
+					MLT_REGISTER_METADATA( filter_type, pluginname, fill_param_info, plugin );
+				}
+				else if (firstname && plugin_type==F0R_PLUGIN_TYPE_MIXER2 ){
+					if (mlt_properties_get(mlt_repository_transitions(repository), pluginname))
+						continue;
+					MLT_REGISTER( transition_type, pluginname, create_frei0r_item );
+					MLT_REGISTER_METADATA( transition_type, pluginname, fill_param_info, plugin );
 				}
-				dlclose(handle);
 			}
 		}
 		mlt_properties_close(direntries);
 	}
 	mlt_tokeniser_close ( tokeniser );
 	mlt_properties_close( blacklist );
+
+	// Only plugins that were added, removed or changed are opened, so rewrite the cache then
+	if ( changed || mlt_properties_count( plugins ) != mlt_properties_count( cache ) )
+		mlt_repository_cache_save( "mlt-frei0r", plugins );
+	mlt_properties_close( cache );
+
+	// The metadata callbacks use the descriptions
+	mlt_factory_register_for_clean_up( plugins, ( mlt_destructor )mlt_properties_close );
 }
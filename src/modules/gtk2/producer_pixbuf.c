@@ -443,7 +443,7 @@ static void refresh_image( producer_pixbuf this, mlt_frame frame, int width, int
 		mlt_properties_set_int( cached_props, "height", this->height );
 		mlt_properties_set_int( cached_props, "real_width", mlt_properties_get_int( producer_props, "_real_width" ) );
 		mlt_properties_set_int( cached_props, "real_height", mlt_properties_get_int( producer_props, "_real_height" ) );
-		mlt_frame_set_image( cached, this->image, this->width * ( this->alpha ? 4 : 3 ) * this->height, mlt_pool_release );
+		mlt_frame_set_image( cached, mlt_pool_retain( this->image ), this->width * ( this->alpha ? 4 : 3 ) * this->height, mlt_pool_release );
 		mlt_properties_set_int( cached_props, "alpha", this->alpha );
 		mlt_properties_set_data( cache, image_key, cached, 0, ( mlt_destructor )mlt_frame_close, NULL );
 	}
@@ -473,18 +473,13 @@ static int producer_get_image( mlt_frame frame, uint8_t **buffer, mlt_image_form
 	*width = this->width;
 	*height = this->height;
 
-	// NB: Cloning is necessary with this producer (due to processing of images ahead of use)
-	// The fault is not in the design of mlt, but in the implementation of the pixbuf producer...
+	// NB: The frame must hold its own reference to the image (due to processing of images ahead of use)
+	// It is shared rather than cloned - mlt_frame_get_image copies it only for writing
 	if ( this->image )
 	{
-		// Clone the image
 		int image_size = this->width * this->height * ( this->alpha ? 4 :3 );
-		uint8_t *image_copy = mlt_pool_alloc( image_size );
-		memcpy( image_copy, this->image, image_size );
-		// Now update properties so we free the copy after
-		mlt_frame_set_image( frame, image_copy, image_size, mlt_pool_release );
-		// We're going to pass the copy on
-		*buffer = image_copy;
+		mlt_frame_set_image_shared( frame, this->image, image_size );
+		*buffer = this->image;
 		*format = this->alpha ? mlt_image_rgb24a : mlt_image_rgb24;
 		mlt_log_debug( MLT_PRODUCER_SERVICE( &this->parent ), "%dx%d (%s)\n",
 			this->width, this->height, mlt_image_format_name( *format ) );
@@ -124,6 +124,15 @@ static mlt_properties metadata( mlt_service_type type, const char *id, void *dat
 MLT_REPOSITORY
 {
 	GSList *list;
+	char *path = plugin_mgr_get_path();
+	char *dir;
+
+	// Refresh the repository cache when plugins are added or removed
+	mlt_repository_watch_env( repository, "LADSPA_PATH" );
+	for ( dir = strtok( path, ":" ); dir; dir = strtok( NULL, ":" ) )
+		mlt_repository_watch( repository, dir );
+	g_free( path );
+
 	g_jackrack_plugin_mgr = plugin_mgr_new();
 
 	for ( list = g_jackrack_plugin_mgr->all_plugins; list; list = g_slist_next( list ) )
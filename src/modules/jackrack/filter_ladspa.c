@@ -32,9 +32,7 @@
 
 #include "jack_rack.h"
 
-#define BUFFER_LEN 10000
-
-static jack_rack_t* initialise_jack_rack( mlt_properties properties, int channels )
+static jack_rack_t* initialise_jack_rack( mlt_properties properties, int channels, int frequency )
 {
 	jack_rack_t *jackrack = NULL;
 	char *resource = mlt_properties_get( properties, "resource" );
@@ -45,10 +43,17 @@ static jack_rack_t* initialise_jack_rack( mlt_properties properties, int channel
 	if ( resource || mlt_properties_get_int64( properties, "_pluginid" ) )
 	{
 		// Create JackRack without Jack client name so that it only uses LADSPA
+		char key[32];
 		jackrack = jack_rack_new( NULL, channels );
-		mlt_properties_set_data( properties, "jackrack", jackrack, 0,
+		if ( jackrack == NULL )
+			return NULL;
+		snprintf( key, sizeof(key), "jackrack.%d.%d", channels, frequency );
+		mlt_properties_set_data( properties, key, jackrack, 0,
 			(mlt_destructor) jack_rack_destroy, NULL );
 
+		// The plugins are instantiated for the current rate of this global
+		sample_rate = frequency;
+
 		if ( resource )
 			// Load JACK Rack XML file
 			jack_rack_open_file( jackrack, resource );
@@ -106,32 +111,44 @@ static int ladspa_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 	// Get the producer's audio
 	*format = mlt_audio_float;
-	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
-	
-	// Initialise LADSPA if needed
-	jack_rack_t *jackrack = mlt_properties_get_data( filter_properties, "jackrack", NULL );
+	int error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+	if ( error || *channels <= 0 || *samples <= 0 )
+		return error;
+
+	// Plugin state is not reentrant, so the filter runs one frame at a time
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+
+	// Racks are kept for each audio layout seen, so a change of channels or
+	// rate neither mismatches the plugins nor reloads them every frame
+	char key[32];
+	snprintf( key, sizeof(key), "jackrack.%d.%d", *channels, *frequency );
+	jack_rack_t *jackrack = mlt_properties_get_data( filter_properties, key, NULL );
 	if ( jackrack == NULL )
-	{
-		sample_rate = *frequency; // global inside jack_rack
-		jackrack = initialise_jack_rack( filter_properties, *channels );
-	}
-		
-	// Get the filter-specific properties
-	LADSPA_Data **input_buffers  = mlt_pool_alloc( sizeof( LADSPA_Data* ) * *channels );
-	LADSPA_Data **output_buffers = mlt_pool_alloc( sizeof( LADSPA_Data* ) * *channels );
+		jackrack = initialise_jack_rack( filter_properties, *channels, *frequency );
 
-	int i;
-	for ( i = 0; i < *channels; i++ )
+	if ( jackrack )
 	{
-		input_buffers[i]  = (LADSPA_Data*) *buffer + i * *samples;
-		output_buffers[i] = (LADSPA_Data*) *buffer + i * *samples;
-	}
+		LADSPA_Data **input_buffers  = mlt_pool_alloc( sizeof( LADSPA_Data* ) * *channels );
+		LADSPA_Data **output_buffers = mlt_pool_alloc( sizeof( LADSPA_Data* ) * *channels );
+		int offset, i;
 
-	// Do LADSPA processing
-	int error = jackrack && process_ladspa( jackrack->procinfo, *samples, input_buffers, output_buffers );
+		// Process the planes in place, in blocks no longer than the plugin buffers
+		for ( offset = 0; !error && offset < *samples; offset += MAX_BUFFER_SIZE )
+		{
+			int count = *samples - offset < MAX_BUFFER_SIZE ? *samples - offset : MAX_BUFFER_SIZE;
+			for ( i = 0; i < *channels; i++ )
+			{
+				input_buffers[i]  = (LADSPA_Data*) *buffer + i * *samples + offset;
+				output_buffers[i] = input_buffers[i];
+			}
+			error = process_ladspa( jackrack->procinfo, count, input_buffers, output_buffers );
+		}
+
+		mlt_pool_release( input_buffers );
+		mlt_pool_release( output_buffers );
+	}
 
-	mlt_pool_release( input_buffers );
-	mlt_pool_release( output_buffers );
+	mlt_service_unlock( MLT_FILTER_SERVICE( filter ) );
 
 	return error;
 }
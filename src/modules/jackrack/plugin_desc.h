@@ -70,6 +70,10 @@ void plugin_desc_set_index       (plugin_desc_t * pd, unsigned long index);
 void plugin_desc_set_id          (plugin_desc_t * pd, unsigned long id);
 void plugin_desc_set_name        (plugin_desc_t * pd, const char * name);
 void plugin_desc_set_properties  (plugin_desc_t * pd, LADSPA_Properties properties);
+void plugin_desc_set_ports       (plugin_desc_t * pd, unsigned long port_count,
+                                  const LADSPA_PortDescriptor * port_descriptors,
+                                  const LADSPA_PortRangeHint * port_range_hints,
+                                  const char * const * port_names);
 
 struct _plugin * plugin_desc_instantiate (plugin_desc_t * pd);
 
@@ -41,6 +41,7 @@
 #include "plugin_desc.h"
 #include "framework/mlt_log.h"
 #include "framework/mlt_factory.h"
+#include "framework/mlt_properties.h"
 
 static gboolean
 plugin_is_valid (const LADSPA_Descriptor * descriptor)
@@ -66,26 +67,52 @@ plugin_is_valid (const LADSPA_Descriptor * descriptor)
   return TRUE;
 }
 
+/* the descriptor cache holds the properties of each object file, where floats are
+   kept as their bits */
+
 static void
-plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * filename)
+plugin_mgr_cache_set_float (mlt_properties properties, const char * name, LADSPA_Data value)
+{
+  union { LADSPA_Data f; guint32 i; } bits;
+  char string[16];
+
+  bits.f = value;
+  snprintf (string, sizeof (string), "%08x", bits.i);
+  mlt_properties_set (properties, name, string);
+}
+
+static LADSPA_Data
+plugin_mgr_cache_get_float (mlt_properties properties, const char * name)
+{
+  union { LADSPA_Data f; guint32 i; } bits;
+  const char * string = mlt_properties_get (properties, name);
+
+  bits.i = string ? strtoul (string, NULL, 16) : 0;
+  return bits.f;
+}
+
+/* open an object file and describe its valid plugins in the cache format */
+static mlt_properties
+plugin_mgr_describe_object_file (const char * filename)
 {
   const char * dlerr;
   void * dl_handle;
   LADSPA_Descriptor_Function get_descriptor;
   const LADSPA_Descriptor * descriptor;
   unsigned long plugin_index;
-  plugin_desc_t * desc, * other_desc = NULL;
-  GSList * list;
-  gboolean exists;
+  mlt_properties object_file = mlt_properties_new ();
+  int count = 0;
   int err;
   
+  mlt_properties_set_int (object_file, "count", 0);
+
   /* open the object file */
   dl_handle = dlopen (filename, RTLD_NOW|RTLD_GLOBAL);
   if (!dl_handle)
     {
       mlt_log_warning( NULL, "%s: error opening shared object file '%s': %s\n",
                __FUNCTION__, filename, dlerror());
-      return;
+      return object_file;
     }
   
   
@@ -100,18 +127,142 @@ plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * file
     mlt_log_warning( NULL, "%s: error finding ladspa_descriptor symbol in object file '%s': %s\n",
              __FUNCTION__, filename, dlerr);
     dlclose (dl_handle);
-    return;
+    return object_file;
   }
   
   plugin_index = 0;
   while ( (descriptor = get_descriptor (plugin_index)) )
     {
-      if (!plugin_is_valid (descriptor))
+      char name[64];
+      unsigned long port;
+
+      if (plugin_is_valid (descriptor))
         {
-          plugin_index++;
-          continue;
+          snprintf (name, sizeof (name), "%d.index", count);
+          mlt_properties_set_int (object_file, name, plugin_index);
+          snprintf (name, sizeof (name), "%d.id", count);
+          mlt_properties_set_int64 (object_file, name, descriptor->UniqueID);
+          snprintf (name, sizeof (name), "%d.name", count);
+          mlt_properties_set (object_file, name, descriptor->Name);
+          snprintf (name, sizeof (name), "%d.properties", count);
+          mlt_properties_set_int (object_file, name, descriptor->Properties);
+          snprintf (name, sizeof (name), "%d.port_count", count);
+          mlt_properties_set_int (object_file, name, descriptor->PortCount);
+
+          for (port = 0; port < descriptor->PortCount; port++)
+            {
+              snprintf (name, sizeof (name), "%d.port.%lu.descriptor", count, port);
+              mlt_properties_set_int (object_file, name, descriptor->PortDescriptors[port]);
+              snprintf (name, sizeof (name), "%d.port.%lu.hint", count, port);
+              mlt_properties_set_int (object_file, name, descriptor->PortRangeHints[port].HintDescriptor);
+              snprintf (name, sizeof (name), "%d.port.%lu.lower", count, port);
+              plugin_mgr_cache_set_float (object_file, name, descriptor->PortRangeHints[port].LowerBound);
+              snprintf (name, sizeof (name), "%d.port.%lu.upper", count, port);
+              plugin_mgr_cache_set_float (object_file, name, descriptor->PortRangeHints[port].UpperBound);
+              snprintf (name, sizeof (name), "%d.port.%lu.name", count, port);
+              mlt_properties_set (object_file, name, descriptor->PortNames[port]);
+            }
+          count++;
         }
+      plugin_index++;
+    }
+  mlt_properties_set_int (object_file, "count", count);
+  
+  err = dlclose (dl_handle);
+  if (err)
+    {
+      mlt_log_warning( NULL, "%s: error closing object file '%s': %s\n",
+               __FUNCTION__, filename, dlerror ());
+    }
+
+  return object_file;
+}
+
+/* make a plugin description from the cache format */
+static plugin_desc_t *
+plugin_mgr_new_desc (const char * filename, mlt_properties object_file, int i)
+{
+  plugin_desc_t * desc = plugin_desc_new ();
+  unsigned long port_count;
+  LADSPA_PortDescriptor * port_descriptors;
+  LADSPA_PortRangeHint * port_range_hints;
+  char ** port_names;
+  unsigned long port;
+  char name[64];
+
+  plugin_desc_set_object_file (desc, filename);
+  snprintf (name, sizeof (name), "%d.index", i);
+  plugin_desc_set_index (desc, mlt_properties_get_int (object_file, name));
+  snprintf (name, sizeof (name), "%d.id", i);
+  plugin_desc_set_id (desc, mlt_properties_get_int64 (object_file, name));
+  snprintf (name, sizeof (name), "%d.name", i);
+  plugin_desc_set_name (desc, mlt_properties_get (object_file, name));
+  snprintf (name, sizeof (name), "%d.properties", i);
+  plugin_desc_set_properties (desc, mlt_properties_get_int (object_file, name));
+  snprintf (name, sizeof (name), "%d.port_count", i);
+  port_count = mlt_properties_get_int (object_file, name);
+
+  port_descriptors = g_malloc (sizeof (LADSPA_PortDescriptor) * (port_count + 1));
+  port_range_hints = g_malloc (sizeof (LADSPA_PortRangeHint) * (port_count + 1));
+  port_names = g_malloc (sizeof (char *) * (port_count + 1));
+  for (port = 0; port < port_count; port++)
+    {
+      snprintf (name, sizeof (name), "%d.port.%lu.descriptor", i, port);
+      port_descriptors[port] = mlt_properties_get_int (object_file, name);
+      snprintf (name, sizeof (name), "%d.port.%lu.hint", i, port);
+      port_range_hints[port].HintDescriptor = mlt_properties_get_int (object_file, name);
+      snprintf (name, sizeof (name), "%d.port.%lu.lower", i, port);
+      port_range_hints[port].LowerBound = plugin_mgr_cache_get_float (object_file, name);
+      snprintf (name, sizeof (name), "%d.port.%lu.upper", i, port);
+      port_range_hints[port].UpperBound = plugin_mgr_cache_get_float (object_file, name);
+      snprintf (name, sizeof (name), "%d.port.%lu.name", i, port);
+      port_names[port] = mlt_properties_get (object_file, name);
+    }
+  plugin_desc_set_ports (desc, port_count, port_descriptors, port_range_hints, (const char * const *) port_names);
+  g_free (port_descriptors);
+  g_free (port_range_hints);
+  g_free (port_names);
+
+  desc->rt = LADSPA_IS_HARD_RT_CAPABLE(desc->properties) ? TRUE : FALSE;
 
+  return desc;
+}
+
+static void
+plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * filename)
+{
+  mlt_properties object_file = mlt_properties_get_data (plugin_mgr->cache, filename, NULL);
+  plugin_desc_t * desc, * other_desc = NULL;
+  GSList * list;
+  gboolean exists;
+  struct stat info;
+  char stat_string[64];
+  int count, i;
+
+  /* only open the object file when it is not in the cache or has changed */
+  if (stat (filename, &info))
+    return;
+  snprintf (stat_string, sizeof (stat_string), "%lld %lld", (long long) info.st_mtime, (long long) info.st_size);
+  if (object_file && mlt_properties_get (object_file, "stat") && !strcmp (mlt_properties_get (object_file, "stat"), stat_string))
+    {
+      mlt_properties_inc_ref (object_file);
+    }
+  else
+    {
+      object_file = plugin_mgr_describe_object_file (filename);
+      mlt_properties_set (object_file, "stat", stat_string);
+      plugin_mgr->cache_changed = TRUE;
+    }
+  mlt_properties_set_data (plugin_mgr->object_files, filename, object_file, 0, (mlt_destructor) mlt_properties_close, NULL);
+
+  count = mlt_properties_get_int (object_file, "count");
+  for (i = 0; i < count; i++)
+    {
+      char name[64];
+      unsigned long id;
+
+      snprintf (name, sizeof (name), "%d.id", i);
+      id = mlt_properties_get_int64 (object_file, name);
       
       /* check it doesn't already exist */
       exists = FALSE;
@@ -119,7 +270,7 @@ plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * file
         {
           other_desc = (plugin_desc_t *) list->data;
           
-          if (other_desc->id == descriptor->UniqueID)
+          if (other_desc->id == id)
             {
               exists = TRUE;
               break;
@@ -129,27 +280,18 @@ plugin_mgr_get_object_file_plugins (plugin_mgr_t * plugin_mgr, const char * file
       if (exists)
         {
           mlt_log_info( NULL, "Plugin %ld exists in both '%s' and '%s'; using version in '%s'\n",
-                  descriptor->UniqueID, other_desc->object_file, filename, other_desc->object_file);
-          plugin_index++;
+                  id, other_desc->object_file, filename, other_desc->object_file);
           continue;
         }
 
       
-      desc = plugin_desc_new_with_descriptor (filename, plugin_index, descriptor);
+      desc = plugin_mgr_new_desc (filename, object_file, i);
       plugin_mgr->all_plugins = g_slist_append (plugin_mgr->all_plugins, desc);
-      plugin_index++;
       plugin_mgr->plugin_count++;
       
       /* print in the splash screen */
       /* mlt_log_verbose( NULL, "Loaded plugin '%s'\n", desc->name); */
     }
-  
-  err = dlclose (dl_handle);
-  if (err)
-    {
-      mlt_log_warning( NULL, "%s: error closing object file '%s': %s\n",
-               __FUNCTION__, filename, dlerror ());
-    }
 }
 
 static void
@@ -206,11 +348,11 @@ plugin_mgr_get_dir_plugins (plugin_mgr_t * plugin_mgr, const char * dir)
              __FUNCTION__, dir, strerror (errno));
 }
 
-static void
-plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr)
+char *
+plugin_mgr_get_path ()
 {
-  char * ladspa_path, * dir;
-  
+  char * ladspa_path;
+
   ladspa_path = g_strdup (getenv ("LADSPA_PATH"));
   if (!ladspa_path)
 #ifdef WIN32
@@ -218,6 +360,16 @@ plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr)
 #else
     ladspa_path = g_strdup ("/usr/local/lib/ladspa:/usr/lib/ladspa:/usr/lib64/ladspa");
 #endif
+
+  return ladspa_path;
+}
+
+static void
+plugin_mgr_get_path_plugins (plugin_mgr_t * plugin_mgr)
+{
+  char * ladspa_path, * dir;
+  
+  ladspa_path = plugin_mgr_get_path ();
   
   dir = strtok (ladspa_path, ":");
   do
@@ -251,7 +403,17 @@ plugin_mgr_new ()
 
   snprintf (dirname, PATH_MAX, "%s/jackrack/blacklist.txt", mlt_environment ("MLT_DATA"));
   pm->blacklist = mlt_properties_load (dirname);
+
+  /* describe the plugins from the cache, opening only new or changed object files */
+  pm->cache = mlt_repository_cache_load ("mlt-ladspa");
+  pm->object_files = mlt_properties_new ();
+  pm->cache_changed = FALSE;
   plugin_mgr_get_path_plugins (pm);
+  if (pm->cache_changed ||
+      mlt_properties_count (pm->object_files) != mlt_properties_count (pm->cache))
+    mlt_repository_cache_save ("mlt-ladspa", pm->object_files);
+  mlt_properties_close (pm->cache);
+  mlt_properties_close (pm->object_files);
   
   if (!pm->all_plugins)
     {
@@ -40,11 +40,17 @@ struct _plugin_mgr
   GSList * plugins;
   unsigned long plugin_count;
   mlt_properties blacklist;
+
+  /* the descriptor cache while scanning */
+  mlt_properties cache;
+  mlt_properties object_files;
+  gboolean cache_changed;
 };
 
 struct _ui;
 
 plugin_mgr_t * plugin_mgr_new ();
+char *         plugin_mgr_get_path ();
 void           plugin_mgr_destroy (plugin_mgr_t * plugin_mgr);
 
 void plugin_mgr_set_plugins (plugin_mgr_t * plugin_mgr, unsigned long rack_channels);
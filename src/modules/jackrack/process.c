@@ -46,7 +46,6 @@
 #define USEC_PER_SEC         1000000
 #define MSEC_PER_SEC         1000
 #define TIME_RUN_SKIP_COUNT  5
-#define MAX_BUFFER_SIZE      4096
 
 jack_nframes_t sample_rate;
 jack_nframes_t buffer_size;
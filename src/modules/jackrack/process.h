@@ -56,6 +56,9 @@ struct _process_info {
   int quit;
 };
 
+/** the most frames process_ladspa handles in one call without JACK */
+#define MAX_BUFFER_SIZE 4096
+
 extern jack_nframes_t sample_rate;
 extern jack_nframes_t buffer_size;
 
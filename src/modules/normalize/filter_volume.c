@@ -20,6 +20,9 @@
 
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
+#include <framework/mlt_log.h>
+
+#include "loudness.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -115,21 +118,22 @@ double signal_max_power( int16_t *buffer, int channels, int samples, int16_t *pe
 	int16_t max = (1 << (bytes_per_samp * 8 - 1)) - 1;
 	int16_t min = -max - 1;
 	
-	double *sums = (double *) calloc( channels, sizeof(double) );
 	int c, i;
 	int16_t sample;
-	double pow, maxpow = 0;
+	double sum, pow, maxpow = 0;
 
 	/* initialize peaks to effectively -inf and +inf */
 	int16_t max_sample = min;
 	int16_t min_sample = max;
   
-	for ( i = 0; i < samples; i++ )
+	for ( c = 0; c < channels; c++ )
 	{
-		for ( c = 0; c < channels; c++ )
+		int16_t *p = buffer + c;
+
+		for ( i = 0, sum = 0; i < samples; i++, p += channels )
 		{
-			sample = *buffer++;
-			sums[ c ] += (double) sample * (double) sample;
+			sample = *p;
+			sum += (double) sample * (double) sample;
 			
 			/* track peak */
 			if ( sample > max_sample )
@@ -137,15 +141,10 @@ double signal_max_power( int16_t *buffer, int channels, int samples, int16_t *pe
 			else if ( sample < min_sample )
 				min_sample = sample;
 		}
-	}
-	for ( c = 0; c < channels; c++ )
-	{
-		pow = sums[ c ] / (double) samples;
+		pow = sum / (double) samples;
 		if ( pow > maxpow )
 			maxpow = pow;
 	}
-			
-	free( sums );
 	
 	/* scale the pow value to be in the range 0.0 -- 1.0 */
 	maxpow /= ( (double) min * (double) min);
@@ -160,6 +159,54 @@ double signal_max_power( int16_t *buffer, int channels, int samples, int16_t *pe
 
 /* ------ End normalize functions --------------------------------------- */
 
+/** Feed the audio of a frame to the loudness meter and publish the readings.
+
+    The meter follows the stream: a jump in position resets the short windows
+    but the integrated loudness keeps accumulating, and a repeated frame is
+    not measured twice.
+*/
+
+static loudness measure_loudness( mlt_filter this, mlt_frame frame, int16_t *buffer, int frequency, int channels, int samples )
+{
+	mlt_properties filter_props = MLT_FILTER_PROPERTIES( this );
+	mlt_properties frame_props = MLT_FRAME_PROPERTIES( frame );
+	loudness meter = mlt_properties_get_data( filter_props, "_loudness", NULL );
+	mlt_position position = mlt_frame_get_position( frame );
+	mlt_position last_position = mlt_properties_get_position( filter_props, "_loudness_position" );
+
+	if ( meter == NULL || channels != mlt_properties_get_int( filter_props, "_loudness_channels" )
+	     || frequency != mlt_properties_get_int( filter_props, "_loudness_frequency" ) )
+	{
+		meter = loudness_init( channels, frequency );
+		mlt_properties_set_data( filter_props, "_loudness", meter, 0, ( mlt_destructor )loudness_close, NULL );
+		mlt_properties_set_int( filter_props, "_loudness_channels", channels );
+		mlt_properties_set_int( filter_props, "_loudness_frequency", frequency );
+		last_position = position - 1;
+	}
+	if ( meter == NULL )
+		return NULL;
+
+	if ( position != last_position )
+	{
+		if ( position != last_position + 1 )
+			loudness_reset( meter );
+		loudness_process( meter, buffer, samples );
+		mlt_properties_set_position( filter_props, "_loudness_position", position );
+
+		mlt_properties_set_double( filter_props, "momentary", loudness_momentary( meter ) );
+		mlt_properties_set_double( filter_props, "short_term", loudness_short_term( meter ) );
+		mlt_properties_set_double( filter_props, "integrated", loudness_integrated( meter ) );
+		mlt_properties_set_double( filter_props, "true_peak", loudness_true_peak( meter ) );
+	}
+
+	mlt_properties_set_double( frame_props, "meta.loudness.momentary", mlt_properties_get_double( filter_props, "momentary" ) );
+	mlt_properties_set_double( frame_props, "meta.loudness.short_term", mlt_properties_get_double( filter_props, "short_term" ) );
+	mlt_properties_set_double( frame_props, "meta.loudness.integrated", mlt_properties_get_double( filter_props, "integrated" ) );
+	mlt_properties_set_double( frame_props, "meta.loudness.true_peak", mlt_properties_get_double( filter_props, "true_peak" ) );
+
+	return meter;
+}
+
 /** Get the audio.
 */
 
@@ -180,6 +227,8 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	double limiter_level = 0.5; /* -6 dBFS */
 	int normalise =  mlt_properties_get_int( instance_props, "normalise" );
 	double amplitude =  mlt_properties_get_double( instance_props, "amplitude" );
+	int analyse = mlt_properties_get_int( instance_props, "analyse" );
+	int loudness_normalise = mlt_properties_get( instance_props, "loudness" ) != NULL;
 	int i, j;
 	double sample;
 	int16_t peak;
@@ -199,7 +248,26 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 
 	mlt_service_lock( MLT_FILTER_SERVICE( this ) );
 
-	if ( normalise )
+	if ( analyse || loudness_normalise )
+	{
+		loudness meter = measure_loudness( this, frame, *buffer, *frequency, *channels, *samples );
+
+		// Leave the audio untouched when only analysing
+		if ( analyse )
+		{
+			mlt_service_unlock( MLT_FILTER_SERVICE( this ) );
+			return 0;
+		}
+
+		// Prefer the program loudness from an earlier analysis to the loudness so far
+		double program = meter ? loudness_integrated( meter ) : LOUDNESS_MIN;
+		if ( mlt_properties_get( instance_props, "program" ) != NULL )
+			program = mlt_properties_get_double( instance_props, "program" );
+		if ( program > LOUDNESS_MIN )
+			gain *= DBFSTOAMP( mlt_properties_get_double( instance_props, "loudness" ) - program );
+		normalise = 1;
+	}
+	else if ( normalise )
 	{
 		int window = mlt_properties_get_int( filter_props, "window" );
 		double *smooth_buffer = mlt_properties_get_data( filter_props, "smooth_buffer", NULL );
@@ -419,6 +487,13 @@ static mlt_frame filter_process( mlt_filter this, mlt_frame frame )
 		mlt_properties_set_double( instance_props, "amplitude", amplitude );
 	}
 
+	// Parse the loudness properties
+	if ( mlt_properties_get( filter_props, "loudness" ) != NULL )
+		mlt_properties_set_double( instance_props, "loudness", mlt_properties_get_double( filter_props, "loudness" ) );
+	if ( mlt_properties_get( filter_props, "program" ) != NULL )
+		mlt_properties_set_double( instance_props, "program", mlt_properties_get_double( filter_props, "program" ) );
+	mlt_properties_set_int( instance_props, "analyse", mlt_properties_get_int( filter_props, "analyse" ) );
+
 	// Parse the window property and allocate smoothing buffer if needed
 	int window = mlt_properties_get_int( filter_props, "window" );
 	if ( mlt_properties_get( filter_props, "smooth_buffer" ) == NULL && window > 1 )
@@ -440,6 +515,20 @@ static mlt_frame filter_process( mlt_filter this, mlt_frame frame )
 	return frame;
 }
 
+/** Report the measurement of an analysis pass.
+*/
+
+static void filter_close( mlt_filter this )
+{
+	mlt_properties properties = MLT_FILTER_PROPERTIES( this );
+
+	if ( mlt_properties_get_int( properties, "analyse" ) && mlt_properties_get( properties, "integrated" ) != NULL )
+		mlt_log_info( MLT_FILTER_SERVICE( this ), "integrated %s LUFS true peak %s dBTP\n",
+			mlt_properties_get( properties, "integrated" ), mlt_properties_get( properties, "true_peak" ) );
+	this->parent.close = NULL;
+	mlt_service_close( &this->parent );
+}
+
 /** Constructor for the filter.
 */
 
@@ -450,6 +539,7 @@ mlt_filter filter_volume_init( mlt_profile profile, mlt_service_type type, const
 	{
 		mlt_properties properties = MLT_FILTER_PROPERTIES( this );
 		this->process = filter_process;
+		this->close = filter_close;
 		if ( arg != NULL )
 			mlt_properties_set( properties, "gain", arg );
 
@@ -0,0 +1,366 @@
+/*
+ * loudness.c -- streaming loudness meter (EBU R128, ITU-R BS.1770)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#include "loudness.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/** Blocks of 100ms are the unit of measurement: momentary loudness is the
+    mean of the last 4 and short term loudness the mean of the last 30.
+*/
+
+#define BLOCKS 30
+#define MOMENTARY_BLOCKS 4
+
+/** Gating blocks are counted in a histogram of 0.01 LU bins from the absolute
+    gate at -70 LUFS up to +30 LUFS, so the integrated loudness of a program of
+    any length is computed in constant space. The bin that holds the relative
+    gate only counts for the part of it above the gate.
+*/
+
+#define ABSOLUTE_GATE -70.0
+#define RELATIVE_GATE -10.0
+#define BINS_PER_LU 100
+#define BINS ( 100 * BINS_PER_LU )
+
+/** True peak is measured by oversampling 4 times with the 48 tap
+    interpolation filter given in annex 2 of BS.1770, split into 4 phases.
+*/
+
+#define TAPS 12
+
+static const double phases[ 4 ][ TAPS ] =
+{
+	{ 0.0017089843750, 0.0109863281250, -0.0196533203125, 0.0332031250000, -0.0594482421875, 0.1373291015625,
+	  0.9721679687500, -0.1022949218750, 0.0476074218750, -0.0266113281250, 0.0148925781250, -0.0083007812500 },
+	{ -0.0291748046875, 0.0292968750000, -0.0517578125000, 0.0891113281250, -0.1665039062500, 0.4650878906250,
+	  0.7797851562500, -0.2003173828125, 0.1015625000000, -0.0582275390625, 0.0330810546875, -0.0189208984375 },
+	{ -0.0189208984375, 0.0330810546875, -0.0582275390625, 0.1015625000000, -0.2003173828125, 0.7797851562500,
+	  0.4650878906250, -0.1665039062500, 0.0891113281250, -0.0517578125000, 0.0292968750000, -0.0291748046875 },
+	{ -0.0083007812500, 0.0148925781250, -0.0266113281250, 0.0476074218750, -0.1022949218750, 0.9721679687500,
+	  0.1373291015625, -0.0594482421875, 0.0332031250000, -0.0196533203125, 0.0109863281250, 0.0017089843750 }
+};
+
+struct channel_s
+{
+	double weight;
+	double shelf[ 2 ];
+	double highpass[ 2 ];
+	double history[ TAPS * 2 ];
+};
+
+struct loudness_s
+{
+	int channels;
+	struct channel_s *channel;
+
+	// K-weighting filter: a high shelf followed by a high pass
+	double shelf_b[ 3 ], shelf_a[ 3 ];
+	double highpass_b[ 3 ], highpass_a[ 3 ];
+
+	// Current 100ms block
+	int block_size;
+	int block_fill;
+	double block_energy;
+
+	// Ring of the last BLOCKS block energies
+	double blocks[ BLOCKS ];
+	int block_index;
+	int block_count;
+
+	// Gating blocks above the absolute gate
+	double gated_energy;
+	double bin_energy[ BINS ];
+	double bin_count[ BINS ];
+	int64_t gated_count;
+
+	// True peak
+	int history_index;
+	double peak;
+};
+
+static inline double energy_to_loudness( double energy )
+{
+	double level = energy > 0 ? -0.691 + 10.0 * log10( energy ) : LOUDNESS_MIN;
+	return level > LOUDNESS_MIN ? level : LOUDNESS_MIN;
+}
+
+/** Calculate the K-weighting coefficients for the sample rate.
+
+    The analogue prototypes of BS.1770 are given as biquads at 48KHz; these
+    are their parameters, which allow the filter to be built for any rate.
+*/
+
+static void k_weighting( loudness self, int frequency )
+{
+	double f0 = 1681.974450955533;
+	double G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+	double K = tan( M_PI * f0 / frequency );
+	double Vh = pow( 10.0, G / 20.0 );
+	double Vb = pow( Vh, 0.4996667741545416 );
+	double a0 = 1.0 + K / Q + K * K;
+
+	self->shelf_b[ 0 ] = ( Vh + Vb * K / Q + K * K ) / a0;
+	self->shelf_b[ 1 ] = 2.0 * ( K * K - Vh ) / a0;
+	self->shelf_b[ 2 ] = ( Vh - Vb * K / Q + K * K ) / a0;
+	self->shelf_a[ 0 ] = 1.0;
+	self->shelf_a[ 1 ] = 2.0 * ( K * K - 1.0 ) / a0;
+	self->shelf_a[ 2 ] = ( 1.0 - K / Q + K * K ) / a0;
+
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan( M_PI * f0 / frequency );
+	a0 = 1.0 + K / Q + K * K;
+
+	self->highpass_b[ 0 ] = 1.0;
+	self->highpass_b[ 1 ] = -2.0;
+	self->highpass_b[ 2 ] = 1.0;
+	self->highpass_a[ 0 ] = 1.0;
+	self->highpass_a[ 1 ] = 2.0 * ( K * K - 1.0 ) / a0;
+	self->highpass_a[ 2 ] = ( 1.0 - K / Q + K * K ) / a0;
+}
+
+/** Construct a meter for interleaved audio of the given layout.
+*/
+
+loudness loudness_init( int channels, int frequency )
+{
+	loudness self = NULL;
+
+	if ( channels > 0 && frequency > 0 )
+		self = calloc( 1, sizeof( struct loudness_s ) );
+	if ( self != NULL )
+	{
+		int c;
+
+		self->channel = calloc( channels, sizeof( struct channel_s ) );
+		if ( self->channel == NULL )
+		{
+			free( self );
+			return NULL;
+		}
+		self->channels = channels;
+		self->block_size = frequency / 10;
+		k_weighting( self, frequency );
+
+		// 5.1 is taken to be in the order L R C LFE Ls Rs: the LFE channel is
+		// ignored and the surrounds are weighted by +1.5dB
+		for ( c = 0; c < channels; c ++ )
+			self->channel[ c ].weight = 1.0;
+		if ( channels == 6 )
+		{
+			self->channel[ 3 ].weight = 0.0;
+			self->channel[ 4 ].weight = 1.41;
+			self->channel[ 5 ].weight = 1.41;
+		}
+	}
+	return self;
+}
+
+/** Forget the signal history after a discontinuity.
+
+    The integrated loudness and the true peak cover everything measured since
+    the meter was constructed and are kept.
+*/
+
+void loudness_reset( loudness self )
+{
+	int c;
+	for ( c = 0; c < self->channels; c ++ )
+	{
+		struct channel_s *channel = &self->channel[ c ];
+		memset( channel->shelf, 0, sizeof( channel->shelf ) );
+		memset( channel->highpass, 0, sizeof( channel->highpass ) );
+		memset( channel->history, 0, sizeof( channel->history ) );
+	}
+	self->block_fill = 0;
+	self->block_energy = 0;
+	self->block_index = 0;
+	self->block_count = 0;
+	self->history_index = 0;
+}
+
+/** Gate the 400ms block that ends with the block just completed.
+*/
+
+static void gate_block( loudness self )
+{
+	double energy = 0;
+	double level;
+	int i;
+
+	for ( i = 1; i <= MOMENTARY_BLOCKS; i ++ )
+		energy += self->blocks[ ( self->block_index + BLOCKS - i ) % BLOCKS ];
+	energy /= MOMENTARY_BLOCKS;
+
+	level = energy_to_loudness( energy );
+	if ( level >= ABSOLUTE_GATE )
+	{
+		int bin = ( level - ABSOLUTE_GATE ) * BINS_PER_LU;
+		if ( bin >= BINS )
+			bin = BINS - 1;
+		self->bin_energy[ bin ] += energy;
+		self->bin_count[ bin ] ++;
+		self->gated_energy += energy;
+		self->gated_count ++;
+	}
+}
+
+/** Measure interleaved s16 audio.
+*/
+
+void loudness_process( loudness self, const int16_t *pcm, int samples )
+{
+	int channels = self->channels;
+	const double *sb = self->shelf_b, *sa = self->shelf_a;
+	const double *hb = self->highpass_b, *ha = self->highpass_a;
+	double peak = self->peak;
+	int i, c, p, k;
+
+	for ( i = 0; i < samples; i ++ )
+	{
+		int h = self->history_index;
+		double energy = 0;
+
+		for ( c = 0; c < channels; c ++ )
+		{
+			struct channel_s *channel = &self->channel[ c ];
+			double x = *pcm ++ / 32768.0;
+			double y, z;
+
+			// K-weighting, as two transposed direct form II biquads
+			y = sb[ 0 ] * x + channel->shelf[ 0 ];
+			channel->shelf[ 0 ] = sb[ 1 ] * x - sa[ 1 ] * y + channel->shelf[ 1 ];
+			channel->shelf[ 1 ] = sb[ 2 ] * x - sa[ 2 ] * y;
+			z = hb[ 0 ] * y + channel->highpass[ 0 ];
+			channel->highpass[ 0 ] = hb[ 1 ] * y - ha[ 1 ] * z + channel->highpass[ 1 ];
+			channel->highpass[ 1 ] = hb[ 2 ] * y - ha[ 2 ] * z;
+			energy += channel->weight * z * z;
+
+			// The history is stored twice so the taps are always contiguous
+			channel->history[ h ] = channel->history[ h + TAPS ] = x;
+			if ( fabs( x ) > peak )
+				peak = fabs( x );
+			for ( p = 0; p < 4; p ++ )
+			{
+				const double *taps = &channel->history[ h + TAPS ];
+				double t = 0;
+				for ( k = 0; k < TAPS; k ++ )
+					t += phases[ p ][ k ] * taps[ -k ];
+				if ( fabs( t ) > peak )
+					peak = fabs( t );
+			}
+		}
+		self->history_index = ( h + 1 ) % TAPS;
+
+		self->block_energy += energy;
+		if ( ++ self->block_fill == self->block_size )
+		{
+			self->blocks[ self->block_index ] = self->block_energy / self->block_size;
+			self->block_index = ( self->block_index + 1 ) % BLOCKS;
+			if ( self->block_count < BLOCKS )
+				self->block_count ++;
+			self->block_fill = 0;
+			self->block_energy = 0;
+
+			// Gating blocks are 400ms long and overlap by 75%
+			if ( self->block_count >= MOMENTARY_BLOCKS )
+				gate_block( self );
+		}
+	}
+	self->peak = peak;
+}
+
+static double window_loudness( loudness self, int count )
+{
+	double energy = 0;
+	int i;
+
+	if ( self->block_count < count )
+		return LOUDNESS_MIN;
+	for ( i = 1; i <= count; i ++ )
+		energy += self->blocks[ ( self->block_index + BLOCKS - i ) % BLOCKS ];
+	return energy_to_loudness( energy / count );
+}
+
+/** Get the momentary loudness in LUFS, over the last 400ms.
+*/
+
+double loudness_momentary( loudness self )
+{
+	return window_loudness( self, MOMENTARY_BLOCKS );
+}
+
+/** Get the short term loudness in LUFS, over the last 3s.
+*/
+
+double loudness_short_term( loudness self )
+{
+	return window_loudness( self, BLOCKS );
+}
+
+/** Get the gated integrated loudness in LUFS of everything measured.
+*/
+
+double loudness_integrated( loudness self )
+{
+	double gate, position, part, energy = 0, count = 0;
+	int bin;
+
+	if ( self->gated_count == 0 )
+		return LOUDNESS_MIN;
+
+	// Only the bins above the relative gate are summed, and the part of the one it falls in
+	gate = energy_to_loudness( self->gated_energy / self->gated_count ) + RELATIVE_GATE;
+	position = gate > ABSOLUTE_GATE ? ( gate - ABSOLUTE_GATE ) * BINS_PER_LU : 0;
+	bin = position;
+	if ( bin < BINS )
+	{
+		part = 1.0 - ( position - bin );
+		energy += self->bin_energy[ bin ] * part;
+		count += self->bin_count[ bin ] * part;
+		bin ++;
+	}
+	for ( ; bin < BINS; bin ++ )
+	{
+		energy += self->bin_energy[ bin ];
+		count += self->bin_count[ bin ];
+	}
+	return count > 0 ? energy_to_loudness( energy / count ) : LOUDNESS_MIN;
+}
+
+/** Get the true peak in dBTP.
+*/
+
+double loudness_true_peak( loudness self )
+{
+	double level = self->peak > 0 ? 20.0 * log10( self->peak ) : LOUDNESS_MIN;
+	return level > LOUDNESS_MIN ? level : LOUDNESS_MIN;
+}
+
+void loudness_close( loudness self )
+{
+	if ( self != NULL )
+	{
+		free( self->channel );
+		free( self );
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ * loudness.h -- streaming loudness meter (EBU R128, ITU-R BS.1770)
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _LOUDNESS_H_
+#define _LOUDNESS_H_
+
+#include <stdint.h>
+
+/** Readings for silence, or for too little audio, are clamped to this level.
+    It is finite since modules may be built with -ffast-math.
+*/
+
+#define LOUDNESS_MIN -200.0
+
+typedef struct loudness_s *loudness;
+
+extern loudness loudness_init( int channels, int frequency );
+extern void loudness_reset( loudness self );
+extern void loudness_process( loudness self, const int16_t *pcm, int samples );
+extern double loudness_momentary( loudness self );
+extern double loudness_short_term( loudness self );
+extern double loudness_integrated( loudness self );
+extern double loudness_true_peak( loudness self );
+extern void loudness_close( loudness self );
+
+#endif
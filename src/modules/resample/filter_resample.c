@@ -21,16 +21,159 @@
 #include <framework/mlt_filter.h>
 #include <framework/mlt_frame.h>
 #include <framework/mlt_log.h>
+#include <framework/mlt_pool.h>
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <samplerate.h>
 #include <string.h>
 
-// BUFFER_LEN is based on a maximum of 96KHz, 5 fps, 8 channels
-// TODO: dynamically allocate larger buffer size
-#define BUFFER_LEN ((96000/5) * 8 * sizeof(float))
 #define RESAMPLE_TYPE SRC_SINC_FASTEST
+#define RESAMPLE_STREAMS (3)
+
+/** The converters of a sequence of frames.
+
+    Each channel has its own mono converter, so the planar float audio of a
+    frame is resampled a plane at a time with no interleaving. The converters
+    carry the signal history from one frame to the next of the sequence.
+*/
+
+typedef struct
+{
+	volatile int busy;
+	volatile mlt_position next;
+	volatile unsigned int used;
+	volatile unsigned int continued;
+	SRC_STATE **states;
+	int channels;
+}
+resample_stream;
+
+/** The resampling state of the filter.
+
+    The consumer fetches audio in order on a single thread (the audio render
+    thread or the read ahead thread), so its frames form one sequence that
+    keeps its converters. A frame that does not continue a sequence - after a
+    seek, or from another caller such as a waveform drawn by an image worker -
+    starts one in the converters that were continued least recently, which
+    are never those of the sequence the consumer is playing.
+
+    Nothing waits: a frame claims converters with an atomic swap and only when
+    they are busy does it get converters of its own for that frame.
+*/
+
+typedef struct resampler_s
+{
+	resample_stream streams[ RESAMPLE_STREAMS ];
+	volatile unsigned int clock;
+}
+*resampler;
+
+static void states_close( SRC_STATE **states, int channels )
+{
+	int c;
+	if ( states != NULL )
+	{
+		for ( c = 0; c < channels; c ++ )
+			if ( states[ c ] != NULL )
+				src_delete( states[ c ] );
+		free( states );
+	}
+}
+
+static SRC_STATE **states_init( int channels, int *error )
+{
+	SRC_STATE **states = calloc( channels, sizeof( SRC_STATE* ) );
+	int c;
+
+	for ( c = 0; states != NULL && c < channels; c ++ )
+	{
+		states[ c ] = src_new( RESAMPLE_TYPE, 1, error );
+		if ( states[ c ] == NULL )
+		{
+			states_close( states, channels );
+			states = NULL;
+		}
+	}
+	return states;
+}
+
+static void resampler_close( resampler self )
+{
+	int i;
+	for ( i = 0; i < RESAMPLE_STREAMS; i ++ )
+		states_close( self->streams[ i ].states, self->streams[ i ].channels );
+	free( self );
+}
+
+/** Check if converters were continued before others or, when neither was, used before them.
+*/
+
+static int stream_older( resample_stream *stream, resample_stream *other )
+{
+	if ( stream->continued == other->continued )
+		return ( int )( stream->used - other->used ) < 0;
+	return ( int )( stream->continued - other->continued ) < 0;
+}
+
+/** Claim the converters of the sequence that the position continues or, failing
+    that, the ones continued least recently to start a new sequence.
+
+    \return the claimed stream or NULL when the converters are busy
+*/
+
+static resample_stream *stream_claim( resampler self, mlt_position position, int *continued )
+{
+	int tried = 0;
+	int i;
+
+	for ( i = 0; i < RESAMPLE_STREAMS; i ++ )
+	{
+		resample_stream *stream = &self->streams[ i ];
+		if ( stream->next == position && __sync_bool_compare_and_swap( &stream->busy, 0, 1 ) )
+		{
+			// Check again now that no other thread can move it on
+			if ( stream->states != NULL && stream->next == position )
+			{
+				*continued = 1;
+				return stream;
+			}
+			__sync_lock_release( &stream->busy );
+		}
+	}
+
+	*continued = 0;
+	while ( 1 )
+	{
+		resample_stream *oldest = NULL;
+		int index = 0;
+
+		for ( i = 0; i < RESAMPLE_STREAMS; i ++ )
+		{
+			resample_stream *stream = &self->streams[ i ];
+			if ( !( tried & ( 1 << i ) ) && !stream->busy && ( oldest == NULL || stream_older( stream, oldest ) ) )
+			{
+				oldest = stream;
+				index = i;
+			}
+		}
+		if ( oldest == NULL || __sync_bool_compare_and_swap( &oldest->busy, 0, 1 ) )
+			return oldest;
+		tried |= 1 << index;
+	}
+}
+
+/** Let the next frame of the sequence have the converters.
+*/
+
+static void stream_release( resampler self, resample_stream *stream, mlt_position position, int continued )
+{
+	stream->next = position + 1;
+	stream->used = __sync_add_and_fetch( &self->clock, 1 );
+	if ( continued )
+		stream->continued = stream->used;
+	__sync_lock_release( &stream->busy );
+}
 
 /** Get the audio.
 */
@@ -55,8 +198,19 @@ static int resample_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 	if ( error ) return error;
 
 	// Return now if no work to do
-	if ( output_rate != *frequency )
+	if ( output_rate != *frequency && *samples > 0 && *channels > 0 )
 	{
+		resampler self = mlt_properties_get_data( filter_properties, "resampler", NULL );
+		mlt_position position = mlt_frame_get_position( frame );
+		double ratio = ( double ) output_rate / ( double ) *frequency;
+		int capacity = *samples * ratio + 16;
+		float *output = NULL;
+		resample_stream *stream = NULL;
+		SRC_STATE **states = NULL;
+		int continued = 0;
+		int generated = 0;
+		int c;
+
 		mlt_log_debug( MLT_FILTER_SERVICE(filter), "channels %d samples %d frequency %d -> %d\n",
 			*channels, *samples, *frequency, output_rate );
 
@@ -64,74 +218,72 @@ static int resample_get_audio( mlt_frame frame, void **buffer, mlt_audio_format
 		if ( *format != mlt_audio_float )
 		{
 			*format = mlt_audio_float;
-			mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
-		}
-
-		mlt_service_lock( MLT_FILTER_SERVICE(filter) );
-
-		float *input_buffer = mlt_properties_get_data( filter_properties, "input_buffer", NULL );
-		float *output_buffer = mlt_properties_get_data( filter_properties, "output_buffer", NULL );
-		SRC_DATA data;
-		data.data_in = input_buffer;
-		data.data_out = output_buffer;
-		data.src_ratio = ( float ) output_rate / ( float ) *frequency;
-		data.input_frames = *samples;
-		data.output_frames = BUFFER_LEN / *channels;
-		data.end_of_input = 0;
-
-		SRC_STATE *state = mlt_properties_get_data( filter_properties, "state", NULL );
-		if ( !state || mlt_properties_get_int( filter_properties, "channels" ) != *channels )
-		{
-			// Recreate the resampler if the number of channels changed
-			state = src_new( RESAMPLE_TYPE, *channels, &error );
-			mlt_properties_set_data( filter_properties, "state", state, 0, (mlt_destructor) src_delete, NULL );
-			mlt_properties_set_int( filter_properties, "channels", *channels );
+			error = mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
+			if ( error ) return error;
 		}
 
-		// Convert to interleaved
-		float *q = (float*) *buffer;
-		float *p = input_buffer;
-		int s, c;
-		for ( s = 0; s < *samples; s++ )
-			for ( c = 0; c < *channels; c++ )
-				*p++ = *( q + c * *samples + s );
-
-		// Resample the audio
-		error = src_process( state, &data );
-		if ( !error )
+		// Continue the converters of the sequence this frame belongs to
+		if ( self != NULL )
+			stream = stream_claim( self, position, &continued );
+		if ( stream != NULL )
 		{
-			int size = data.output_frames_gen * *channels * sizeof(float);
-
-			// Resize if necessary
-			if ( data.output_frames_gen > *samples )
+			if ( stream->states == NULL || stream->channels != *channels )
 			{
-				*buffer = mlt_pool_realloc( *buffer, size );
-				mlt_frame_set_audio( frame, *buffer, *format, size, mlt_pool_release );
+				states_close( stream->states, stream->channels );
+				stream->states = states_init( *channels, &error );
+				stream->channels = stream->states ? *channels : 0;
 			}
-
-			// Convert to non-interleaved
-			p = (float*) *buffer;
-			for ( c = 0; c < *channels; c++ )
+			else if ( !continued )
 			{
-				float *q = output_buffer + c;
-				int i = data.output_frames_gen + 1;
-				while ( --i  )
-				{
-					*p++ = *q;
-					q += *channels;
-				}
+				for ( c = 0; c < *channels; c ++ )
+					src_reset( stream->states[ c ] );
 			}
+			states = stream->states;
+		}
+		else
+		{
+			states = states_init( *channels, &error );
+		}
 
-			// Update output variables
-			*samples = data.output_frames_gen;
-			*frequency = output_rate;
+		// Size the output for the ratio, with room for rounding
+		if ( states != NULL )
+			output = mlt_pool_alloc( capacity * *channels * sizeof( float ) );
 
+		// Every converter makes as many samples from the same input, so the
+		// count of the first places the planes of the others
+		for ( c = 0; output != NULL && !error && c < *channels; c ++ )
+		{
+			SRC_DATA data;
+			data.data_in = ( float* )*buffer + c * *samples;
+			data.data_out = output + c * generated;
+			data.input_frames = *samples;
+			data.output_frames = capacity;
+			data.src_ratio = ratio;
+			data.end_of_input = 0;
+			error = src_process( states[ c ], &data );
+			if ( c == 0 )
+				generated = data.output_frames_gen;
 		}
+
+		if ( stream != NULL )
+			stream_release( self, stream, position, continued );
 		else
+			states_close( states, *channels );
+
+		if ( output != NULL && !error )
 		{
+			mlt_frame_set_audio( frame, output, *format, capacity * *channels * sizeof( float ), mlt_pool_release );
+			*buffer = output;
+			*samples = generated;
+			*frequency = output_rate;
+		}
+		else
+		{
+			mlt_pool_release( output );
+			if ( !error )
+				error = 1;
 			mlt_log_error( MLT_FILTER_SERVICE( filter ), "%s %d,%d,%d\n", src_strerror( error ), *frequency, *samples, output_rate );
 		}
-		mlt_service_unlock( MLT_FILTER_SERVICE(filter) );
 	}
 
 	return error;
@@ -157,26 +309,19 @@ static mlt_frame filter_process( mlt_filter this, mlt_frame frame )
 mlt_filter filter_resample_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
 {
 	mlt_filter this = mlt_filter_new( );
-	if ( this != NULL )
+	resampler self = calloc( 1, sizeof( struct resampler_s ) );
+	if ( this != NULL && self != NULL )
 	{
-		int error;
-		SRC_STATE *state = src_new( RESAMPLE_TYPE, 2 /* channels */, &error );
-		if ( error == 0 )
-		{
-			void *input_buffer = mlt_pool_alloc( BUFFER_LEN );
-			void *output_buffer = mlt_pool_alloc( BUFFER_LEN );
-			this->process = filter_process;
-			if ( arg != NULL )
-				mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "frequency", atoi( arg ) );
-			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "channels", 2 );
-			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "state", state, 0, (mlt_destructor)src_delete, NULL );
-			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "input_buffer", input_buffer, BUFFER_LEN, mlt_pool_release, NULL );
-			mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "output_buffer", output_buffer, BUFFER_LEN, mlt_pool_release, NULL );
-		}
-		else
-		{
-			fprintf( stderr, "filter_resample_init: %s\n", src_strerror( error ) );
-		}
+		this->process = filter_process;
+		if ( arg != NULL )
+			mlt_properties_set_int( MLT_FILTER_PROPERTIES( this ), "frequency", atoi( arg ) );
+		mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), "resampler", self, 0, ( mlt_destructor )resampler_close, NULL );
+	}
+	else
+	{
+		mlt_filter_close( this );
+		free( self );
+		this = NULL;
 	}
 	return this;
 }
@@ -46,10 +46,14 @@ struct consumer_sdl_s
 	pthread_t thread;
 	int joined;
 	int running;
-	uint8_t audio_buffer[ 4096 * 10 ];
-	int audio_avail;
-	pthread_mutex_t audio_mutex;
-	pthread_cond_t audio_cond;
+	uint8_t *audio_buffer;              // ring of interleaved s16, written by the consumer thread
+	unsigned int audio_size;            // and read by the SDL callback without locking;
+	volatile unsigned int audio_read;   // the capacity is a power of two and the positions
+	volatile unsigned int audio_write;  // are free running byte counters
+	volatile int audio_flush;
+	volatile int64_t audio_callback_time;
+	int audio_limit;
+	int audio_device_size;
 	pthread_mutex_t video_mutex;
 	pthread_cond_t video_cond;
 	int playing;
@@ -98,8 +102,6 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 		mlt_properties_set_double( this->properties, "volume", 1.0 );
 
 		// This is the initialisation of the consumer
-		pthread_mutex_init( &this->audio_mutex, NULL );
-		pthread_cond_init( &this->audio_cond, NULL);
 		pthread_mutex_init( &this->video_mutex, NULL );
 		pthread_cond_init( &this->video_cond, NULL);
 
@@ -113,6 +115,9 @@ mlt_consumer consumer_sdl_audio_init( mlt_profile profile, mlt_service_type type
 		// Default audio buffer
 		mlt_properties_set_int( this->properties, "audio_buffer", 2048 );
 
+		// Default amount of audio queued ahead of the device in milliseconds
+		mlt_properties_set_int( this->properties, "audio_latency", 200 );
+
 		// Ensure we don't join on a non-running object
 		this->joined = 1;
 		
@@ -201,11 +206,6 @@ int consumer_stop( mlt_consumer parent )
 		pthread_cond_broadcast( &this->video_cond );
 		pthread_mutex_unlock( &this->video_mutex );
 
-		// Unlatch the audio callback
-		pthread_mutex_lock( &this->audio_mutex );
-		pthread_cond_broadcast( &this->audio_cond );
-		pthread_mutex_unlock( &this->audio_mutex );
-
 		if ( this->playing )
 			SDL_QuitSubSystem( SDL_INIT_AUDIO );
 	}
@@ -219,6 +219,38 @@ int consumer_is_stopped( mlt_consumer parent )
 	return !this->running;
 }
 
+static int64_t time_now( )
+{
+	struct timeval now;
+	gettimeofday( &now, NULL );
+	return ( int64_t )now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/** Copy between a linear buffer and the ring at a free running position.
+*/
+
+static void ring_copy( consumer_sdl this, unsigned int position, uint8_t *data, int len, int to_ring, int volume )
+{
+	unsigned int offset = position & ( this->audio_size - 1 );
+	int first = this->audio_size - offset < len ? this->audio_size - offset : len;
+
+	if ( to_ring )
+	{
+		memcpy( this->audio_buffer + offset, data, first );
+		memcpy( this->audio_buffer, data + first, len - first );
+	}
+	else if ( volume != SDL_MIX_MAXVOLUME )
+	{
+		SDL_MixAudio( data, this->audio_buffer + offset, first, volume );
+		SDL_MixAudio( data + first, this->audio_buffer, len - first, volume );
+	}
+	else
+	{
+		memcpy( data, this->audio_buffer + offset, first );
+		memcpy( data + first, this->audio_buffer, len - first );
+	}
+}
+
 static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
 {
 	consumer_sdl this = udata;
@@ -226,43 +258,73 @@ static void sdl_fill_audio( void *udata, uint8_t *stream, int len )
 	// Get the volume
 	double volume = mlt_properties_get_double( this->properties, "volume" );
 
-	pthread_mutex_lock( &this->audio_mutex );
-
-	// Block until audio received
-	while ( this->running && len > this->audio_avail )
-		pthread_cond_wait( &this->audio_cond, &this->audio_mutex );
-
-	if ( this->audio_avail >= len )
+	// Drop what is queued when asked to, the writer never moves the read position
+	if ( this->audio_flush )
 	{
-		// Place in the audio buffer
-		if ( volume != 1.0 )
-			SDL_MixAudio( stream, this->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
-		else
-			memcpy( stream, this->audio_buffer, len );
+		this->audio_read = this->audio_write;
+		this->audio_flush = 0;
+	}
 
-		// Remove len from the audio available
-		this->audio_avail -= len;
+	unsigned int avail = this->audio_write - this->audio_read;
+	int bytes = avail < len ? avail : len;
 
-		// Remove the samples
-		memmove( this->audio_buffer, this->audio_buffer + len, this->audio_avail );
-	}
-	else
-	{
-		// Just to be safe, wipe the stream first
+	// Silence whatever the ring can not provide rather than block the device
+	if ( bytes < len || volume != 1.0 )
 		memset( stream, 0, len );
 
-		// Mix the audio 
-		SDL_MixAudio( stream, this->audio_buffer, len, ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) );
+	if ( bytes > 0 )
+	{
+		// Read the samples only once their position is published
+		__sync_synchronize( );
+		ring_copy( this, this->audio_read, stream, bytes, 0, volume != 1.0 ? ( int )( ( float )SDL_MIX_MAXVOLUME * volume ) : SDL_MIX_MAXVOLUME );
 
-		// No audio left
-		this->audio_avail = 0;
+		// Finish reading before releasing the space to the consumer thread
+		__sync_synchronize( );
+		this->audio_read += bytes;
 	}
 
+	// Remember when the device took the buffer to measure the delay
+	this->audio_callback_time = time_now( );
+
 	// We're definitely playing now
 	this->playing = 1;
+}
+
+/** Append audio to the ring, waiting while it holds more than the target latency.
+*/
+
+static void ring_write( consumer_sdl this, uint8_t *data, int bytes, int frame_size )
+{
+	struct timespec tm = { 0, 1000000 };
 
-	pthread_cond_broadcast( &this->audio_cond );
-	pthread_mutex_unlock( &this->audio_mutex );
+	while ( this->running && bytes > 0 )
+	{
+		int space = this->audio_limit - ( int )( this->audio_write - this->audio_read );
+		int chunk = space < bytes ? space - space % frame_size : bytes;
+
+		if ( chunk <= 0 )
+		{
+			nanosleep( &tm, NULL );
+			continue;
+		}
+		if ( data )
+		{
+			ring_copy( this, this->audio_write, data, chunk, 1, SDL_MIX_MAXVOLUME );
+			data += chunk;
+		}
+		else
+		{
+			unsigned int offset = this->audio_write & ( this->audio_size - 1 );
+			int first = this->audio_size - offset < chunk ? this->audio_size - offset : chunk;
+			memset( this->audio_buffer + offset, 0, first );
+			memset( this->audio_buffer, 0, chunk - first );
+		}
+
+		// Publish the samples before the position for the callback
+		__sync_synchronize( );
+		this->audio_write += chunk;
+		bytes -= chunk;
+	}
 }
 
 static int consumer_play_audio( consumer_sdl this, mlt_frame frame, int init_audio, int *duration )
@@ -314,6 +376,25 @@ static int consumer_play_audio( consumer_sdl this, mlt_frame frame, int init_aud
 		}
 		else if ( got.size != 0 )
 		{
+			// Size the ring for the target latency, but always for two device buffers
+			int frame_size = channels * 2;
+			int latency = mlt_properties_get_int( properties, "audio_latency" );
+			int limit = ( int64_t ) latency * frequency / 1000 * frame_size;
+			if ( limit < 2 * ( int ) got.size )
+				limit = 2 * got.size;
+			limit -= limit % frame_size;
+
+			free( this->audio_buffer );
+			this->audio_size = 4096;
+			while ( this->audio_size < limit )
+				this->audio_size <<= 1;
+			this->audio_buffer = malloc( this->audio_size );
+			this->audio_limit = limit;
+			this->audio_device_size = got.size;
+			this->audio_read = this->audio_write = 0;
+			this->audio_flush = 0;
+			this->audio_callback_time = 0;
+
 			SDL_PauseAudio( 0 );
 			init_audio = 0;
 		}
@@ -321,21 +402,32 @@ static int consumer_play_audio( consumer_sdl this, mlt_frame frame, int init_aud
 
 	if ( init_audio == 0 )
 	{
-		mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+		mlt_properties frame_properties = MLT_FRAME_PROPERTIES( frame );
+		int bytes_per_second = frequency * channels * 2;
 		bytes = ( samples * channels * 2 );
-		pthread_mutex_lock( &this->audio_mutex );
-		while ( this->running && bytes > ( sizeof( this->audio_buffer) - this->audio_avail ) )
-			pthread_cond_wait( &this->audio_cond, &this->audio_mutex );
-		if ( this->running )
+
+		if ( mlt_properties_get_double( frame_properties, "_speed" ) == 1 )
 		{
-			if ( mlt_properties_get_double( properties, "_speed" ) == 1 )
-				memcpy( &this->audio_buffer[ this->audio_avail ], pcm, bytes );
-			else
-				memset( &this->audio_buffer[ this->audio_avail ], 0, bytes );
-			this->audio_avail += bytes;
+			ring_write( this, ( uint8_t* ) pcm, bytes, channels * 2 );
+		}
+		else
+		{
+			// Stale audio would lag behind a seek or scrub, so drop it
+			this->audio_flush = 1;
+			ring_write( this, NULL, bytes, channels * 2 );
+		}
+
+		// Measure the delay until the last sample written is heard: what is
+		// queued here plus what is left of the buffer the device last took
+		int64_t callback_time = this->audio_callback_time;
+		if ( callback_time > 0 && bytes_per_second > 0 )
+		{
+			int64_t device = this->audio_device_size - ( time_now( ) - callback_time ) * bytes_per_second / 1000000;
+			if ( device < 0 )
+				device = 0;
+			device += this->audio_write - this->audio_read;
+			mlt_properties_set_int( properties, "audio_delay", device * 1000 / bytes_per_second );
 		}
-		pthread_cond_broadcast( &this->audio_cond );
-		pthread_mutex_unlock( &this->audio_mutex );
 	}
 	else
 	{
@@ -573,7 +665,7 @@ static void *consumer_thread( void *arg )
 	while( mlt_deque_count( this->queue ) )
 		mlt_frame_close( mlt_deque_pop_back( this->queue ) );
 
-	this->audio_avail = 0;
+	this->audio_read = this->audio_write;
 
 	return NULL;
 }
@@ -596,13 +688,12 @@ static void consumer_close( mlt_consumer parent )
 	mlt_deque_close( this->queue );
 
 	// Destroy mutexes
-	pthread_mutex_destroy( &this->audio_mutex );
-	pthread_cond_destroy( &this->audio_cond );
 	pthread_mutex_destroy( &this->video_mutex );
 	pthread_cond_destroy( &this->video_cond );
 	pthread_mutex_destroy( &this->refresh_mutex );
 	pthread_cond_destroy( &this->refresh_cond );
 
 	// Finally clean up this
+	free( this->audio_buffer );
 	free( this );
 }
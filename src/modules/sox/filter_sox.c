@@ -27,8 +27,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-
-// TODO: does not support multiple effects with SoX v14.1.0+
+#include <sys/time.h>
 
 #ifdef SOX14
 #	include <sox.h>
@@ -54,7 +53,6 @@
 #	include <st.h>
 #endif
 
-#define BUFFER_LEN 8192
 #define AMPLITUDE_NORM 0.2511886431509580 /* -12dBFS */
 #define AMPLITUDE_MIN 0.00001
 
@@ -80,37 +78,85 @@ static inline double mean( double *buf, int count )
 	return mean;
 }
 
-#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
-static void delete_effect( eff_t effp )
+/** The effect chain.
+
+    Effects are started once for each channel when the effect properties,
+    the sample rate or the number of channels change, and then every frame
+    streams through them. Each plane of the frame ping-pongs between its
+    place in the frame and one scratch buffer, so chained effects are not
+    copied between.
+*/
+
+typedef struct sox_chain_s
 {
+	char *spec;        // the effect properties the chain was built from
+	int count;         // the number of effects
+	int channels;
+	int frequency;
+	eff_t *effects;    // count effects for each channel
+	double *times;     // the total processing time of each effect in seconds
+	int frames;        // the number of frames processed
+	st_sample_t *scratch;
+	int scratch_size;
+}
+*sox_chain;
+
+static void close_effect( eff_t effp )
+{
+	// Stop the effect to release what it allocated when started
+#ifdef SOX14
+	( * effp->handler.stop )( effp );
+#else
+	( * effp->h->stop )( effp );
+#endif
+#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
 	free( effp->priv );
 	free( (void*)effp->in_encoding );
 	free( effp );
-}
+#else
+	mlt_pool_release( effp );
 #endif
+}
+
+static void chain_close( sox_chain chain )
+{
+	int i;
+	for ( i = 0; i < chain->count * chain->channels; i ++ )
+		if ( chain->effects[ i ] != NULL )
+			close_effect( chain->effects[ i ] );
+	free( chain->effects );
+	free( chain->times );
+	free( chain->spec );
+	mlt_pool_release( chain->scratch );
+	free( chain );
+}
 
-/** Create an effect state instance for a channels
+/** Create and start an effect for one channel.
 */
-static int create_effect( mlt_filter this, char *value, int count, int channel, int frequency )
+static eff_t create_effect( char *value, int frequency )
 {
 	mlt_tokeniser tokeniser = mlt_tokeniser_init();
-	char id[ 256 ];
 	int error = 1;
 
 	// Tokenise the effect specification
 	mlt_tokeniser_parse_new( tokeniser, value, " " );
 	if ( tokeniser->count < 1 )
-		return error;
+	{
+		mlt_tokeniser_close( tokeniser );
+		return NULL;
+	}
 
 	// Locate the effect
-	mlt_destructor effect_destructor = mlt_pool_release;
 #ifdef SOX14
 	//fprintf(stderr, "%s: effect %s count %d\n", __FUNCTION__, tokeniser->tokens[0], tokeniser->count );
 #if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
 	sox_effect_handler_t const *eff_handle = sox_find_effect( tokeniser->tokens[0] );
-	if (eff_handle == NULL ) return error;
+	if ( eff_handle == NULL )
+	{
+		mlt_tokeniser_close( tokeniser );
+		return NULL;
+	}
 	eff_t eff = sox_create_effect( eff_handle );
-	effect_destructor = ( mlt_destructor ) delete_effect;
 	sox_encodinginfo_t *enc = calloc( 1, sizeof( sox_encodinginfo_t ) );
 	enc->encoding = SOX_ENCODING_SIGN2;
 	enc->bits_per_sample = 16;
@@ -162,23 +208,100 @@ static int create_effect( mlt_filter this, char *value, int count, int channel,
 #else
 			if ( ( * eff->h->start )( eff ) == ST_SUCCESS )
 #endif
-			{
-				// Construct id
-				sprintf( id, "_effect_%d_%d", count, channel );
-
-				// Save the effect state
-				mlt_properties_set_data( MLT_FILTER_PROPERTIES( this ), id, eff, 0, effect_destructor, NULL );
 				error = 0;
-			}
 		}
 	}
+
 	// Some error occurred so delete the temp effect state
 	if ( error == 1 )
-		effect_destructor( eff );
+	{
+#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
+		free( eff->priv );
+		free( (void*)eff->in_encoding );
+		free( eff );
+#else
+		mlt_pool_release( eff );
+#endif
+		eff = NULL;
+	}
 	
 	mlt_tokeniser_close( tokeniser );
 	
-	return error;
+	return eff;
+}
+
+/** Get the effect chain, building it again if anything it depends on changed.
+*/
+static sox_chain get_chain( mlt_filter filter, int frequency, int channels )
+{
+	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
+	sox_chain chain = mlt_properties_get_data( filter_properties, "_chain", NULL );
+	int n = mlt_properties_count( filter_properties );
+	char *spec = NULL;
+	int size = 1;
+	int count = 0;
+	int i, c;
+
+	// Gather the effect properties in order
+	for ( i = 0; i < n; i ++ )
+	{
+		char *name = mlt_properties_get_name( filter_properties, i );
+		char *value = mlt_properties_get_value( filter_properties, i );
+		if ( !strncmp( name, "effect", 6 ) && value != NULL )
+		{
+			spec = realloc( spec, size + strlen( value ) + 1 );
+			if ( size == 1 )
+				spec[ 0 ] = 0;
+			strcat( spec, value );
+			strcat( spec, "\n" );
+			size += strlen( value ) + 1;
+			count ++;
+		}
+	}
+
+	if ( chain != NULL && chain->frequency == frequency && chain->channels == channels
+	     && ( spec == chain->spec || ( spec && chain->spec && !strcmp( spec, chain->spec ) ) ) )
+	{
+		free( spec );
+		return chain;
+	}
+
+	// Build a new chain, skipping effects that fail to start
+	chain = calloc( 1, sizeof( struct sox_chain_s ) );
+	chain->spec = spec;
+	chain->frequency = frequency;
+	chain->channels = channels;
+	chain->effects = calloc( count * channels + 1, sizeof( eff_t ) );
+	chain->times = calloc( count + 1, sizeof( double ) );
+	for ( i = 0; i < n; i ++ )
+	{
+		char *name = mlt_properties_get_name( filter_properties, i );
+		char *value = mlt_properties_get_value( filter_properties, i );
+		eff_t *effects = &chain->effects[ chain->count * channels ];
+
+		if ( strncmp( name, "effect", 6 ) || value == NULL )
+			continue;
+
+		// Even though some effects are multi-channel aware, it is not reliable
+		// We must maintain a separate effect state for each channel
+		for ( c = 0; c < channels; c ++ )
+			if ( ( effects[ c ] = create_effect( value, frequency ) ) == NULL )
+				break;
+		if ( c == channels )
+		{
+			chain->count ++;
+		}
+		else
+		{
+			mlt_log_warning( MLT_FILTER_SERVICE( filter ), "failed to start effect %s\n", value );
+			while ( c-- )
+				close_effect( effects[ c ] );
+			memset( effects, 0, channels * sizeof( eff_t ) );
+		}
+	}
+	mlt_properties_set_data( filter_properties, "_chain", chain, 0, ( mlt_destructor )chain_close, NULL );
+
+	return chain;
 }
 
 /** Get the audio.
@@ -195,80 +318,38 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 	// Get the filter properties
 	mlt_properties filter_properties = MLT_FILTER_PROPERTIES( filter );
 
-	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
-
-	// Get the properties
-	st_sample_t *input_buffer;// = mlt_properties_get_data( filter_properties, "input_buffer", NULL );
-	st_sample_t *output_buffer = mlt_properties_get_data( filter_properties, "output_buffer", NULL );
 	int i; // channel
-	int count = mlt_properties_get_int( filter_properties, "_effect_count" );
 
 	// Get the producer's audio
 	*format = mlt_audio_s32;
 	mlt_frame_get_audio( frame, buffer, format, frequency, channels, samples );
 
-	// Even though some effects are multi-channel aware, it is not reliable
-	// We must maintain a separate effect state for each channel
+	mlt_service_lock( MLT_FILTER_SERVICE( filter ) );
+
+	sox_chain chain = get_chain( filter, *frequency, *channels );
+	int count = chain->count;
+
+	// Make sure the scratch buffer can hold a plane
+	if ( *samples > chain->scratch_size )
+	{
+		mlt_pool_release( chain->scratch );
+		chain->scratch = mlt_pool_alloc( *samples * sizeof( st_sample_t ) );
+		chain->scratch_size = *samples;
+	}
+
 	for ( i = 0; i < *channels; i++ )
 	{
-		char id[ 256 ];
-		sprintf( id, "_effect_0_%d", i );
-		
-		// Get an existing effect state
-		eff_t e = mlt_properties_get_data( filter_properties, id, NULL );
-		
-		// Validate the existing effect state
-#if (ST_LIB_VERSION_CODE >= ST_LIB_VERSION(14,1,0))
-		if ( e != NULL && ( e->in_signal.rate != *frequency || 
-							e->out_signal.rate != *frequency ) )
-#else
-		if ( e != NULL && ( e->ininfo.rate != *frequency || 
-							e->outinfo.rate != *frequency ) )
-#endif
-			e = NULL;
-		
-		// (Re)Create the effect state
-		if ( e == NULL )
-		{
-			int j = 0;
-			
-			// Reset the count
-			count = 0;
-	
-			// Loop over all properties
-			for ( j = 0; j < mlt_properties_count( filter_properties ); j ++ )
-			{
-				// Get the name of this property
-				char *name = mlt_properties_get_name( filter_properties, j );
-	
-				// If the name does not contain a . and matches effect
-				if ( !strncmp( name, "effect", 6 ) )
-				{
-					// Get the effect specification
-					char *value = mlt_properties_get_value( filter_properties, j );
-	
-					// Create an instance
-					if ( create_effect( filter, value, count, i, *frequency ) == 0 )
-						count ++;
-				}
-			}
-			
-			// Save the number of filters
-			mlt_properties_set_int( filter_properties, "_effect_count", count );
-			
-		}
 		if ( *samples > 0 && count > 0 )
 		{
-			input_buffer = (st_sample_t*) *buffer + i * *samples;
+			st_sample_t *input_buffer = (st_sample_t*) *buffer + i * *samples;
 			st_sample_t *p = input_buffer;
-			st_size_t isamp = *samples;
-			st_size_t osamp = *samples;
+			st_sample_t *in = input_buffer;
+			st_sample_t *out = chain->scratch;
 			double rms = 0;
 			int j = *samples + 1;
 			char *normalise = mlt_properties_get( filter_properties, "normalise" );
 			double normalised_gain = 1.0;
 			
-			// Convert from interleaved
 			while( --j )
 			{
 				// Compute rms amplitude while we are accessing each sample
@@ -318,51 +399,73 @@ static int filter_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *f
 			// For each effect
 			for ( j = 0; j < count; j++ )
 			{
-				sprintf( id, "_effect_%d_%d", j, i );
-				e = mlt_properties_get_data( filter_properties, id, NULL );
+				eff_t e = chain->effects[ j * *channels + i ];
+				st_size_t isamp = *samples;
+				st_size_t osamp = *samples;
+				float saved_gain = 1.0;
+				struct timeval start, end;
 				
-				// We better have this guy
-				if ( e != NULL )
-				{
-					float saved_gain = 1.0;
-					
-					// XXX: hack to apply the normalised gain level to the vol effect
+				// XXX: hack to apply the normalised gain level to the vol effect
 #ifdef SOX14
-					if ( normalise && strcmp( e->handler.name, "vol" ) == 0 )
+				if ( normalise && strcmp( e->handler.name, "vol" ) == 0 )
 #else
-					if ( normalise && strcmp( e->name, "vol" ) == 0 )
+				if ( normalise && strcmp( e->name, "vol" ) == 0 )
 #endif
-					{
-						float *f = ( float * )( e->priv );
-						saved_gain = *f;
-						*f = saved_gain * normalised_gain;
-					}
-					
-					// Apply the effect
+				{
+					float *f = ( float * )( e->priv );
+					saved_gain = *f;
+					*f = saved_gain * normalised_gain;
+				}
+				
+				// Apply the effect
+				gettimeofday( &start, NULL );
 #ifdef SOX14
-					if ( ( * e->handler.flow )( e, input_buffer, output_buffer, &isamp, &osamp ) != ST_SUCCESS )
+				if ( ( * e->handler.flow )( e, in, out, &isamp, &osamp ) != ST_SUCCESS )
 #else
-					if ( ( * e->h->flow )( e, input_buffer, output_buffer, &isamp, &osamp ) != ST_SUCCESS )
+				if ( ( * e->h->flow )( e, in, out, &isamp, &osamp ) != ST_SUCCESS )
 #endif
-					{
-						mlt_log_warning( MLT_FILTER_SERVICE(filter), "effect processing failed\n" );
-					}
-					
-					// XXX: hack to restore the original vol gain to prevent accumulation
+				{
+					mlt_log_warning( MLT_FILTER_SERVICE(filter), "effect processing failed\n" );
+				}
+				gettimeofday( &end, NULL );
+				chain->times[ j ] += ( end.tv_sec - start.tv_sec ) + ( end.tv_usec - start.tv_usec ) / 1000000.0;
+
+				// Silence what a buffering effect did not produce yet
+				if ( osamp < *samples )
+					memset( out + osamp, 0, ( *samples - osamp ) * sizeof( st_sample_t ) );
+				
+				// XXX: hack to restore the original vol gain to prevent accumulation
 #ifdef SOX14
-					if ( normalise && strcmp( e->handler.name, "vol" ) == 0 )
+				if ( normalise && strcmp( e->handler.name, "vol" ) == 0 )
 #else
-					if ( normalise && strcmp( e->name, "vol" ) == 0 )
+				if ( normalise && strcmp( e->name, "vol" ) == 0 )
 #endif
-					{
-						float *f = ( float * )( e->priv );
-						*f = saved_gain;
-					}
+				{
+					float *f = ( float * )( e->priv );
+					*f = saved_gain;
 				}
+
+				// The output of this effect is the input of the next
+				p = in;
+				in = out;
+				out = p;
 			}
 
-			// Write back
-			memcpy( input_buffer, output_buffer, *samples * sizeof(st_sample_t) );
+			// Write back if the last effect wrote to the scratch buffer
+			if ( in != input_buffer )
+				memcpy( input_buffer, in, *samples * sizeof(st_sample_t) );
+		}
+	}
+
+	// Report the mean processing time per frame of each effect
+	if ( count > 0 && *samples > 0 )
+	{
+		char name[ 32 ];
+		chain->frames ++;
+		for ( i = 0; i < count; i ++ )
+		{
+			snprintf( name, sizeof( name ), "time.%d", i );
+			mlt_properties_set_double( filter_properties, name, chain->times[ i ] * 1000.0 / chain->frames );
 		}
 	}
 
@@ -407,8 +510,6 @@ mlt_filter filter_sox_init( mlt_profile profile, mlt_service_type type, const ch
 	mlt_filter this = mlt_filter_new( );
 	if ( this != NULL )
 	{
-		void *input_buffer = mlt_pool_alloc( BUFFER_LEN );
-		void *output_buffer = mlt_pool_alloc( BUFFER_LEN );
 		mlt_properties properties = MLT_FILTER_PROPERTIES( this );
 		
 		this->process = filter_process;
@@ -427,8 +528,6 @@ mlt_filter filter_sox_init( mlt_profile profile, mlt_service_type type, const ch
 		}
 		else if ( arg )
 			mlt_properties_set( properties, "effect", arg );
-		mlt_properties_set_data( properties, "input_buffer", input_buffer, BUFFER_LEN, mlt_pool_release, NULL );
-		mlt_properties_set_data( properties, "output_buffer", output_buffer, BUFFER_LEN, mlt_pool_release, NULL );
 		mlt_properties_set_int( properties, "window", 75 );
 	}
 	return this;
@@ -0,0 +1,536 @@
+/*
+ * consumer_mltbin.c -- a binary serialiser of a service network
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <framework/mlt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <libxml/tree.h>
+
+#include "mltbin.h"
+
+#define _x (const xmlChar*)
+#define _s (const char*)
+
+extern xmlDocPtr xml_make_doc( mlt_consumer consumer, mlt_service service );
+
+/** A growable byte buffer.
+*/
+
+typedef struct
+{
+	uint8_t *data;
+	size_t size;
+	size_t used;
+}
+mltbin_buffer;
+
+/** The strings are interned so that names and repeated values are stored once.
+*/
+
+typedef struct
+{
+	mltbin_buffer strings;
+	mltbin_buffer records;
+	uint32_t count;
+	uint32_t *table;
+	uint32_t table_size;
+	size_t *offsets;
+	size_t offsets_size;
+	int error;
+}
+mltbin_writer;
+
+static int consumer_start( mlt_consumer parent );
+static int consumer_is_stopped( mlt_consumer self );
+
+mlt_consumer consumer_mltbin_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg )
+{
+	// Create the consumer object
+	mlt_consumer self = calloc( sizeof( struct mlt_consumer_s ), 1 );
+
+	// If no malloc'd and consumer init ok
+	if ( self != NULL && mlt_consumer_init( self, NULL, profile ) == 0 )
+	{
+		// Allow thread to be started/stopped
+		self->start = consumer_start;
+		self->is_stopped = consumer_is_stopped;
+
+		mlt_properties_set( MLT_CONSUMER_PROPERTIES( self ), "resource", arg );
+
+		// Return the consumer produced
+		return self;
+	}
+
+	// malloc or consumer init failed
+	free( self );
+
+	// Indicate failure
+	return NULL;
+}
+
+static void buffer_put( mltbin_writer *writer, mltbin_buffer *buffer, const void *data, size_t size )
+{
+	if ( buffer->used + size > buffer->size )
+	{
+		size_t new_size = buffer->size ? buffer->size : 4096;
+		uint8_t *new_data;
+		while ( new_size < buffer->used + size )
+			new_size *= 2;
+		new_data = realloc( buffer->data, new_size );
+		if ( new_data == NULL )
+		{
+			writer->error = 1;
+			return;
+		}
+		buffer->data = new_data;
+		buffer->size = new_size;
+	}
+	memcpy( buffer->data + buffer->used, data, size );
+	buffer->used += size;
+}
+
+static void buffer_put_u32( mltbin_writer *writer, mltbin_buffer *buffer, uint32_t value )
+{
+	uint8_t bytes[ 4 ] = { value & 0xff, ( value >> 8 ) & 0xff, ( value >> 16 ) & 0xff, value >> 24 };
+	buffer_put( writer, buffer, bytes, 4 );
+}
+
+static uint32_t string_hash( const char *s, size_t length )
+{
+	uint32_t hash = 2166136261u;
+	while ( length -- )
+		hash = ( hash ^ ( uint8_t )*s ++ ) * 16777619u;
+	return hash;
+}
+
+/** Find the slot of a string in the hash table, which is either empty or holds it.
+*/
+
+static uint32_t *string_slot( mltbin_writer *writer, const char *s, size_t length, uint32_t hash )
+{
+	uint32_t i = hash & ( writer->table_size - 1 );
+	while ( writer->table[ i ] )
+	{
+		uint8_t *entry = writer->strings.data + writer->offsets[ writer->table[ i ] - 1 ];
+		uint32_t entry_length = entry[ 0 ] | ( entry[ 1 ] << 8 ) | ( entry[ 2 ] << 16 ) | ( entry[ 3 ] << 24 );
+		if ( entry_length == length && !memcmp( entry + 4, s, length ) )
+			break;
+		i = ( i + 1 ) & ( writer->table_size - 1 );
+	}
+	return &writer->table[ i ];
+}
+
+static uint32_t string_id( mltbin_writer *writer, const char *s )
+{
+	size_t length = strlen( s );
+	uint32_t hash = string_hash( s, length );
+	uint32_t *slot;
+
+	// Keep the table at most half full
+	if ( writer->count * 2 >= writer->table_size )
+	{
+		uint32_t *old = writer->table;
+		uint32_t old_size = writer->table_size;
+		uint32_t i;
+
+		writer->table_size = old_size ? old_size * 2 : 1024;
+		writer->table = calloc( writer->table_size, sizeof( uint32_t ) );
+		if ( writer->table == NULL )
+		{
+			writer->table = old;
+			writer->table_size = old_size;
+			writer->error = 1;
+			return 0;
+		}
+		for ( i = 0; i < old_size; i ++ )
+		{
+			if ( old[ i ] )
+			{
+				uint8_t *entry = writer->strings.data + writer->offsets[ old[ i ] - 1 ];
+				uint32_t entry_length = entry[ 0 ] | ( entry[ 1 ] << 8 ) | ( entry[ 2 ] << 16 ) | ( entry[ 3 ] << 24 );
+				*string_slot( writer, ( char* )entry + 4, entry_length, string_hash( ( char* )entry + 4, entry_length ) ) = old[ i ];
+			}
+		}
+		free( old );
+	}
+
+	slot = string_slot( writer, s, length, hash );
+	if ( *slot == 0 )
+	{
+		if ( writer->count == writer->offsets_size )
+		{
+			size_t size = writer->offsets_size ? writer->offsets_size * 2 : 1024;
+			size_t *offsets = realloc( writer->offsets, size * sizeof( size_t ) );
+			if ( offsets == NULL )
+			{
+				writer->error = 1;
+				return 0;
+			}
+			writer->offsets = offsets;
+			writer->offsets_size = size;
+		}
+		writer->offsets[ writer->count ] = writer->strings.used;
+		buffer_put_u32( writer, &writer->strings, length );
+		buffer_put( writer, &writer->strings, s, length + 1 );
+		*slot = ++ writer->count;
+	}
+	return *slot - 1;
+}
+
+static void buffer_put_double( mltbin_writer *writer, mltbin_buffer *buffer, double value )
+{
+	union { uint64_t bits; double value; } u;
+	u.value = value;
+	buffer_put_u32( writer, buffer, u.bits & 0xffffffff );
+	buffer_put_u32( writer, buffer, u.bits >> 32 );
+}
+
+/** Check for an int that mlt_property formats as the same text.
+*/
+
+static int int_value( const char *value, int32_t *result )
+{
+	char text[ 32 ];
+	char *end = NULL;
+	long n = strtol( value, &end, 10 );
+
+	if ( value[ 0 ] == 0 || *end || n != ( int32_t )n )
+		return 0;
+	snprintf( text, sizeof( text ), "%d", ( int )n );
+	*result = n;
+	return !strcmp( text, value );
+}
+
+/** Check for a double that mlt_property formats as the same text.
+*/
+
+static int double_value( const char *value, double *result )
+{
+	char text[ 64 ];
+	char *end = NULL;
+	double d = strtod( value, &end );
+
+	if ( value[ 0 ] == 0 || *end || strlen( value ) >= sizeof( text ) )
+		return 0;
+	snprintf( text, sizeof( text ), "%f", d );
+	*result = d;
+	return !strcmp( text, value );
+}
+
+/** Write a value as keyframes, returning 0 with nothing written when the keys
+	would not format as the same text.
+*/
+
+static int put_keyframes( mltbin_writer *writer, const char *value )
+{
+	mltbin_buffer *records = &writer->records;
+	size_t mark = records->used;
+	size_t keys_offset;
+	uint32_t keys = 0;
+	const char *p = value;
+	uint8_t type = mltbin_keyframes;
+	size_t length = strlen( value );
+	char *text;
+	const uint8_t *next = NULL;
+	int ok;
+
+	if ( value[ strspn( value, "0123456789.-%=,:x;" ) ] || strpbrk( value, "%=,:x;" ) == NULL )
+		return 0;
+
+	buffer_put( writer, records, &type, 1 );
+	keys_offset = records->used;
+	buffer_put_u32( writer, records, 0 );
+
+	while ( !writer->error )
+	{
+		size_t span = strspn( p, "-0123456789" );
+		uint8_t has_frame = span > 0 && p[ span ] == '=';
+		size_t values_offset;
+		uint8_t values = 0;
+		uint8_t separator;
+
+		buffer_put( writer, records, &has_frame, 1 );
+		if ( has_frame )
+		{
+			buffer_put_u32( writer, records, strtol( p, NULL, 10 ) );
+			p += span + 1;
+		}
+		values_offset = records->used;
+		buffer_put( writer, records, &values, 1 );
+
+		do
+		{
+			uint8_t flags;
+			char *end = NULL;
+
+			span = strspn( p, "-.0123456789" );
+			if ( span == 0 || values == MLTBIN_KEY_VALUES )
+				goto fail;
+			flags = p[ span ] == '%' ? mltbin_number_percent : 0;
+			if ( strspn( p, "-0123456789" ) == span )
+			{
+				long n = strtol( p, &end, 10 );
+				flags |= mltbin_number_int;
+				buffer_put( writer, records, &flags, 1 );
+				buffer_put_u32( writer, records, n );
+			}
+			else
+			{
+				double d = strtod( p, &end );
+				uint8_t decimals = p + span - strchr( p, '.' ) - 1;
+				flags |= mltbin_number_double;
+				buffer_put( writer, records, &flags, 1 );
+				buffer_put( writer, records, &decimals, 1 );
+				buffer_put_double( writer, records, d );
+			}
+			if ( end != p + span )
+				goto fail;
+			p += span + ( flags & mltbin_number_percent ? 1 : 0 );
+			separator = ( *p == ',' || *p == ':' || *p == 'x' ) ? *p ++ : 0;
+			buffer_put( writer, records, &separator, 1 );
+			values ++;
+		}
+		while ( separator );
+
+		if ( writer->error )
+			goto fail;
+		records->data[ values_offset ] = values;
+		keys ++;
+
+		if ( *p == ';' )
+			p ++;
+		else if ( *p == 0 )
+			break;
+		else
+			goto fail;
+	}
+	if ( writer->error )
+		goto fail;
+
+	records->data[ keys_offset ] = keys & 0xff;
+	records->data[ keys_offset + 1 ] = ( keys >> 8 ) & 0xff;
+	records->data[ keys_offset + 2 ] = ( keys >> 16 ) & 0xff;
+	records->data[ keys_offset + 3 ] = keys >> 24;
+
+	// Only keep the keys when they give back the same text
+	text = malloc( length + 1 );
+	ok = text != NULL &&
+		mltbin_format_keyframes( records->data + keys_offset, records->data + records->used, text, length + 1, &next ) == ( int )length &&
+		next == records->data + records->used && !strcmp( text, value );
+	free( text );
+	if ( ok )
+		return 1;
+
+fail:
+	records->used = mark;
+	return 0;
+}
+
+/** Write a property element that only holds text as a property record with
+	the value in its native type.
+*/
+
+static void put_property( mltbin_writer *writer, const char *name, const char *value )
+{
+	mltbin_buffer *records = &writer->records;
+	uint8_t op = mltbin_property;
+	uint8_t type;
+	int32_t i;
+	double d;
+
+	buffer_put( writer, records, &op, 1 );
+	buffer_put_u32( writer, records, string_id( writer, name ) );
+
+	if ( int_value( value, &i ) )
+	{
+		type = ( !strcmp( name, "in" ) || !strcmp( name, "out" ) || !strcmp( name, "length" ) ) ? mltbin_position : mltbin_int;
+		buffer_put( writer, records, &type, 1 );
+		buffer_put_u32( writer, records, i );
+	}
+	else if ( double_value( value, &d ) )
+	{
+		type = mltbin_double;
+		buffer_put( writer, records, &type, 1 );
+		buffer_put_double( writer, records, d );
+	}
+	else if ( !put_keyframes( writer, value ) )
+	{
+		type = mltbin_string;
+		buffer_put( writer, records, &type, 1 );
+		buffer_put_u32( writer, records, string_id( writer, value ) );
+	}
+}
+
+/** Check for a property element with a name and nothing but text.
+*/
+
+static int is_text_property( xmlNodePtr node )
+{
+	xmlNodePtr child;
+
+	if ( xmlStrcmp( node->name, _x("property") ) || node->properties == NULL ||
+		 node->properties->next != NULL || xmlStrcmp( node->properties->name, _x("name") ) )
+		return 0;
+	for ( child = node->children; child != NULL; child = child->next )
+		if ( child->type != XML_TEXT_NODE )
+			return 0;
+	return 1;
+}
+
+static void serialise_nodes( mltbin_writer *writer, xmlNodePtr node )
+{
+	for ( ; node != NULL && !writer->error; node = node->next )
+	{
+		if ( node->type == XML_ELEMENT_NODE && is_text_property( node ) )
+		{
+			xmlChar *name = xmlGetProp( node, _x("name") );
+			xmlChar *value = xmlNodeGetContent( node );
+			put_property( writer, name ? _s(name) : "", value ? _s(value) : "" );
+			xmlFree( name );
+			xmlFree( value );
+		}
+		else if ( node->type == XML_ELEMENT_NODE )
+		{
+			xmlAttrPtr attr;
+			uint32_t count = 0;
+			uint8_t op = mltbin_start;
+
+			for ( attr = node->properties; attr != NULL; attr = attr->next )
+				count ++;
+
+			buffer_put( writer, &writer->records, &op, 1 );
+			buffer_put_u32( writer, &writer->records, string_id( writer, _s(node->name) ) );
+			buffer_put_u32( writer, &writer->records, count );
+			for ( attr = node->properties; attr != NULL; attr = attr->next )
+			{
+				xmlChar *value = xmlGetProp( node, attr->name );
+				buffer_put_u32( writer, &writer->records, string_id( writer, _s(attr->name) ) );
+				buffer_put_u32( writer, &writer->records, string_id( writer, value ? _s(value) : "" ) );
+				xmlFree( value );
+			}
+
+			serialise_nodes( writer, node->children );
+
+			op = mltbin_end;
+			buffer_put( writer, &writer->records, &op, 1 );
+			buffer_put_u32( writer, &writer->records, string_id( writer, _s(node->name) ) );
+		}
+		else if ( node->type == XML_TEXT_NODE || node->type == XML_CDATA_SECTION_NODE || node->type == XML_ENTITY_REF_NODE )
+		{
+			xmlChar *value = xmlNodeGetContent( node );
+			if ( value != NULL && value[ 0 ] )
+			{
+				uint8_t op = mltbin_text;
+				buffer_put( writer, &writer->records, &op, 1 );
+				buffer_put_u32( writer, &writer->records, string_id( writer, _s(value) ) );
+			}
+			xmlFree( value );
+		}
+	}
+}
+
+static int write_document( xmlDocPtr doc, FILE *file )
+{
+	mltbin_writer writer;
+	uint8_t header[ 8 ] = { 'M', 'L', 'T', 'B', MLTBIN_VERSION, 0, 0, 0 };
+	uint8_t count[ 4 ];
+	int error;
+
+	memset( &writer, 0, sizeof( writer ) );
+	serialise_nodes( &writer, xmlDocGetRootElement( doc ) );
+
+	count[ 0 ] = writer.count & 0xff;
+	count[ 1 ] = ( writer.count >> 8 ) & 0xff;
+	count[ 2 ] = ( writer.count >> 16 ) & 0xff;
+	count[ 3 ] = writer.count >> 24;
+
+	error = writer.error ||
+		fwrite( header, sizeof( header ), 1, file ) != 1 ||
+		fwrite( count, sizeof( count ), 1, file ) != 1 ||
+		( writer.strings.used && fwrite( writer.strings.data, writer.strings.used, 1, file ) != 1 ) ||
+		( writer.records.used && fwrite( writer.records.data, writer.records.used, 1, file ) != 1 );
+
+	free( writer.strings.data );
+	free( writer.records.data );
+	free( writer.table );
+	free( writer.offsets );
+
+	return error;
+}
+
+static int consumer_start( mlt_consumer self )
+{
+	// Get the producer service
+	mlt_service service = mlt_service_producer( MLT_CONSUMER_SERVICE( self ) );
+	if ( service != NULL )
+	{
+		mlt_properties properties = MLT_CONSUMER_PROPERTIES( self );
+		char *resource =  mlt_properties_get( properties, "resource" );
+		xmlDocPtr doc = NULL;
+		FILE *file = stdout;
+
+		// Set the title if provided
+		if ( mlt_properties_get( properties, "title" ) )
+			mlt_properties_set( MLT_SERVICE_PROPERTIES( service ), "title", mlt_properties_get( properties, "title" ) );
+		else if ( mlt_properties_get( MLT_SERVICE_PROPERTIES( service ), "title" ) == NULL )
+			mlt_properties_set( MLT_SERVICE_PROPERTIES( service ), "title", "Anonymous Submission" );
+
+		// Check for a root on the consumer properties and pass to service
+		if ( mlt_properties_get( properties, "root" ) )
+			mlt_properties_set( MLT_SERVICE_PROPERTIES( service ), "root", mlt_properties_get( properties, "root" ) );
+
+		// Specify roots in other cases...
+		if ( resource != NULL && mlt_properties_get( properties, "root" ) == NULL )
+		{
+			// Get the current working directory
+			char *cwd = getcwd( NULL, 0 );
+			mlt_properties_set( MLT_SERVICE_PROPERTIES( service ), "root", cwd );
+			free( cwd );
+		}
+
+		// The document is the same one the xml consumer writes
+		doc = xml_make_doc( self, service );
+
+		if ( resource != NULL && strcmp( resource, "" ) )
+			file = fopen( resource, "wb" );
+
+		if ( file == NULL || write_document( doc, file ) )
+			mlt_log_error( MLT_CONSUMER_SERVICE( self ), "failed to write %s\n", resource ? resource : "stdout" );
+
+		if ( file != NULL && file != stdout )
+			fclose( file );
+		else if ( file != NULL )
+			fflush( file );
+
+		xmlFreeDoc( doc );
+	}
+
+	mlt_consumer_stop( self );
+
+	mlt_consumer_stopped( self );
+
+	return 0;
+}
+
+static int consumer_is_stopped( mlt_consumer self )
+{
+	return 1;
+}
@@ -23,10 +23,14 @@
 
 extern mlt_consumer consumer_xml_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 extern mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_consumer consumer_mltbin_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
+extern mlt_producer producer_mltbin_init( mlt_profile profile, mlt_service_type type, const char *id, char *arg );
 
 MLT_REPOSITORY
 {
 	MLT_REGISTER( consumer_type, "xml", consumer_xml_init );
 	MLT_REGISTER( producer_type, "xml", producer_xml_init );
 	MLT_REGISTER( producer_type, "xml-string", producer_xml_init );
+	MLT_REGISTER( consumer_type, "mltbin", consumer_mltbin_init );
+	MLT_REGISTER( producer_type, "mltbin", producer_mltbin_init );
 }
@@ -0,0 +1,85 @@
+/*
+ * mltbin.h -- the binary project format
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _MLTBIN_H_
+#define _MLTBIN_H_
+
+/* A file holds the elements of an MLT XML document as a stream of records.
+
+	"MLTB", version, 3 reserved bytes
+	u32 string count, then each string as u32 length, bytes and a terminating 0
+	records until the end of the file:
+		mltbin_start, u32 name, u32 attribute count, u32 name and u32 value for each
+		mltbin_text, u32 value
+		mltbin_end, u32 name
+		mltbin_property, u32 name, u8 type and the value:
+			mltbin_string, u32 value
+			mltbin_int or mltbin_position, s32
+			mltbin_double, the 64 bits of the double
+			mltbin_keyframes, u32 key count and for each key:
+				u8 1 and s32 frame when the key has a frame, else u8 0
+				u8 value count and for each value:
+					u8 mltbin_number_int and s32, or mltbin_number_double,
+					u8 decimal places and the 64 bits of the double, the
+					kind or'ed with mltbin_number_percent
+					u8 separator that follows the value, 0 for none
+
+	All integers are little endian and names and values refer to strings by
+	index, so the strings can be used directly from a memory map.
+
+	A property record stands for a property element holding only text. Its
+	value has a type only when the text is exactly how an mlt_property formats
+	that value, and keyframes - such as "0=0,0:100%x100%;25=..." - are only
+	stored as keys when formatting them gives back the same text, so a
+	document read back is the one written.
+*/
+
+#define MLTBIN_VERSION 2
+
+enum
+{
+	mltbin_start = 1,
+	mltbin_text,
+	mltbin_end,
+	mltbin_property
+};
+
+enum
+{
+	mltbin_string = 1,
+	mltbin_int,
+	mltbin_position,
+	mltbin_double,
+	mltbin_keyframes
+};
+
+enum
+{
+	mltbin_number_int = 1,
+	mltbin_number_double = 2,
+	mltbin_number_percent = 4
+};
+
+/** The most values in a keyframe.
+*/
+
+#define MLTBIN_KEY_VALUES 16
+
+extern int mltbin_format_keyframes( const uint8_t *data, const uint8_t *end, char *text, size_t size, const uint8_t **next );
+
+#endif
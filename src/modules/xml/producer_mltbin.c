@@ -0,0 +1,402 @@
+/*
+ * producer_mltbin.c -- a loader of the binary project format
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <framework/mlt.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libxml/parser.h>
+
+#include "mltbin.h"
+
+#define _x (const xmlChar*)
+
+typedef int ( *xml_parser )( xmlSAXHandlerPtr sax, void *user_data, const char *filename, const char *data );
+extern mlt_producer producer_xml_load( mlt_profile profile, char *data, int info, xml_parser parse );
+extern mlt_properties producer_xml_property( void *ctx );
+
+typedef struct
+{
+	const uint8_t *ptr;
+	const uint8_t *end;
+	int error;
+}
+mltbin_reader;
+
+static uint32_t read_u32( mltbin_reader *reader )
+{
+	uint32_t value = 0;
+	if ( reader->end - reader->ptr >= 4 )
+	{
+		value = reader->ptr[ 0 ] | ( reader->ptr[ 1 ] << 8 ) | ( reader->ptr[ 2 ] << 16 ) | ( ( uint32_t )reader->ptr[ 3 ] << 24 );
+		reader->ptr += 4;
+	}
+	else
+	{
+		reader->error = 1;
+	}
+	return value;
+}
+
+static uint32_t read_string( mltbin_reader *reader, uint32_t count )
+{
+	uint32_t index = read_u32( reader );
+	if ( index >= count )
+	{
+		reader->error = 1;
+		index = 0;
+	}
+	return index;
+}
+
+static uint32_t get_u32( const uint8_t *data )
+{
+	return data[ 0 ] | ( data[ 1 ] << 8 ) | ( data[ 2 ] << 16 ) | ( ( uint32_t )data[ 3 ] << 24 );
+}
+
+static double get_double( const uint8_t *data )
+{
+	union { uint64_t bits; double value; } u;
+	u.bits = get_u32( data ) | ( ( uint64_t )get_u32( data + 4 ) << 32 );
+	return u.value;
+}
+
+/** Append to text as snprintf does, counting the length even when it does not fit.
+*/
+
+static void text_printf( char *text, size_t size, size_t *length, const char *format, ... )
+{
+	va_list args;
+	int n;
+	va_start( args, format );
+	n = vsnprintf( text + ( *length < size ? *length : size ), *length < size ? size - *length : 0, format, args );
+	va_end( args );
+	if ( n > 0 )
+		*length += n;
+}
+
+/** Format the keys of a keyframes value as text.
+
+	Up to size bytes of the text are written to text and the position after
+	the value in data is returned in next.
+
+	\return the length of the text or -1 when the keys run past end
+*/
+
+int mltbin_format_keyframes( const uint8_t *data, const uint8_t *end, char *text, size_t size, const uint8_t **next )
+{
+	size_t length = 0;
+	uint32_t keys;
+	uint32_t i;
+
+	if ( size > 0 )
+		text[ 0 ] = 0;
+	if ( end - data < 4 )
+		return -1;
+	keys = get_u32( data );
+	data += 4;
+
+	for ( i = 0; i < keys; i ++ )
+	{
+		int values;
+
+		if ( i > 0 )
+			text_printf( text, size, &length, ";" );
+		if ( end - data < 1 || ( data[ 0 ] && end - data < 5 ) )
+			return -1;
+		if ( *data ++ )
+		{
+			text_printf( text, size, &length, "%d=", ( int32_t )get_u32( data ) );
+			data += 4;
+		}
+		if ( end - data < 1 )
+			return -1;
+		values = *data ++;
+		while ( values -- )
+		{
+			uint8_t flags;
+
+			if ( end - data < 1 )
+				return -1;
+			flags = *data ++;
+			if ( ( flags & 3 ) == mltbin_number_int && end - data >= 5 )
+			{
+				text_printf( text, size, &length, "%d", ( int32_t )get_u32( data ) );
+				data += 4;
+			}
+			else if ( ( flags & 3 ) == mltbin_number_double && end - data >= 10 )
+			{
+				text_printf( text, size, &length, "%.*f", data[ 0 ], get_double( data + 1 ) );
+				data += 9;
+			}
+			else
+			{
+				return -1;
+			}
+			if ( flags & mltbin_number_percent )
+				text_printf( text, size, &length, "%%" );
+			if ( *data )
+				text_printf( text, size, &length, "%c", *data );
+			data ++;
+		}
+	}
+
+	*next = data;
+	return length;
+}
+
+static double read_double( mltbin_reader *reader )
+{
+	double value = 0;
+	if ( reader->end - reader->ptr >= 8 )
+	{
+		value = get_double( reader->ptr );
+		reader->ptr += 8;
+	}
+	else
+	{
+		reader->error = 1;
+	}
+	return value;
+}
+
+/** Set the value of a property record on the service being loaded, or replay it
+	as a property element when that is not possible.
+*/
+
+static void read_property( mltbin_reader *reader, xmlSAXHandlerPtr sax, struct _xmlParserCtxt *xmlcontext, const xmlChar **strings, uint32_t count )
+{
+	const char *name = ( const char* )strings[ read_string( reader, count ) ];
+	mlt_properties properties = NULL;
+	char buffer[ 1024 ];
+	char *allocated = NULL;
+	const char *text = NULL;
+	int32_t int_value = 0;
+	double double_value = 0;
+	uint8_t type = 0;
+
+	if ( reader->ptr < reader->end )
+		type = *reader->ptr ++;
+
+	switch ( type )
+	{
+		case mltbin_string:
+			text = ( const char* )strings[ read_string( reader, count ) ];
+			break;
+		case mltbin_int:
+		case mltbin_position:
+			int_value = read_u32( reader );
+			break;
+		case mltbin_double:
+			double_value = read_double( reader );
+			break;
+		case mltbin_keyframes:
+			{
+				const uint8_t *next = NULL;
+				int length = mltbin_format_keyframes( reader->ptr, reader->end, buffer, sizeof( buffer ), &next );
+				if ( length >= ( int )sizeof( buffer ) && ( allocated = malloc( length + 1 ) ) != NULL )
+					mltbin_format_keyframes( reader->ptr, reader->end, allocated, length + 1, &next );
+				if ( length < 0 || ( length >= ( int )sizeof( buffer ) && allocated == NULL ) )
+					reader->error = 1;
+				else
+					reader->ptr = next;
+				text = allocated ? allocated : buffer;
+			}
+			break;
+		default:
+			reader->error = 1;
+			break;
+	}
+	if ( reader->error )
+	{
+		free( allocated );
+		return;
+	}
+
+	properties = producer_xml_property( xmlcontext );
+	if ( properties != NULL )
+	{
+		if ( type == mltbin_int )
+			mlt_properties_set_int( properties, name, int_value );
+		else if ( type == mltbin_position )
+			mlt_properties_set_position( properties, name, int_value );
+		else if ( type == mltbin_double )
+			mlt_properties_set_double( properties, name, double_value );
+		else
+			mlt_properties_set( properties, name, text );
+	}
+	else
+	{
+		const xmlChar *atts[] = { _x("name"), _x(name), NULL };
+
+		// Format the value as the property element would hold it
+		if ( type == mltbin_int || type == mltbin_position )
+			snprintf( buffer, sizeof( buffer ), "%d", int_value );
+		else if ( type == mltbin_double )
+			snprintf( buffer, sizeof( buffer ), "%f", double_value );
+		if ( text == NULL )
+			text = buffer;
+
+		sax->startElement( xmlcontext, _x("property"), atts );
+		if ( text[ 0 ] )
+			sax->characters( xmlcontext, _x(text), strlen( text ) );
+		sax->endElement( xmlcontext, _x("property") );
+	}
+	free( allocated );
+}
+
+/** Replay the records of a file as SAX events, returning whether it was well formed.
+*/
+
+static int parse_mltbin( xmlSAXHandlerPtr sax, void *user_data, const char *filename, const char *data )
+{
+	struct _xmlParserCtxt xmlcontext;
+	mltbin_reader reader;
+	const xmlChar **strings = NULL;
+	uint32_t *lengths = NULL;
+	const xmlChar **atts = NULL;
+	uint32_t atts_size = 0;
+	uint32_t count = 0;
+	uint32_t i;
+	int depth = 0;
+	struct stat st;
+	void *map;
+	int fd;
+
+	if ( filename == NULL )
+		return -1;
+	fd = open( filename, O_RDONLY );
+	if ( fd < 0 )
+		return -1;
+	if ( fstat( fd, &st ) != 0 || st.st_size < 12 )
+	{
+		close( fd );
+		return 0;
+	}
+	map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if ( map == MAP_FAILED )
+		return -1;
+
+	reader.ptr = map;
+	reader.end = reader.ptr + st.st_size;
+	reader.error = memcmp( reader.ptr, "MLTB", 4 ) || reader.ptr[ 4 ] != MLTBIN_VERSION;
+	reader.ptr += 8;
+
+	// Index the strings where they lie in the map
+	if ( !reader.error )
+	{
+		count = read_u32( &reader );
+		if ( count > ( reader.end - reader.ptr ) / 5 )
+			reader.error = 1;
+	}
+	if ( !reader.error && count > 0 )
+	{
+		strings = malloc( count * sizeof( xmlChar* ) );
+		lengths = malloc( count * sizeof( uint32_t ) );
+		reader.error = strings == NULL || lengths == NULL;
+	}
+	for ( i = 0; i < count && !reader.error; i ++ )
+	{
+		lengths[ i ] = read_u32( &reader );
+		if ( reader.error || lengths[ i ] >= reader.end - reader.ptr || reader.ptr[ lengths[ i ] ] != 0 )
+		{
+			reader.error = 1;
+			break;
+		}
+		strings[ i ] = reader.ptr;
+		reader.ptr += lengths[ i ] + 1;
+	}
+
+	// Every record names a string
+	if ( count == 0 && reader.ptr < reader.end )
+		reader.error = 1;
+
+	// The handlers only use the private data of the parser context
+	memset( &xmlcontext, 0, sizeof( xmlcontext ) );
+	xmlcontext._private = user_data;
+
+	while ( !reader.error && reader.ptr < reader.end )
+	{
+		uint8_t op = *reader.ptr ++;
+		if ( op == mltbin_start )
+		{
+			uint32_t name = read_string( &reader, count );
+			uint32_t n = read_u32( &reader );
+			if ( reader.error || n > ( reader.end - reader.ptr ) / 8 )
+				break;
+			if ( 2 * n + 1 > atts_size )
+			{
+				const xmlChar **new_atts = realloc( atts, ( 2 * n + 1 ) * sizeof( xmlChar* ) );
+				if ( new_atts == NULL )
+				{
+					reader.error = 1;
+					break;
+				}
+				atts = new_atts;
+				atts_size = 2 * n + 1;
+			}
+			for ( i = 0; i < 2 * n; i ++ )
+				atts[ i ] = strings[ read_string( &reader, count ) ];
+			if ( reader.error )
+				break;
+			atts[ 2 * n ] = NULL;
+			sax->startElement( &xmlcontext, strings[ name ], n ? atts : NULL );
+			depth ++;
+		}
+		else if ( op == mltbin_text )
+		{
+			uint32_t value = read_string( &reader, count );
+			if ( !reader.error )
+				sax->characters( &xmlcontext, strings[ value ], lengths[ value ] );
+		}
+		else if ( op == mltbin_property )
+		{
+			read_property( &reader, sax, &xmlcontext, strings, count );
+		}
+		else if ( op == mltbin_end && depth > 0 )
+		{
+			uint32_t name = read_string( &reader, count );
+			if ( !reader.error )
+				sax->endElement( &xmlcontext, strings[ name ] );
+			depth --;
+		}
+		else
+		{
+			reader.error = 1;
+		}
+	}
+
+	free( atts );
+	free( strings );
+	free( lengths );
+	munmap( map, st.st_size );
+
+	return !reader.error && depth == 0;
+}
+
+mlt_producer producer_mltbin_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *arg )
+{
+	return producer_xml_load( profile, arg, 0, parse_mltbin );
+}
@@ -70,6 +70,9 @@ struct deserialise_context_s
 	mlt_properties producer_map;
 	mlt_properties destructors;
 	char *property;
+	char *value;
+	size_t value_length;
+	size_t value_size;
 	int is_value;
 	xmlDocPtr value_doc;
 	xmlNodePtr stack_node[ STACK_SIZE ];
@@ -82,10 +85,16 @@ struct deserialise_context_s
 	const xmlChar *systemId;
 	mlt_properties params;
 	mlt_profile profile;
-	int pass;
+	int restart;		// 1 when the profile came late, 2 once parsing again
 };
 typedef struct deserialise_context_s *deserialise_context;
 
+/** A parser delivers SAX events with user_data as the private data of the
+	parser context, returning 1 when well formed, 0 when not and -1 when the
+	input can not be read.
+*/
+typedef int ( *xml_parser )( xmlSAXHandlerPtr sax, void *user_data, const char *filename, const char *data );
+
 /** Convert the numerical current branch address to a dot-delimited string.
 */
 static char *serialise_branch( deserialise_context this, char *s )
@@ -1063,6 +1072,7 @@ static void on_start_property( deserialise_context context, const xmlChar *name,
 
 		if ( context->property != NULL )
 			mlt_properties_set( properties, context->property, value == NULL ? "" : value );
+		context->value_length = 0;
 
 		// Tell parser to collect any further nodes for serialisation
 		context->is_value = 1;
@@ -1103,6 +1113,24 @@ static void on_end_property( deserialise_context context, const xmlChar *name )
 			xmlFreeDoc( context->value_doc );
 			context->value_doc = NULL;
 		}
+		else if ( context->property != NULL && context->value_length > 0 )
+		{
+			// Append the collected text to the value attribute, if any
+			char *s = mlt_properties_get( properties, context->property );
+			if ( s != NULL && s[ 0 ] )
+			{
+				char *new = malloc( strlen( s ) + context->value_length + 1 );
+				strcpy( new, s );
+				strcat( new, context->value );
+				mlt_properties_set( properties, context->property, new );
+				free( new );
+			}
+			else
+			{
+				mlt_properties_set( properties, context->property, context->value );
+			}
+		}
+		context->value_length = 0;
 
 		// Close this property handling
 		free( context->property );
@@ -1116,25 +1144,49 @@ static void on_end_property( deserialise_context context, const xmlChar *name )
 	}
 }
 
+/** Get the properties a property element would set, for a parser that sets a
+	typed value in place of the element.
+
+	This counts as an element in the branch of the document, so services get
+	the same branch as when the element is parsed.
+
+	\return the properties or NULL when the value must be given as an element
+*/
+
+mlt_properties producer_xml_property( void *ctx )
+{
+	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
+	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
+	mlt_service service = NULL;
+
+	if ( context->is_value == 0 && context->stack_service_size > 0 )
+		service = context->stack_service[ context->stack_service_size - 1 ];
+	if ( service != NULL )
+		context->branch[ context->depth ] ++;
+	return service != NULL ? MLT_SERVICE_PROPERTIES( service ) : NULL;
+}
+
 static void on_start_element( void *ctx, const xmlChar *name, const xmlChar **atts)
 {
 	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
 	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
 	
 //printf("on_start_element: %s\n", name );
-	if ( context->pass == 0 )
+	if ( context->is_value == 0 &&
+	     ( xmlStrcmp( name, _x("mlt") ) == 0 ||
+	       xmlStrcmp( name, _x("profile") ) == 0 ||
+	       xmlStrcmp( name, _x("profileinfo") ) == 0 ) )
 	{
-		if ( xmlStrcmp( name, _x("mlt") ) == 0 ||
-		     xmlStrcmp( name, _x("profile") ) == 0 ||
-		     xmlStrcmp( name, _x("profileinfo") ) == 0 )
-			on_start_profile( context, name, atts );
-		return;
+		// Services created so far used the wrong profile, so the document is parsed again
+		if ( context->restart == 0 && mlt_properties_get_int( context->destructors, "registered" ) > 0 )
+			context->restart = 1;
+		on_start_profile( context, name, atts );
 	}
 	context->branch[ context->depth ] ++;
 	context->depth ++;
 	
 	// Build a tree from nodes within a property value
-	if ( context->is_value == 1 && context->pass == 1 )
+	if ( context->is_value == 1 )
 	{
 		xmlNodePtr node = xmlNewNode( NULL, name );
 		
@@ -1186,7 +1238,7 @@ static void on_end_element( void *ctx, const xmlChar *name )
 	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
 	
 //printf("on_end_element: %s\n", name );
-	if ( context->is_value == 1 && context->pass == 1 && xmlStrcmp( name, _x("property") ) != 0 )
+	if ( context->is_value == 1 && xmlStrcmp( name, _x("property") ) != 0 )
 		context_pop_node( context );
 	else if ( xmlStrcmp( name, _x("multitrack") ) == 0 )
 		on_end_multitrack( context, name );
@@ -1215,41 +1267,33 @@ static void on_characters( void *ctx, const xmlChar *ch, int len )
 {
 	struct _xmlParserCtxt *xmlcontext = ( struct _xmlParserCtxt* )ctx;
 	deserialise_context context = ( deserialise_context )( xmlcontext->_private );
-	char *value = calloc( len + 1, 1 );
-	enum service_type type;
-	mlt_service service = context_pop_service( context, &type );
-	mlt_properties properties = MLT_SERVICE_PROPERTIES( service );
-
-	if ( service != NULL )
-		context_push_service( context, service, type );
-
-	value[ len ] = 0;
-	strncpy( value, (const char*) ch, len );
 
 	if ( context->stack_node_size > 0 )
-		xmlNodeAddContent( context->stack_node[ context->stack_node_size - 1 ], ( xmlChar* )value );
+		xmlNodeAddContentLen( context->stack_node[ context->stack_node_size - 1 ], ch, len );
 
 	// libxml2 generates an on_characters immediately after a get_entity within
 	// an element value, and we ignore it because it is called again during
 	// actual substitution.
 	else if ( context->property != NULL && context->entity_is_replace == 0 )
 	{
-		char *s = mlt_properties_get( properties, context->property );
-		if ( s != NULL )
+		// Collect the text until the end of the property - large values arrive
+		// in many pieces
+		if ( context->value_length + len + 1 > context->value_size )
 		{
-			// Append new text to existing content
-			char *new = calloc( strlen( s ) + len + 1, 1 );
-			strcat( new, s );
-			strcat( new, value );
-			mlt_properties_set( properties, context->property, new );
-			free( new );
+			size_t size = context->value_size ? context->value_size : 1024;
+			while ( size < context->value_length + len + 1 )
+				size *= 2;
+			char *value = realloc( context->value, size );
+			if ( value == NULL )
+				return;
+			context->value = value;
+			context->value_size = size;
 		}
-		else
-			mlt_properties_set( properties, context->property, value );
+		memcpy( context->value + context->value_length, ch, len );
+		context->value_length += len;
+		context->value[ context->value_length ] = 0;
 	}
 	context->entity_is_replace = 0;
-	
-	free( value);
 }
 
 /** Convert parameters parsed from resource into entity declarations.
@@ -1415,16 +1459,48 @@ static int file_exists( char *file )
 	return exists;
 }
 
-mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *data )
+/** Run libxml2 over a file or a string, returning whether it was well formed.
+*/
+static int parse_xml( xmlSAXHandlerPtr sax, void *user_data, const char *filename, const char *data )
+{
+	struct _xmlParserCtxt *xmlcontext;
+	int well_formed = 0;
+
+	if ( filename != NULL )
+		xmlcontext = xmlCreateFileParserCtxt( filename );
+	else
+		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
+
+	// Invalid context
+	if ( xmlcontext == NULL )
+		return -1;
+
+	xmlcontext->sax = sax;
+	xmlcontext->_private = user_data;
+	xmlParseDocument( xmlcontext );
+	well_formed = xmlcontext->wellFormed;
+
+	// Cleanup after parsing
+	xmlcontext->sax = NULL;
+	xmlcontext->_private = NULL;
+	xmlFreeParserCtxt( xmlcontext );
+
+	return well_formed;
+}
+
+/** Build the service network from the SAX events delivered by a parser.
+
+	This is shared with the binary project format, which replays the same
+	events without any text parsing.
+*/
+mlt_producer producer_xml_load( mlt_profile profile, char *data, int info, xml_parser parse )
 {
 	xmlSAXHandler *sax = calloc( 1, sizeof( xmlSAXHandler ) );
 	struct deserialise_context_s *context = calloc( 1, sizeof( struct deserialise_context_s ) );
 	mlt_properties properties = NULL;
 	int i = 0;
-	struct _xmlParserCtxt *xmlcontext;
 	int well_formed = 0;
 	char *filename = NULL;
-	int info = strcmp( id, "xml-string" ) ? 0 : 1;
 
 	if ( data == NULL || !strcmp( data, "" ) || ( info == 0 && !file_exists( data ) ) )
 		return NULL;
@@ -1471,77 +1547,75 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 
 	// Setup SAX callbacks
 	sax->startElement = on_start_element;
+	sax->endElement = on_end_element;
+	sax->characters = on_characters;
+	sax->cdataBlock = on_characters;
+	sax->internalSubset = on_internal_subset;
+	sax->entityDecl = on_entity_declaration;
+	sax->getEntity = on_get_entity;
 
 	// Setup libxml2 SAX parsing
 	xmlInitParser(); 
 	xmlSubstituteEntitiesDefault( 1 );
-	// This is used to facilitate entity substitution in the SAX parser
-	context->entity_doc = xmlNewDoc( _x("1.0") );
-	if ( info == 0 )
-		xmlcontext = xmlCreateFileParserCtxt( filename );
-	else
-		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
 
-	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
+	// Parse - a second time only when the profile follows the first service
+	do
 	{
-		mlt_properties_close( context->producer_map );
-		mlt_properties_close( context->destructors );
-		mlt_properties_close( context->params );
-		free( context );
-		free( sax );
-		free( filename );
-		return NULL;
-	}
+		if ( context->restart )
+		{
+			char *root = strdup( mlt_properties_get( context->producer_map, "root" ) );
+
+			// Discard everything built by the previous parse
+			mlt_properties_close( context->producer_map );
+			mlt_properties_close( context->destructors );
+			context->producer_map = mlt_properties_new();
+			context->destructors = mlt_properties_new();
+			mlt_properties_set( context->producer_map, "root", root );
+			mlt_properties_set_int( context->destructors, "registered", 0 );
+			free( root );
+			if ( context->params != NULL )
+				mlt_properties_close( context->params );
+			context->params = mlt_properties_new();
+			if ( info == 0 )
+				parse_url( context->params, url_decode( filename, data ) );
+			free( context->property );
+			context->property = NULL;
+			context->is_value = 0;
+			context->depth = 0;
+			memset( context->branch, 0, sizeof( context->branch ) );
+			context->stack_node_size = 0;
+			context->stack_service_size = 0;
+			context->restart = 2;
+		}
 
-	// Parse
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;	
-	xmlParseDocument( xmlcontext );
-	
-	// Cleanup after parsing
-	xmlcontext->sax = NULL;
-	xmlcontext->_private = NULL;
-	xmlFreeParserCtxt( xmlcontext );
-	context->stack_node_size = 0;
-	context->stack_service_size = 0;
+		// This is used to facilitate entity substitution in the SAX parser
+		context->entity_doc = xmlNewDoc( _x("1.0") );
+		well_formed = parse( sax, context, info == 0 ? filename : NULL, data );
 
-	// Setup the second pass
-	context->pass ++;
-	if ( info == 0 )
-		xmlcontext = xmlCreateFileParserCtxt( filename );
-	else
-		xmlcontext = xmlCreateMemoryParserCtxt( data, strlen( data ) );
+		// Invalid context - clean up and return NULL
+		if ( well_formed < 0 )
+		{
+			mlt_properties_close( context->producer_map );
+			mlt_properties_close( context->destructors );
+			if ( context->params != NULL )
+				mlt_properties_close( context->params );
+			xmlFreeDoc( context->entity_doc );
+			free( context->value );
+			free( context );
+			free( sax );
+			free( filename );
+			return NULL;
+		}
 
-	// Invalid context - clean up and return NULL
-	if ( xmlcontext == NULL )
-	{
-		mlt_properties_close( context->producer_map );
-		mlt_properties_close( context->destructors );
-		mlt_properties_close( context->params );
+		// Cleanup after parsing
 		xmlFreeDoc( context->entity_doc );
-		free( context );
-		free( sax );
-		free( filename );
-		return NULL;
+		if ( context->value_doc != NULL )
+		{
+			xmlFreeDoc( context->value_doc );
+			context->value_doc = NULL;
+		}
 	}
-
-	// Setup SAX callbacks
-	sax->endElement = on_end_element;
-	sax->characters = on_characters;
-	sax->cdataBlock = on_characters;
-	sax->internalSubset = on_internal_subset;
-	sax->entityDecl = on_entity_declaration;
-	sax->getEntity = on_get_entity;
-
-	// Parse
-	xmlcontext->sax = sax;
-	xmlcontext->_private = ( void* )context;
-	xmlParseDocument( xmlcontext );
-	well_formed = xmlcontext->wellFormed;
-
-	// Cleanup after parsing
-	xmlFreeDoc( context->entity_doc );
+	while ( context->restart == 1 && well_formed );
 	free( sax );
 	xmlMemoryDump( ); // for debugging
 
@@ -1620,8 +1694,15 @@ mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype,
 	if ( context->params != NULL )
 		mlt_properties_close( context->params );
 	mlt_properties_close( context->destructors );
+	free( context->property );
+	free( context->value );
 	free( context );
 	free( filename );
 
 	return MLT_PRODUCER( service );
 }
+
+mlt_producer producer_xml_init( mlt_profile profile, mlt_service_type servtype, const char *id, char *data )
+{
+	return producer_xml_load( profile, data, strcmp( id, "xml-string" ) ? 0 : 1, parse_xml );
+}
@@ -0,0 +1,69 @@
+/*
+ * audioconvert.c -- benchmark the audio format conversions
+ *
+ * usage: audioconvert [seconds]
+ *
+ * Converts frames of 1920 samples at 48KHz between every pair of formats for
+ * 2, 8 and 16 channels and prints how many seconds of audio are converted per
+ * second of processor time.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define SAMPLES 1920
+
+static mlt_audio_format formats[] = { mlt_audio_s16, mlt_audio_s32, mlt_audio_float, mlt_audio_s32le, mlt_audio_f32le };
+
+int main( int argc, char **argv )
+{
+	double seconds = argc > 1 ? atof( argv[ 1 ] ) : 0.2;
+	int channel_counts[] = { 2, 8, 16 };
+	int i, j, k;
+
+	for ( k = 0; k < 3; k ++ )
+	{
+		int channels = channel_counts[ k ];
+		float *source = malloc( SAMPLES * channels * sizeof( float ) );
+		void *input = malloc( SAMPLES * channels * sizeof( int32_t ) );
+		void *output = malloc( SAMPLES * channels * sizeof( int32_t ) );
+
+		for ( i = 0; i < SAMPLES * channels; i ++ )
+			source[ i ] = ( float )( ( i * 7919 ) % 65536 - 32768 ) / 32768.0;
+
+		printf( "%d channels\n", channels );
+		for ( i = 0; i < 5; i ++ )
+		{
+			mlt_audio_convert( input, formats[ i ], source, mlt_audio_f32le, SAMPLES, channels );
+			for ( j = 0; j < 5; j ++ )
+			{
+				clock_t start = clock( );
+				clock_t end = start + seconds * CLOCKS_PER_SEC;
+				long frames = 0;
+				double elapsed;
+
+				if ( i == j )
+					continue;
+				do
+				{
+					mlt_audio_convert( output, formats[ j ], input, formats[ i ], SAMPLES, channels );
+					frames ++;
+				}
+				while ( clock( ) < end );
+				elapsed = ( double )( clock( ) - start ) / CLOCKS_PER_SEC;
+
+				printf( "\t%-6s -> %-6s %8.0fx realtime\n", mlt_audio_format_name( formats[ i ] ),
+					mlt_audio_format_name( formats[ j ] ), frames * SAMPLES / 48000.0 / elapsed );
+			}
+		}
+
+		free( source );
+		free( input );
+		free( output );
+	}
+
+	return 0;
+}
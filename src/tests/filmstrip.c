@@ -0,0 +1,131 @@
+/*
+ * filmstrip.c -- check that the filmstrip consumer renders the connected producer
+ *
+ * usage: filmstrip [threads]
+ *
+ * Connects the filmstrip consumer to a colour whose resource was changed after
+ * it was created and which fades out with a brightness filter, and compares
+ * each thumbnail of the sprite with the frame rendered directly at the same
+ * size. Prints whether each thumbnail is byte for byte the same and exits with
+ * 1 if any differ.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 6
+#define LENGTH 100
+#define WIDTH 80
+#define HEIGHT 45
+
+/** Create the producer with an override and a filter that a reopened one would not have.
+*/
+
+static mlt_producer create_producer( mlt_profile profile )
+{
+	mlt_producer producer = mlt_factory_producer( profile, NULL, "colour:red" );
+	mlt_filter filter = mlt_factory_filter( profile, "brightness", NULL );
+
+	if ( producer == NULL || filter == NULL )
+	{
+		fprintf( stderr, "missing core services, set MLT_REPOSITORY\n" );
+		exit( 1 );
+	}
+
+	mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), "resource", "0x3070b0ff" );
+	mlt_producer_set_in_and_out( producer, 0, LENGTH - 1 );
+	mlt_properties_set_double( MLT_FILTER_PROPERTIES( filter ), "start", 1.0 );
+	mlt_properties_set_double( MLT_FILTER_PROPERTIES( filter ), "end", 0.0 );
+	mlt_filter_set_in_and_out( filter, 0, LENGTH - 1 );
+	mlt_producer_attach( producer, filter );
+	mlt_filter_close( filter );
+
+	return producer;
+}
+
+/** Render a thumbnail directly as the consumer should.
+*/
+
+static uint8_t *render( mlt_producer producer, int position, mlt_profile profile )
+{
+	mlt_frame frame = NULL;
+	mlt_image_format format = mlt_image_rgb24;
+	int width = WIDTH;
+	int height = HEIGHT;
+	uint8_t *image = NULL;
+	uint8_t *data = NULL;
+
+	mlt_producer_seek( producer, position );
+	mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+	mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "rescale.interp", "bilinear" );
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_deinterlace", 1 );
+	mlt_properties_set_double( MLT_FRAME_PROPERTIES( frame ), "consumer_aspect_ratio", mlt_profile_sar( profile ) );
+	mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+	if ( image != NULL && format == mlt_image_rgb24 && width == WIDTH && height == HEIGHT )
+	{
+		data = malloc( WIDTH * HEIGHT * 3 );
+		memcpy( data, image, WIDTH * HEIGHT * 3 );
+	}
+	mlt_frame_close( frame );
+
+	return data;
+}
+
+int main( int argc, char **argv )
+{
+	int threads = argc > 1 ? atoi( argv[ 1 ] ) : 2;
+	mlt_profile profile;
+	mlt_producer producer;
+	mlt_consumer consumer;
+	mlt_properties properties;
+	uint8_t *sprite;
+	int failed = 0;
+	int i, y;
+
+	mlt_factory_init( NULL );
+	profile = mlt_profile_init( NULL );
+	producer = create_producer( profile );
+	consumer = mlt_factory_consumer( profile, "filmstrip", NULL );
+	if ( consumer == NULL )
+	{
+		fprintf( stderr, "missing the filmstrip consumer, set MLT_REPOSITORY\n" );
+		return 1;
+	}
+	properties = MLT_CONSUMER_PROPERTIES( consumer );
+	mlt_properties_set_int( properties, "count", COUNT );
+	mlt_properties_set_int( properties, "width", WIDTH );
+	mlt_properties_set_int( properties, "height", HEIGHT );
+	mlt_properties_set_int( properties, "threads", threads );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( producer ) );
+	mlt_consumer_start( consumer );
+
+	sprite = mlt_properties_get_data( properties, "sprite", NULL );
+	if ( sprite == NULL || mlt_properties_get_int( properties, "sprite_width" ) != COUNT * WIDTH )
+	{
+		fprintf( stderr, "no sprite\n" );
+		return 1;
+	}
+
+	for ( i = 0; i < COUNT; i ++ )
+	{
+		int position = i * ( LENGTH - 1 ) / ( COUNT - 1 );
+		uint8_t *thumbnail = render( producer, position, profile );
+		int same = thumbnail != NULL;
+
+		for ( y = 0; same && y < HEIGHT; y ++ )
+			same = !memcmp( sprite + y * COUNT * WIDTH * 3 + i * WIDTH * 3, thumbnail + y * WIDTH * 3, WIDTH * 3 );
+		printf( "thumbnail %d (frame %d): %s\n", i, position, same ? "ok" : "DIFFERENT" );
+		failed += !same;
+		free( thumbnail );
+	}
+
+	mlt_consumer_close( consumer );
+	mlt_producer_close( producer );
+	mlt_profile_close( profile );
+	mlt_factory_close( );
+
+	return failed != 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * ladspa.c -- benchmark a LADSPA rack
+ *
+ * usage: ladspa [channels] [plugins] [frames]
+ *
+ * Runs a rack of a 256 tap FIR filter, a mono plugin defined here and so one
+ * copy per channel, on blocks of 1920 samples and prints the time per block
+ * and a checksum of the output, which a change to the rack must not alter.
+ */
+
+#include <modules/jackrack/process.h>
+#include <modules/jackrack/plugin.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define SAMPLES 1920
+#define TAPS 256
+
+typedef struct
+{
+	LADSPA_Data *input;
+	LADSPA_Data *output;
+	LADSPA_Data history[ TAPS * 2 ];
+	int head;
+}
+fir;
+
+static LADSPA_Handle fir_instantiate( const LADSPA_Descriptor *descriptor, unsigned long rate )
+{
+	return calloc( 1, sizeof( fir ) );
+}
+
+static void fir_connect_port( LADSPA_Handle handle, unsigned long port, LADSPA_Data *data )
+{
+	fir *self = handle;
+	if ( port == 0 )
+		self->input = data;
+	else
+		self->output = data;
+}
+
+static void fir_run( LADSPA_Handle handle, unsigned long samples )
+{
+	fir *self = handle;
+	unsigned long i;
+	int k;
+
+	for ( i = 0; i < samples; i ++ )
+	{
+		LADSPA_Data sum = 0;
+		self->history[ self->head ] = self->history[ self->head + TAPS ] = self->input[ i ];
+		for ( k = 0; k < TAPS; k ++ )
+			sum += self->history[ self->head + TAPS - k ] / TAPS;
+		self->head = ( self->head + 1 ) % TAPS;
+		self->output[ i ] = sum;
+	}
+}
+
+static void fir_cleanup( LADSPA_Handle handle )
+{
+	free( handle );
+}
+
+static LADSPA_Descriptor fir_descriptor;
+static unsigned long fir_input = 0;
+static unsigned long fir_output = 1;
+static plugin_desc_t fir_desc;
+
+static plugin_t *fir_plugin( int channels )
+{
+	plugin_t *plugin = calloc( 1, sizeof( plugin_t ) );
+	int i;
+
+	plugin->desc = &fir_desc;
+	plugin->descriptor = &fir_descriptor;
+	plugin->enabled = TRUE;
+	plugin->copies = channels;
+	plugin->holders = calloc( channels, sizeof( ladspa_holder_t ) );
+	plugin->audio_output_memory = calloc( channels, sizeof( LADSPA_Data * ) );
+	for ( i = 0; i < channels; i ++ )
+	{
+		plugin->holders[ i ].instance = fir_instantiate( &fir_descriptor, 48000 );
+		plugin->audio_output_memory[ i ] = calloc( MAX_BUFFER_SIZE, sizeof( LADSPA_Data ) );
+	}
+
+	return plugin;
+}
+
+static double now( )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+int main( int argc, char **argv )
+{
+	int channels = argc > 1 ? atoi( argv[ 1 ] ) : 8;
+	int plugins = argc > 2 ? atoi( argv[ 2 ] ) : 4;
+	int frames = argc > 3 ? atoi( argv[ 3 ] ) : 200;
+	LADSPA_Data *buffer = malloc( channels * SAMPLES * sizeof( LADSPA_Data ) );
+	LADSPA_Data **planes = malloc( channels * sizeof( LADSPA_Data * ) );
+	process_info_t *procinfo = process_info_new( NULL, channels, FALSE, FALSE );
+	double start, elapsed, checksum = 0;
+	int i;
+
+	fir_descriptor.instantiate = fir_instantiate;
+	fir_descriptor.connect_port = fir_connect_port;
+	fir_descriptor.run = fir_run;
+	fir_descriptor.cleanup = fir_cleanup;
+	fir_desc.channels = 1;
+	fir_desc.audio_input_port_indicies = &fir_input;
+	fir_desc.audio_output_port_indicies = &fir_output;
+
+	for ( i = 0; i < channels; i ++ )
+		planes[ i ] = buffer + i * SAMPLES;
+
+	for ( i = 0; i < plugins; i ++ )
+		process_add_plugin( procinfo, fir_plugin( channels ) );
+
+	for ( i = 0; i < channels * SAMPLES; i ++ )
+		buffer[ i ] = ( i % 97 ) / 97.0;
+
+	start = now( );
+	for ( i = 0; i < frames; i ++ )
+		process_ladspa( procinfo, SAMPLES, planes, planes );
+	elapsed = now( ) - start;
+
+	for ( i = 0; i < channels * SAMPLES; i ++ )
+		checksum += buffer[ i ];
+	printf( "%d channels, %d plugins: %.3fms per frame, checksum %f\n",
+		channels, plugins, elapsed * 1000 / frames, checksum );
+
+	process_info_destroy( procinfo );
+	free( planes );
+	free( buffer );
+
+	return 0;
+}
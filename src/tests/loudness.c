@@ -0,0 +1,101 @@
+/*
+ * loudness.c -- check the EBU R128 loudness meter of the normalize module
+ *
+ * usage: loudness
+ *
+ * Measures 1KHz sines at 48KHz and prints each reading beside the expected
+ * value, along with whether it is within 0.1 LU of it:
+ *
+ * - stereo at -23 LUFS;
+ * - 5.1 (L R C LFE Ls Rs) at -23 LUFS in L and R, with a full scale LFE that
+ *   must be ignored;
+ * - 5.1 with the same sine in Ls only, which is 3.01dB quieter for being in one
+ *   channel and 1.5dB louder for being a surround;
+ * - stereo at -36, -23 and -36 LUFS for 10s, 20s and 10s, so the gate keeps
+ *   only the middle (case 3 of EBU Tech 3341).
+ */
+
+#include <modules/normalize/loudness.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define FREQUENCY 48000
+
+/** Get the amplitude of a 1KHz sine in each of two channels for a loudness.
+*/
+
+static double amplitude( double lufs )
+{
+	// The K-weighting gain at 1KHz is close to 0dB, so a full scale sine in
+	// both channels of stereo reads 0 LUFS
+	return pow( 10.0, lufs / 20.0 );
+}
+
+/** Add seconds of a sine at an amplitude to the given channels of a meter.
+*/
+
+static void measure( loudness meter, int channels, const int *mask, double level, double seconds, double *phase )
+{
+	int samples = FREQUENCY / 10;
+	int16_t *pcm = malloc( samples * channels * sizeof( int16_t ) );
+	int blocks = seconds * 10;
+	int i, j, c;
+
+	for ( j = 0; j < blocks; j ++ )
+	{
+		for ( i = 0; i < samples; i ++ )
+		{
+			double s = sin( *phase );
+			*phase += 2 * M_PI * 1000 / FREQUENCY;
+			for ( c = 0; c < channels; c ++ )
+				pcm[ i * channels + c ] = mask[ c ] == 2 ? 32767 * s : mask[ c ] ? 32767 * level * s : 0;
+		}
+		loudness_process( meter, pcm, samples );
+	}
+	free( pcm );
+}
+
+static int check( const char *name, double value, double expected )
+{
+	int ok = fabs( value - expected ) <= 0.1;
+	printf( "%-32s %8.3f LUFS, expected %8.3f: %s\n", name, value, expected, ok ? "ok" : "FAILED" );
+	return ok;
+}
+
+int main( int argc, char **argv )
+{
+	int stereo[] = { 1, 1 };
+	// 1 marks a channel with the sine and 2 one with it at full scale
+	int front[] = { 1, 1, 0, 2, 0, 0 };
+	int surround[] = { 0, 0, 0, 0, 1, 0 };
+	double phase = 0;
+	int failed = 0;
+	loudness meter;
+
+	meter = loudness_init( 2, FREQUENCY );
+	measure( meter, 2, stereo, amplitude( -23 ), 20, &phase );
+	failed += !check( "stereo", loudness_integrated( meter ), -23 );
+	failed += !check( "stereo short term", loudness_short_term( meter ), -23 );
+	loudness_close( meter );
+
+	meter = loudness_init( 6, FREQUENCY );
+	measure( meter, 6, front, amplitude( -23 ), 20, &phase );
+	failed += !check( "5.1 front with LFE", loudness_integrated( meter ), -23 );
+	loudness_close( meter );
+
+	meter = loudness_init( 6, FREQUENCY );
+	measure( meter, 6, surround, amplitude( -23 ), 20, &phase );
+	failed += !check( "5.1 left surround", loudness_integrated( meter ), -23 - 3.01 + 10 * log10( 1.41 ) );
+	loudness_close( meter );
+
+	meter = loudness_init( 2, FREQUENCY );
+	measure( meter, 2, stereo, amplitude( -36 ), 10, &phase );
+	measure( meter, 2, stereo, amplitude( -23 ), 20, &phase );
+	measure( meter, 2, stereo, amplitude( -36 ), 10, &phase );
+	failed += !check( "gated stereo", loudness_integrated( meter ), -23 );
+	loudness_close( meter );
+
+	return failed != 0;
+}
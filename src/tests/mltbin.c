@@ -0,0 +1,170 @@
+/*
+ * mltbin.c -- check the binary project format against xml
+ *
+ * usage: mltbin [clips]
+ *
+ * Builds a project of colour clips with filters holding int, double, string
+ * and keyframe values and a composite with geometry keyframes, saves it as xml,
+ * then loads that and saves it both as xml and in the binary format. The
+ * binary file loaded and saved as xml must give the same document. Prints the
+ * size of each file and the time to load each, and exits with 1 if the
+ * documents differ.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double now( )
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void save( mlt_profile profile, mlt_producer producer, const char *id, const char *filename )
+{
+	mlt_consumer consumer = mlt_factory_consumer( profile, id, filename );
+
+	if ( consumer == NULL )
+	{
+		fprintf( stderr, "missing the %s consumer, set MLT_REPOSITORY\n", id );
+		exit( 1 );
+	}
+	mlt_properties_set( MLT_CONSUMER_PROPERTIES( consumer ), "title", "mltbin" );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( producer ) );
+	mlt_consumer_start( consumer );
+	mlt_consumer_close( consumer );
+}
+
+/** Load a file and save it as xml, returning the seconds the load took.
+*/
+
+static double load( mlt_profile profile, const char *id, const char *filename, const char *output )
+{
+	double start = now( );
+	mlt_producer producer = mlt_factory_producer( profile, id, ( char* )filename );
+	double elapsed = now( ) - start;
+
+	if ( producer == NULL )
+	{
+		fprintf( stderr, "failed to load %s\n", filename );
+		exit( 1 );
+	}
+	save( profile, producer, "xml", output );
+	mlt_producer_close( producer );
+
+	return elapsed;
+}
+
+static mlt_producer build( mlt_profile profile, int clips )
+{
+	mlt_playlist playlist = mlt_playlist_init( );
+	mlt_tractor tractor = mlt_tractor_new( );
+	mlt_playlist overlay = mlt_playlist_init( );
+	mlt_transition composite = mlt_factory_transition( profile, "composite", NULL );
+	int i;
+
+	if ( composite == NULL )
+	{
+		fprintf( stderr, "missing core services, set MLT_REPOSITORY\n" );
+		exit( 1 );
+	}
+	for ( i = 0; i < clips; i ++ )
+	{
+		mlt_producer clip = mlt_factory_producer( profile, "colour", i % 2 ? "red" : "0x336699ff" );
+		mlt_filter filter = mlt_factory_filter( profile, "brightness", NULL );
+		mlt_properties properties = MLT_FILTER_PROPERTIES( filter );
+
+		mlt_properties_set_double( properties, "start", 0.5 + i % 10 / 20.0 );
+		mlt_properties_set( properties, "end", "1" );
+		mlt_properties_set( properties, "level", "0.25" );
+		mlt_properties_set( properties, "note", "clip; with = text, 1:2" );
+		mlt_properties_set( properties, "geometry", "0=0,0:100%x100%:100;50=10.5%,-20:50%x50%:33.333333;99=-5,0:720x576" );
+		mlt_properties_set( properties, "odd", "007;0x100;1e3" );
+		mlt_producer_attach( clip, filter );
+		mlt_playlist_append_io( playlist, clip, 0, 24 + i % 50 );
+		mlt_playlist_append_io( overlay, clip, 0, 24 + i % 50 );
+		mlt_filter_close( filter );
+		mlt_producer_close( clip );
+	}
+
+	mlt_properties_set( MLT_TRANSITION_PROPERTIES( composite ), "geometry", "0=0,0:100%x100%:100;25=25%,25%:50%x50%:50" );
+	mlt_properties_set_int( MLT_TRANSITION_PROPERTIES( composite ), "progressive", 1 );
+	mlt_tractor_set_track( tractor, MLT_PLAYLIST_PRODUCER( playlist ), 0 );
+	mlt_tractor_set_track( tractor, MLT_PLAYLIST_PRODUCER( overlay ), 1 );
+	mlt_field_plant_transition( mlt_tractor_field( tractor ), composite, 0, 1 );
+	mlt_transition_close( composite );
+	mlt_playlist_close( playlist );
+	mlt_playlist_close( overlay );
+
+	return MLT_TRACTOR_PRODUCER( tractor );
+}
+
+static char *read_file( const char *filename, long *size )
+{
+	FILE *file = fopen( filename, "rb" );
+	char *data = NULL;
+
+	*size = 0;
+	if ( file != NULL )
+	{
+		fseek( file, 0, SEEK_END );
+		*size = ftell( file );
+		fseek( file, 0, SEEK_SET );
+		data = malloc( *size + 1 );
+		if ( fread( data, 1, *size, file ) != *size )
+			*size = 0;
+		data[ *size ] = 0;
+		fclose( file );
+	}
+
+	return data;
+}
+
+int main( int argc, char **argv )
+{
+	int clips = argc > 1 ? atoi( argv[ 1 ] ) : 100;
+	mlt_profile profile;
+	mlt_producer producer;
+	double xml_time, mltbin_time;
+	long xml_size, mltbin_size, size;
+	char *xml, *mltbin;
+	int same;
+
+	// Save loaded projects in full rather than as a reference to the file
+	setenv( "MLT_XML_DEEP", "1", 1 );
+	mlt_factory_init( NULL );
+	profile = mlt_profile_init( NULL );
+
+	producer = build( profile, clips );
+	save( profile, producer, "xml", "mltbin-source.mlt" );
+	mlt_producer_close( producer );
+
+	producer = mlt_factory_producer( profile, "xml", "mltbin-source.mlt" );
+	save( profile, producer, "mltbin", "mltbin.mltb" );
+	mlt_producer_close( producer );
+
+	xml_time = load( profile, "xml", "mltbin-source.mlt", "mltbin-xml.mlt" );
+	mltbin_time = load( profile, "mltbin", "mltbin.mltb", "mltbin-mltbin.mlt" );
+
+	free( read_file( "mltbin-source.mlt", &xml_size ) );
+	free( read_file( "mltbin.mltb", &mltbin_size ) );
+	xml = read_file( "mltbin-xml.mlt", &size );
+	mltbin = read_file( "mltbin-mltbin.mlt", &size );
+	same = xml != NULL && mltbin != NULL && !strcmp( xml, mltbin );
+
+	printf( "%d clips: xml %ld bytes loads in %.1fms, mltbin %ld bytes loads in %.1fms\n",
+		clips, xml_size, xml_time * 1000, mltbin_size, mltbin_time * 1000 );
+	printf( "documents: %s\n", same ? "same" : "DIFFERENT" );
+
+	free( xml );
+	free( mltbin );
+	mlt_profile_close( profile );
+	mlt_factory_close( );
+
+	return !same;
+}
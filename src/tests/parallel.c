@@ -0,0 +1,118 @@
+/*
+ * parallel.c -- check that a parallel tractor renders what a serial one does
+ *
+ * usage: parallel [threads]
+ *
+ * Builds a tractor of a colour with a colour composited at half size and
+ * another dissolved in with luma, and renders its frames with parallel set
+ * to 0 and to threads (2 by default). Prints whether the images of each
+ * frame are byte for byte the same and exits with 1 if any differ.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAMES 10
+
+/** Create the tractor.
+*/
+
+static mlt_tractor create_tractor( mlt_profile profile, int parallel )
+{
+	mlt_tractor tractor = mlt_tractor_new( );
+	mlt_field field = mlt_tractor_field( tractor );
+	mlt_producer background = mlt_factory_producer( profile, "colour", "green" );
+	mlt_producer overlay = mlt_factory_producer( profile, "colour", "0xff000080" );
+	mlt_producer fade = mlt_factory_producer( profile, "colour", "blue" );
+	mlt_transition composite = mlt_factory_transition( profile, "composite", "25%/25%:50%x50%" );
+	mlt_transition luma = mlt_factory_transition( profile, "luma", NULL );
+
+	if ( background == NULL || overlay == NULL || fade == NULL || composite == NULL || luma == NULL )
+	{
+		fprintf( stderr, "missing core services, set MLT_REPOSITORY\n" );
+		exit( 1 );
+	}
+
+	mlt_tractor_set_track( tractor, background, 0 );
+	mlt_tractor_set_track( tractor, overlay, 1 );
+	mlt_tractor_set_track( tractor, fade, 2 );
+	mlt_transition_set_in_and_out( luma, 0, FRAMES - 1 );
+	mlt_field_plant_transition( field, composite, 0, 1 );
+	mlt_field_plant_transition( field, luma, 0, 2 );
+	mlt_properties_set_int( MLT_TRACTOR_PROPERTIES( tractor ), "parallel", parallel );
+
+	mlt_producer_close( background );
+	mlt_producer_close( overlay );
+	mlt_producer_close( fade );
+	mlt_transition_close( composite );
+	mlt_transition_close( luma );
+
+	return tractor;
+}
+
+/** Render a frame into a buffer as a consumer would.
+*/
+
+static int render( mlt_tractor tractor, int position, mlt_profile profile, uint8_t **data )
+{
+	mlt_producer producer = MLT_TRACTOR_PRODUCER( tractor );
+	mlt_frame frame = NULL;
+	mlt_image_format format = mlt_image_yuv422;
+	int width = profile->width;
+	int height = profile->height;
+	uint8_t *image = NULL;
+	int size = 0;
+
+	mlt_producer_seek( producer, position );
+	mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+	mlt_properties_set( MLT_FRAME_PROPERTIES( frame ), "rescale.interp", "bilinear" );
+	mlt_properties_set_int( MLT_FRAME_PROPERTIES( frame ), "consumer_deinterlace", 1 );
+	mlt_properties_set_double( MLT_FRAME_PROPERTIES( frame ), "consumer_aspect_ratio", mlt_profile_sar( profile ) );
+	mlt_frame_get_image( frame, &image, &format, &width, &height, 0 );
+	if ( image != NULL )
+	{
+		size = width * height * 2;
+		*data = malloc( size );
+		memcpy( *data, image, size );
+	}
+	mlt_frame_close( frame );
+
+	return size;
+}
+
+int main( int argc, char **argv )
+{
+	int threads = argc > 1 ? atoi( argv[ 1 ] ) : 2;
+	mlt_profile profile;
+	mlt_tractor serial, parallel;
+	int failed = 0;
+	int i;
+
+	mlt_factory_init( NULL );
+	profile = mlt_profile_init( NULL );
+	serial = create_tractor( profile, 0 );
+	parallel = create_tractor( profile, threads );
+
+	for ( i = 0; i < FRAMES; i ++ )
+	{
+		uint8_t *a = NULL, *b = NULL;
+		int size_a = render( serial, i, profile, &a );
+		int size_b = render( parallel, i, profile, &b );
+		int same = size_a > 0 && size_a == size_b && !memcmp( a, b, size_a );
+
+		printf( "frame %d: %s\n", i, same ? "ok" : "DIFFERENT" );
+		failed += !same;
+		free( a );
+		free( b );
+	}
+
+	mlt_tractor_close( serial );
+	mlt_tractor_close( parallel );
+	mlt_profile_close( profile );
+	mlt_factory_close( );
+
+	return failed != 0;
+}
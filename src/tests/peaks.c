@@ -0,0 +1,267 @@
+/*
+ * peaks.c -- check the index of the peaks consumer and the file it keeps
+ *
+ * usage: peaks
+ *
+ * Connects the peaks consumer to a tone whose amplitude is a property and
+ * whose first channel a channelcopy filter copies to the second, and checks:
+ * that the levels of each block match the audio rendered directly, that the
+ * index is written to the cache directory in its fixed byte order, that it is
+ * used again without decoding, that changing the producer scans it again and
+ * that the beside property writes it beside the media instead. Exits with 1
+ * if any check fails.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define LENGTH 20
+#define FREQUENCY 48000
+#define CHANNELS 2
+#define BLOCK 256
+
+static int fetched = 0;
+static int failed = 0;
+
+static void check( int ok, const char *what )
+{
+	printf( "%s: %s\n", what, ok ? "ok" : "FAILED" );
+	failed += !ok;
+}
+
+/** Generate a tone on the first channel and silence on the second.
+*/
+
+static int tone_get_audio( mlt_frame frame, void **buffer, mlt_audio_format *format, int *frequency, int *channels, int *samples )
+{
+	mlt_properties properties = MLT_FRAME_PROPERTIES( frame );
+	double amplitude = mlt_properties_get_double( properties, "tone.amplitude" );
+	int64_t start = mlt_properties_get_int64( properties, "tone.start" );
+	int size = *samples * *channels * sizeof( int16_t );
+	int16_t *pcm = mlt_pool_alloc( size );
+	int i, c;
+
+	*format = mlt_audio_s16;
+	for ( i = 0; i < *samples; i ++ )
+		for ( c = 0; c < *channels; c ++ )
+			pcm[ i * *channels + c ] = c == 0 ? amplitude * sin( ( start + i ) * 2 * M_PI * 440 / *frequency ) : 0;
+	*buffer = pcm;
+	mlt_frame_set_audio( frame, pcm, *format, size, mlt_pool_release );
+
+	return 0;
+}
+
+static int tone_get_frame( mlt_producer producer, mlt_frame_ptr frame, int index )
+{
+	mlt_profile profile = mlt_service_profile( MLT_PRODUCER_SERVICE( producer ) );
+	mlt_position position = mlt_producer_position( producer );
+	double amplitude = mlt_properties_get_double( MLT_PRODUCER_PROPERTIES( producer ), "amplitude" );
+
+	*frame = mlt_frame_init( MLT_PRODUCER_SERVICE( producer ) );
+	mlt_frame_set_position( *frame, position );
+	mlt_properties_set_double( MLT_FRAME_PROPERTIES( *frame ), "tone.amplitude", amplitude * ( position + 1 ) / LENGTH );
+	mlt_properties_set_int64( MLT_FRAME_PROPERTIES( *frame ), "tone.start", mlt_sample_calculator_to_now( mlt_profile_fps( profile ), FREQUENCY, position ) );
+	mlt_frame_push_audio( *frame, tone_get_audio );
+	mlt_producer_prepare_next( producer );
+	fetched ++;
+
+	return 0;
+}
+
+static mlt_producer create_producer( mlt_profile profile, const char *media )
+{
+	mlt_producer producer = calloc( 1, sizeof( struct mlt_producer_s ) );
+	mlt_filter filter = mlt_factory_filter( profile, "channelcopy", NULL );
+
+	if ( filter == NULL )
+	{
+		fprintf( stderr, "missing core services, set MLT_REPOSITORY\n" );
+		exit( 1 );
+	}
+	mlt_producer_init( producer, NULL );
+	producer->get_frame = tone_get_frame;
+	mlt_properties_set_data( MLT_PRODUCER_PROPERTIES( producer ), "mlt_profile", profile, 0, NULL, NULL );
+	mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), "mlt_type", "producer" );
+	mlt_properties_set( MLT_PRODUCER_PROPERTIES( producer ), "resource", media );
+	mlt_properties_set_double( MLT_PRODUCER_PROPERTIES( producer ), "amplitude", 20000 );
+	mlt_producer_set_in_and_out( producer, 0, LENGTH - 1 );
+	mlt_producer_attach( producer, filter );
+	mlt_filter_close( filter );
+
+	return producer;
+}
+
+/** Query the levels of each block of the producer.
+*/
+
+static float *query( mlt_profile profile, mlt_producer producer, int pixels, int beside )
+{
+	mlt_consumer consumer = mlt_factory_consumer( profile, "peaks", NULL );
+	mlt_properties properties = MLT_CONSUMER_PROPERTIES( consumer );
+	float *peaks;
+	float *copy = NULL;
+
+	mlt_properties_set_int( properties, "frequency", FREQUENCY );
+	mlt_properties_set_int( properties, "channels", CHANNELS );
+	mlt_properties_set_int( properties, "pixels", pixels );
+	mlt_properties_set_int( properties, "beside", beside );
+	mlt_consumer_connect( consumer, MLT_PRODUCER_SERVICE( producer ) );
+	mlt_consumer_start( consumer );
+	peaks = mlt_properties_get_data( properties, "peaks", NULL );
+	if ( peaks != NULL )
+	{
+		copy = malloc( pixels * CHANNELS * 3 * sizeof( float ) );
+		memcpy( copy, peaks, pixels * CHANNELS * 3 * sizeof( float ) );
+	}
+	mlt_consumer_close( consumer );
+
+	return copy;
+}
+
+/** Compare the levels with those of the audio of the producer rendered directly.
+*/
+
+static int compare( mlt_profile profile, mlt_producer producer, float *peaks, int blocks )
+{
+	double fps = mlt_profile_fps( profile );
+	int64_t total = mlt_sample_calculator_to_now( fps, FREQUENCY, LENGTH );
+	int16_t *audio = malloc( total * CHANNELS * sizeof( int16_t ) );
+	int same = peaks != NULL && audio != NULL;
+	int position, block, c;
+
+	for ( position = 0; same && position < LENGTH; position ++ )
+	{
+		mlt_frame frame = NULL;
+		mlt_audio_format format = mlt_audio_s16;
+		int frequency = FREQUENCY;
+		int channels = CHANNELS;
+		int64_t start = mlt_sample_calculator_to_now( fps, FREQUENCY, position );
+		int samples = mlt_sample_calculator_to_now( fps, FREQUENCY, position + 1 ) - start;
+		int16_t *pcm = NULL;
+
+		mlt_producer_seek( producer, position );
+		mlt_service_get_frame( MLT_PRODUCER_SERVICE( producer ), &frame, 0 );
+		mlt_frame_get_audio( frame, ( void ** )&pcm, &format, &frequency, &channels, &samples );
+		memcpy( audio + start * CHANNELS, pcm, samples * CHANNELS * sizeof( int16_t ) );
+		mlt_frame_close( frame );
+	}
+
+	for ( block = 0; same && block < blocks; block ++ )
+	{
+		for ( c = 0; c < CHANNELS; c ++ )
+		{
+			float *levels = peaks + ( block * CHANNELS + c ) * 3;
+			int min = 32767, max = -32768;
+			double power = 0;
+			int i;
+
+			for ( i = block * BLOCK; i < ( block + 1 ) * BLOCK; i ++ )
+			{
+				int16_t sample = audio[ i * CHANNELS + c ];
+				min = sample < min ? sample : min;
+				max = sample > max ? sample : max;
+				power += ( double )sample * sample;
+			}
+			same = same && levels[ 0 ] == min / 32768.0f && levels[ 1 ] == max / 32768.0f
+				&& fabs( levels[ 2 ] - sqrt( power / BLOCK ) / 32768.0 ) < 1e-4;
+		}
+	}
+	free( audio );
+
+	return same;
+}
+
+static unsigned char *read_file( const char *filename, int *size )
+{
+	FILE *file = fopen( filename, "rb" );
+	unsigned char *data = NULL;
+
+	*size = 0;
+	if ( file != NULL )
+	{
+		fseek( file, 0, SEEK_END );
+		*size = ftell( file );
+		fseek( file, 0, SEEK_SET );
+		data = malloc( *size );
+		if ( fread( data, 1, *size, file ) != *size )
+			*size = 0;
+		fclose( file );
+	}
+
+	return data;
+}
+
+int main( int argc, char **argv )
+{
+	char directory[] = "/tmp/mlt-peaks-XXXXXX";
+	char media[ 100 ], beside[ 120 ], command[ 150 ];
+	mlt_profile profile;
+	mlt_producer producer;
+	float *first, *second, *changed;
+	unsigned char *data = NULL;
+	int blocks, size = 0, files = 0;
+	FILE *file;
+
+	if ( mkdtemp( directory ) == NULL )
+		return 1;
+	setenv( "XDG_CACHE_HOME", directory, 1 );
+	unsetenv( "MLT_REPOSITORY_CACHE" );
+	snprintf( media, sizeof( media ), "%s/media", directory );
+	snprintf( beside, sizeof( beside ), "%s.mltpeaks", media );
+	file = fopen( media, "w" );
+	fputs( "media", file );
+	fclose( file );
+
+	mlt_factory_init( NULL );
+	profile = mlt_profile_init( NULL );
+	producer = create_producer( profile, media );
+	blocks = mlt_sample_calculator_to_now( mlt_profile_fps( profile ), FREQUENCY, LENGTH ) / BLOCK;
+
+	first = query( profile, producer, blocks, 0 );
+	check( compare( profile, producer, first, blocks ), "levels of the connected producer" );
+
+	// The only other file in the directory is the index
+	snprintf( command, sizeof( command ), "ls %s | grep -c mlt-peaks-", directory );
+	file = popen( command, "r" );
+	if ( file != NULL && fscanf( file, "%d", &files ) != 1 )
+		files = 0;
+	if ( file != NULL )
+		pclose( file );
+	snprintf( command, sizeof( command ), "cat %s/mlt-peaks-* > %s/index", directory, directory );
+	if ( files == 1 && system( command ) == 0 )
+	{
+		snprintf( command, sizeof( command ), "%s/index", directory );
+		data = read_file( command, &size );
+	}
+	check( files == 1 && size > 36 && !memcmp( data, "MLTPEAKS\2\0\0\0\x80\xbb\0\0\2\0\0\0\0\1\0\0", 24 ), "index in the cache directory in little endian" );
+	check( access( beside, F_OK ) != 0, "nothing beside the media" );
+	free( data );
+
+	fetched = 0;
+	second = query( profile, producer, blocks, 0 );
+	check( fetched == 0 && second != NULL && !memcmp( first, second, blocks * CHANNELS * 3 * sizeof( float ) ), "index used again" );
+
+	mlt_properties_set_double( MLT_PRODUCER_PROPERTIES( producer ), "amplitude", 10000 );
+	fetched = 0;
+	changed = query( profile, producer, blocks, 1 );
+	check( fetched > 0 && compare( profile, producer, changed, blocks ), "changed producer scanned again" );
+	check( access( beside, F_OK ) == 0, "index beside the media when asked" );
+
+	free( first );
+	free( second );
+	free( changed );
+	mlt_producer_close( producer );
+	mlt_profile_close( profile );
+	mlt_factory_close( );
+
+	snprintf( command, sizeof( command ), "rm -rf %s", directory );
+	if ( system( command ) != 0 )
+		fprintf( stderr, "failed to remove %s\n", directory );
+
+	return failed != 0;
+}
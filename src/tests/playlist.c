@@ -0,0 +1,102 @@
+/*
+ * playlist.c -- check clip lookup in a playlist after edits
+ *
+ * usage: playlist
+ *
+ * Builds a playlist of colour clips of different lengths, edits it in every
+ * way that changes the offsets of its entries and after each edit checks the
+ * clip found at every position against the lengths of the clips before it.
+ * Prints the edits that fail and exits with 1 if any did.
+ */
+
+#include <framework/mlt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** Check every position of the playlist against the clip lengths.
+*/
+
+static int check( mlt_playlist playlist, const char *edit )
+{
+	mlt_playlist_clip_info info;
+	mlt_position start = 0;
+	int count = mlt_playlist_count( playlist );
+	int errors = 0;
+	int i, j;
+
+	for ( i = 0; i < count; i ++ )
+	{
+		mlt_playlist_get_clip_info( playlist, &info, i );
+		if ( info.start != start )
+			errors ++;
+		if ( mlt_playlist_clip( playlist, mlt_whence_relative_start, i ) != start )
+			errors ++;
+		for ( j = 0; j < info.frame_count; j ++ )
+			if ( mlt_playlist_get_clip_index_at( playlist, start + j ) != i )
+				errors ++;
+		start += info.frame_count;
+	}
+	if ( mlt_producer_get_playtime( MLT_PLAYLIST_PRODUCER( playlist ) ) != start )
+		errors ++;
+	if ( mlt_playlist_get_clip_index_at( playlist, start ) != count )
+		errors ++;
+
+	printf( "%-16s %3d clips %5d frames: %s\n", edit, count, start, errors ? "FAILED" : "ok" );
+	return errors != 0;
+}
+
+int main( int argc, char **argv )
+{
+	mlt_profile profile;
+	mlt_playlist playlist;
+	int failed = 0;
+	int i;
+
+	mlt_factory_init( NULL );
+	profile = mlt_profile_init( NULL );
+	playlist = mlt_playlist_init( );
+
+	for ( i = 0; i < 40; i ++ )
+	{
+		mlt_producer producer = mlt_factory_producer( profile, "colour", i % 2 ? "red" : "blue" );
+		if ( producer == NULL )
+		{
+			fprintf( stderr, "no colour producer, set MLT_REPOSITORY\n" );
+			return 1;
+		}
+		mlt_properties_set_int( MLT_PRODUCER_PROPERTIES( producer ), "length", 1000 );
+		mlt_playlist_append_io( playlist, producer, 0, i * 7 % 23 );
+		mlt_producer_close( producer );
+	}
+	failed += check( playlist, "append" );
+
+	mlt_playlist_remove( playlist, 3 );
+	failed += check( playlist, "remove" );
+	mlt_playlist_move( playlist, 0, 20 );
+	failed += check( playlist, "move forward" );
+	mlt_playlist_move( playlist, 30, 1 );
+	failed += check( playlist, "move back" );
+	mlt_playlist_blank( playlist, 9 );
+	failed += check( playlist, "blank" );
+	mlt_playlist_insert_blank( playlist, 5, 11 );
+	failed += check( playlist, "insert blank" );
+	mlt_playlist_resize_clip( playlist, 8, 2, 40 );
+	failed += check( playlist, "resize" );
+	mlt_playlist_split( playlist, 8, 10 );
+	failed += check( playlist, "split" );
+	mlt_playlist_join( playlist, 12, 2, 0 );
+	failed += check( playlist, "join" );
+	mlt_playlist_remove_region( playlist, 50, 30 );
+	failed += check( playlist, "remove region" );
+	mlt_playlist_repeat_clip( playlist, 2, 3 );
+	failed += check( playlist, "repeat" );
+	mlt_playlist_clear( playlist );
+	failed += check( playlist, "clear" );
+
+	mlt_playlist_close( playlist );
+	mlt_profile_close( profile );
+	mlt_factory_close( );
+
+	return failed != 0;
+}